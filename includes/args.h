@@ -20,6 +20,11 @@
      * This represents the maximum path length allowed.
      * 4096 is a common default on Linux systems.
      */
+    /* Export formats for --export */
+    #include "export.h"
+    /* Path globs for --only and --exclude */
+    #include "filter.h"
+
     #ifndef PATH_MAX
         #define PATH_MAX 4096
     #endif
@@ -30,13 +35,63 @@
      *  - input_files: dynamically allocated array of strings holding input filenames.
      *  - file_count: number of input files stored in input_files.
      *  - dest_path: string holding the destination directory path where output is created.
+     *  - dest_paths/dest_count: every destination given (--dest repeated, --dests file), dest_path is the first.
      *  - debug_mode: boolean flag indicating if debug mode is enabled.
+     *  - remove_mode: remove the tree described by the input files instead of building it.
+     *  - jobs: number of worker threads (0 = one per processor).
+     *  - pipeline_mode: overlap lexing, parsing and building.
+     *  - direct_mode: create entries straight from the tokens, without a tree.
+     *  - export_mode/export_format: print the parsed tree instead of building it.
+     *  - plan_path: compile the templates into this plan file instead of building them.
+     *  - apply_plan_path/show_plan_path: replay or print a plan file, no template is read.
+     *  - diff_old/diff_new: print the delta between two templates.
+     *  - update_mode: also apply that delta to the destination.
+     *  - watch_mode: build the template, then re-apply it on every save.
+     *  - serve_path: serve build requests on this Unix socket.
+     *  - client_path: send the build to the server listening on this socket.
+     *  - find_path: look this path up in the templates instead of building them.
+     *  - filter: --only/--exclude globs, compiled once and applied while parsing.
+     *  - preflight: check the destination has room for the build before creating anything.
+     *  - journal_path: checkpoint journal of a resumable build.
+     *  - batch_path: bindings table, one instance of the templates per row.
+     *  - dedup: create identical files as hard links of one inode.
+     *  - throttle: adapt the filesystem operations in flight to their latency.
+     *  - max_ops: cap on filesystem operations per second (0 = none).
+     *  - progress: report the entries done, rate and ETA while building.
+     *  - trace_path: write a trace-event timeline of the run to this file.
      */
     typedef struct {
         char **input_files;       // Array of input file paths
         unsigned int file_count;  // Number of input files
         char *dest_path;          // Destination directory path
+        char **dest_paths;        // Every destination given, in order
+        unsigned int dest_count;  // Number of destinations given
         bool debug_mode;          // Debug mode flag
+        bool remove_mode;         // Remove mode flag
+        unsigned int jobs;        // Worker thread count
+        bool pipeline_mode;       // Pipelined build flag
+        bool direct_mode;         // Tree-less build flag
+        bool export_mode;         // Export flag
+        ExportFormat export_format; // Export output format
+        const char *plan_path;    // Plan file to write (points into argv)
+        const char *apply_plan_path; // Plan file to replay (points into argv)
+        const char *show_plan_path;  // Plan file to print (points into argv)
+        const char *diff_old;     // Old template of a diff (points into argv)
+        const char *diff_new;     // New template of a diff (points into argv)
+        bool update_mode;         // Apply the diff to the destination
+        bool watch_mode;          // Watch flag
+        const char *serve_path;   // Socket to serve on (points into argv)
+        const char *client_path;  // Socket of the server to use (points into argv)
+        const char *find_path;    // Path to look up (points into argv)
+        PathFilter filter;        // Entries to keep or drop
+        bool preflight;           // Capacity check flag
+        const char *journal_path; // Journal to resume from and append to (points into argv)
+        const char *batch_path;   // Bindings table of a batch build (points into argv)
+        bool dedup;               // File deduplication flag
+        bool throttle;            // Adaptive pacing flag
+        double max_ops;           // Operations per second cap
+        bool progress;            // Progress reporting flag
+        const char *trace_path;   // Trace file to write (points into argv)
     } Args;
 
     /* Initialize an Args structure.
@@ -65,6 +120,16 @@
      */
     int add_input_file(Args *args, const char *filename);
 
+    /* Add a destination directory to the Args structure.
+     *
+     * The first one also replaces the default dest_path.
+     *
+     * Returns:
+     *  - 0 on success
+     *  - non-zero on failure
+     */
+    int add_dest_path(Args *args, const char *path);
+
     /* Free all memory allocated inside the Args structure.
      *
      * Parameters:
@@ -72,7 +137,7 @@
      *
      * Behavior:
      *  - Frees all input file strings and the input_files array.
-     *  - Frees the dest_path string.
+     *  - Frees the dest_path string, the destination list and the filter patterns.
      *  - Resets fields to safe default values.
      */
     void free_args(Args *args);
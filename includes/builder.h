@@ -5,6 +5,14 @@
     #include "fs.h"
     /* Tree structure and node operations */
     #include "treeMaker.h"
+    /* Token stream and include resolution for the direct mode */
+    #include "parser.h"
+    /* Worker pool used by the parallel walks */
+    #include "pool.h"
+
+    #ifndef _WIN32
+        #include <stdatomic.h>
+    #endif
 
     /* Generate absolute path for a tree node relative to base directory.
      *
@@ -34,6 +42,19 @@
      */
     int build_file_recursive(const Tree node, const char *base_path);
 
+    /* Attribute sets tracked by the file deduplication of one walk */
+    #define BUILD_DEDUP_SETS 64
+
+    /* Create identical files as hard links of one inode from now on.
+     *
+     * Files are empty, so two files are identical when they share their
+     * attributes (mode, owner, time): the first one of each set is created,
+     * the next ones are linked to it. A source that can take no more links
+     * is replaced by the next file created. Each walk (and each pipeline
+     * task) keeps its own sources; POSIX only.
+     */
+    void build_set_dedup(bool enabled);
+
     /* Materialize tree structure on filesystem.
      *
      * Orchestrates directory-first, file-second creation.
@@ -43,4 +64,51 @@
      */
     int build_tree(const Tree root, const char *dest_dir);
 
+    /* Nodes between two flushed checkpoints of a resumable build */
+    #define BUILD_JOURNAL_EVERY 65536
+    /* Smallest completed subtree recorded in the journal */
+    #define BUILD_JOURNAL_SPAN 256
+
+    /* Materialize tree structure on filesystem like build_tree, resumably.
+     *
+     * Progress is appended to the journal at journal_path as pre-order
+     * index ranges of completed subtrees, plus a periodically flushed
+     * checkpoint. When that file holds the journal of an interrupted build
+     * of the same tree (stats, from parse_tokens_stats, must match) into
+     * the same destination (compared by real path), the ranges it completed
+     * are skipped and the build continues from its last checkpoint; any
+     * other journal is started over. The journal is removed once the build succeeds.
+     * Returns 0 unless the root or the journal can not be created.
+     */
+    int build_tree_resume(const Tree root, const char *dest_dir, const char *journal_path, const TreeStats *stats);
+
+    /* Returns true if journal_path holds the journal of an interrupted build
+     * of a tree with these stats into dest_dir, i.e. build_tree_resume would
+     * resume it. Such a build already created part of the tree, so the
+     * capacity preflight is skipped.
+     */
+    bool build_journal_matches(const char *journal_path, const char *dest_dir, const TreeStats *stats);
+
+    /* Build a template straight from its token stream, without a tree.
+     *
+     * Each NAME is created as soon as it is lexed, relative to the
+     * descriptor of its parent; only the entries on the current path are
+     * kept, so memory is O(depth) whatever the template size.
+     * - "@include" templates are streamed the same way
+     * - "-" reads the template from the standard input
+     * Returns 0 on full success, non-zero if any creation failed.
+     */
+    int build_direct(const char *path, const char *dest_dir);
+
+    /* Remove the tree structure described by root from dest_dir.
+     *
+     * Inverse of build_tree: walks the tree bottom-up and unlinks entries
+     * relative to held directory descriptors, one directory per pool task.
+     * - Only entries named by the template are removed
+     * - Directories still holding other entries are kept with a warning
+     * - jobs selects the worker count (0 = one per processor)
+     * Returns 0 on full success, non-zero if any removal failed.
+     */
+    int remove_tree(const Tree root, const char *dest_dir, unsigned int jobs);
+
 #endif
@@ -0,0 +1,52 @@
+#ifndef __DIFF_H__
+    #define __DIFF_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+
+    /* Platform-agnostic filesystem operations */
+    #include "fs.h"
+    /* Tree structure and node operations */
+    #include "treeMaker.h"
+
+    /* Entries counted by a diff */
+    typedef struct DiffStats {
+        size_t added;               // Entries only in the new template
+        size_t removed;             // Entries only in the old template
+        size_t retyped;             // Entries turned from file to directory or back, or whose link kind or target changed
+        size_t changed;             // Entries kept with other attributes (mode, owner, group, mtime)
+    } DiffStats;
+
+    /* Compare two templates and optionally apply the delta.
+     *
+     * Children are sorted by name and both trees are walked with a linear
+     * merge, so the comparison is linear in the templates after sorting.
+     * Each change is printed to out (when not NULL) as:
+     *  - "+ path": entry only in the new template
+     *  - "- path": entry only in the old template
+     *  - "~ path": entry whose type changed (its contents follow as - and +),
+     *    or file that became a link, stopped being one or links elsewhere now
+     *  - "* path": entry whose attributes changed, set in place
+     * Directories end with "/".
+     *
+     * With dest_dir set, only the delta is applied to that destination,
+     * which must hold a build of old_root: removed entries are unlinked
+     * (directories holding foreign entries are kept) and added entries are
+     * created, relative to directory descriptors opened on demand. Unchanged
+     * parts of the tree cost no system call.
+     *
+     * Returns 0 on success, non-zero if any operation failed.
+     */
+    int diff_trees(const Tree old_root, const Tree new_root, const char *dest_dir, FILE *out, DiffStats *stats);
+
+    /* Same as diff_trees, against a destination descriptor held by the caller.
+     *
+     * dest_fd < 0 only prints the delta. old_root may be NULL: everything
+     * in new_root is then added. With keep_removed, removed entries are
+     * listed but left on disk. dest_fd stays open.
+     */
+    int diff_trees_at(const Tree old_root, const Tree new_root, int dest_fd, bool keep_removed, FILE *out, DiffStats *stats);
+
+#endif
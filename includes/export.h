@@ -0,0 +1,76 @@
+#ifndef __EXPORT_H__
+    #define __EXPORT_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <errno.h>
+
+    /* Tree structure and node operations */
+    #include "treeMaker.h"
+
+    #ifdef _WIN32
+        #include <io.h>
+    #else
+        #include <unistd.h>
+    #endif
+
+    /* Size of the private output buffer, flushed with a single write */
+    #define EXPORT_BUFFER ((size_t)1 << 20)
+
+    /* Output formats:
+     *  - EXPORT_TEXT: one entry per line, indented by depth, "/" after directories
+     *  - EXPORT_JSON: nested {"name", "path", "type", "children"} objects
+     *  - EXPORT_PATHS0: relative paths separated by NUL bytes (for xargs -0)
+     */
+    typedef enum ExportFormat {
+        EXPORT_TEXT,
+        EXPORT_JSON,
+        EXPORT_PATHS0
+    } ExportFormat;
+
+    /* Buffered writer used by the exporters.
+     *
+     * Fields:
+     *  - fd: output descriptor
+     *  - buf/len: private output buffer and its used bytes
+     *  - path/path_len/path_cap: path of the current entry, reused for every node
+     *  - status: EXIT_FAILURE once a write failed
+     */
+    typedef struct Exporter {
+        int fd;                     // Output descriptor
+        char *buf;                  // Output buffer (EXPORT_BUFFER bytes)
+        size_t len;                 // Used bytes in buf
+        char *path;                 // Relative path of the current entry
+        size_t path_len;            // Length of path
+        size_t path_cap;            // Capacity of path
+        int status;                 // First write failure
+    } Exporter;
+
+    /* Parse a format name: "text", "json" or "paths0".
+     *
+     * Returns 0 and sets *format on success, non-zero for an unknown name.
+     */
+    int export_format_parse(const char *name, ExportFormat *format);
+
+    /* Write a tree to fd in the given format.
+     *
+     * Parameters:
+     *  - root: tree to export
+     *  - format: output format
+     *  - fd: output descriptor (STDOUT_FILENO for the console)
+     *
+     * Paths are relative to the destination, included subtrees appear at
+     * their mount point. Memory does not grow with the tree size.
+     * Returns 0 on success, non-zero if the tree is empty or a write failed.
+     */
+    int export_tree(const Tree root, ExportFormat format, int fd);
+
+    /* Write a tree to fd in the text format, indented from level.
+     *
+     * Returns 0 on success, non-zero if the tree is empty or a write failed.
+     */
+    int export_text(const Tree root, int level, int fd);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __FILTER_H__
+    #define __FILTER_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+
+    /* Platform-agnostic filesystem operations (PATH_SEPARATOR) */
+    #include "fs.h"
+
+    /* How a path relates to a pattern */
+    typedef enum FilterMatch {
+        FILTER_NONE,                // No path below this one can match
+        FILTER_PREFIX,              // The path is an ancestor of possible matches
+        FILTER_FULL                 // The path matches
+    } FilterMatch;
+
+    /* What to do with an entry */
+    typedef enum FilterVerdict {
+        FILTER_SKIP,                // Drop the entry and everything below it
+        FILTER_KEEP,                // Keep the entry, its children are checked one by one
+        FILTER_SELECT               // Keep the entry and, excludes aside, everything below it
+    } FilterVerdict;
+
+    /* Compiled glob: one component per name.
+     * "*" and "?" match inside a name, "**" matches any number of names.
+     */
+    typedef struct FilterPattern {
+        char *text;                 // Pattern copy, split in place
+        char **parts;               // Components
+        size_t count;               // Number of components
+    } FilterPattern;
+
+    /* --only and --exclude patterns, matched against paths below the root */
+    typedef struct PathFilter {
+        FilterPattern *only;        // An entry must match one of these (all kept if none)
+        size_t only_count;          // Number of only patterns
+        FilterPattern *exclude;     // An entry matching one of these is dropped
+        size_t exclude_count;       // Number of exclude patterns
+    } PathFilter;
+
+    /* Compile pattern and add it to filter.
+     *
+     * Leading "./" or "/" and empty names are ignored: "a//b/" is "a/b".
+     * Returns 0 on success, non-zero on an empty pattern or allocation failure.
+     */
+    int filter_add(PathFilter *filter, const char *pattern, bool exclude);
+
+    /* Returns true if filter holds at least one pattern. */
+    bool filter_active(const PathFilter *filter);
+
+    /* Decide what to do with the entry at path (relative to the root, names
+     * separated by '/' or PATH_SEPARATOR).
+     *
+     * - Excluded entries are skipped
+     * - An entry matching an only pattern is selected with its subtree
+     * - A directory that may hold a match is kept, other entries are skipped
+     * selected tells that an ancestor is already selected: only the excludes
+     * are checked then.
+     */
+    FilterVerdict filter_check(const PathFilter *filter, const char *path, bool is_dir, bool selected);
+
+    /* Free the patterns held by filter. */
+    void filter_free(PathFilter *filter);
+
+#endif
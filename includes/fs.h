@@ -7,11 +7,15 @@
  * - stdlib.h: General utilities like memory allocation
  * - string.h: String manipulation functions
  * - stdbool.h: Boolean type support (bool, true, false)
+ * - errno.h: Error codes reported by the system calls
+ * - limits.h: PATH_MAX and NAME_MAX when the system provides them
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
 
 /*
  * Platform-specific includes and definitions:
@@ -37,9 +41,42 @@
     #include <sys/stat.h>
     #include <fcntl.h>
     #include <unistd.h>
+    #include <sys/statvfs.h>
     #define PATH_SEPARATOR '/'
 #endif
 
+/* Pacing of the metadata operations below (see --throttle and --max-ops). */
+#include "throttle.h"
+/* Counters of the entries created or removed (see --progress). */
+#include "progress.h"
+/* Slow call spans and the create_folder/create_file probes (see --trace). */
+#include "trace.h"
+
+/* Define PATH_MAX if not already defined by the system. */
+#ifndef PATH_MAX
+    #define PATH_MAX 4096
+#endif
+
+/*
+ * EntryAttrs
+ *
+ * Metadata given to the entries of a template (see the "[...]" attribute
+ * lists). Negative fields keep the default: mode 0755 for directories and
+ * 0644 for files, the owner and group of the creating process, and the
+ * creation time.
+ */
+typedef struct EntryAttrs {
+    int dir_mode;           // Permission bits of directories, -1 for 0755
+    int file_mode;          // Permission bits of files, -1 for 0644
+    long uid;               // Owner, -1 to keep the creating user
+    long gid;               // Group, -1 to keep the creating group
+    long long mtime;        // Modification time in seconds since the epoch
+    bool has_mtime;         // mtime is set
+} EntryAttrs;
+
+/* Attributes that change nothing */
+#define ENTRY_ATTRS_DEFAULT ((EntryAttrs){ -1, -1, -1, -1, 0, false })
+
 /*
  * create_file
  *
@@ -77,4 +114,203 @@ int create_file(const char *path);
  */
 int create_folder(const char *path);
 
+/*
+ * check_capacity
+ *
+ * Checks that the filesystem holding dest_dir has room for a build.
+ *
+ * Parameters:
+ *  - dest_dir: destination directory
+ *  - directories, files: entries the build creates
+ *
+ * Returns:
+ *  - 0 if the free inodes and blocks are enough, or cannot be known
+ *  - non-zero otherwise, with the shortfall printed
+ *
+ * Notes:
+ *  - Each entry takes one inode and each directory one block; files are
+ *    empty. Entries already present are counted too, so the count is an
+ *    upper bound and the message says so; a resumed build is not checked.
+ *  - Filesystems reporting no inode count (e.g. btrfs) are checked on
+ *    blocks only.
+ */
+int check_capacity(const char *dest_dir, size_t directories, size_t files);
+
+#ifndef _WIN32
+/*
+ * open_folder_at
+ *
+ * Opens the directory `name` relative to the directory descriptor dirfd.
+ *
+ * Parameters:
+ *  - dirfd: descriptor of the parent directory (or AT_FDCWD)
+ *  - name: directory name, relative to dirfd
+ *
+ * Returns:
+ *  - a directory descriptor on success
+ *  - -1 on failure, errno is left as set by openat
+ *
+ * Notes:
+ *  - Symbolic links are not followed, so a link planted in place of a
+ *    directory can not redirect the walk outside the destination.
+ */
+int open_folder_at(int dirfd, const char *name);
+
+/*
+ * create_folder_at
+ *
+ * Creates the directory `name` relative to dirfd (mode 0755).
+ *
+ * Returns:
+ *  - 0 on success or if the directory already exists
+ *  - non-zero on failure
+ */
+int create_folder_at(int dirfd, const char *name);
+
+/*
+ * create_file_at
+ *
+ * Creates the empty file `name` relative to dirfd (mode 0644).
+ *
+ * Returns:
+ *  - 0 on success or if the file already exists
+ *  - non-zero on failure
+ */
+int create_file_at(int dirfd, const char *name);
+
+/*
+ * create_folder_attrs_at
+ *
+ * Creates the directory `name` relative to dirfd with the mode of attrs
+ * (NULL for the defaults).
+ *
+ * Returns:
+ *  - 0 on success or if the directory already exists
+ *  - non-zero on failure
+ *
+ * Notes:
+ *  - The owner keeps full access until apply_folder_attrs runs, so the
+ *    children of a read-only directory can still be created. Owner and
+ *    time are left to apply_folder_attrs too: creating the children would
+ *    change the time again.
+ */
+int create_folder_attrs_at(int dirfd, const char *name, const EntryAttrs *attrs);
+
+/*
+ * create_file_attrs_at
+ *
+ * Creates the empty file `name` relative to dirfd with the attributes of
+ * attrs (NULL for the defaults). The mode is passed to openat, the owner
+ * and time are set on the descriptor it returns, so no path is resolved
+ * twice.
+ *
+ * Returns:
+ *  - 0 on success or if the file already exists (its attributes are set)
+ *  - non-zero on failure, a symbolic link in place of the file included
+ */
+int create_file_attrs_at(int dirfd, const char *name, const EntryAttrs *attrs);
+
+/*
+ * apply_folder_attrs
+ *
+ * Sets the directory attributes of attrs on the open directory fd, once
+ * its children exist. name is only used in messages.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - non-zero on failure
+ */
+int apply_folder_attrs(int fd, const char *name, const EntryAttrs *attrs);
+
+/*
+ * apply_attrs_at
+ *
+ * Sets the attributes of attrs on the entry `name` relative to dirfd, for
+ * entries the caller holds no descriptor of (e.g. an empty directory).
+ *
+ * Returns:
+ *  - 0 on success
+ *  - non-zero on failure
+ *
+ * Notes:
+ *  - An entry that is a symbolic link is refused, so the attributes never
+ *    reach the file it points to.
+ */
+int apply_attrs_at(int dirfd, const char *name, bool is_dir, const EntryAttrs *attrs);
+
+/*
+ * create_symlink_at
+ *
+ * Creates the symbolic link `name` to target relative to dirfd.
+ *
+ * Returns:
+ *  - 0 on success or if a symbolic link named `name` already exists
+ *  - non-zero on failure
+ */
+int create_symlink_at(int dirfd, const char *name, const char *target);
+
+/*
+ * link_file_at
+ *
+ * Creates `name` relative to dirfd as a hard link to the file `target`
+ * relative to target_dirfd.
+ *
+ * Returns:
+ *  - 0 on success or if `name` already exists
+ *  - -1 on failure, errno is left as set by linkat and nothing is printed
+ *    (ENOENT: no target yet, EMLINK: the target has too many links)
+ *
+ * Notes:
+ *  - Symbolic links are not followed: a target that is a link gets a
+ *    second name, not the file it points to.
+ */
+int link_file_at(int target_dirfd, const char *target, int dirfd, const char *name);
+
+/*
+ * link_file_beneath
+ *
+ * Creates `name` relative to dirfd as a hard link to the regular file
+ * `target`, a relative path walked from dirfd one directory at a time.
+ *
+ * Parameters:
+ *  - create: create the missing directories of target and the file itself
+ *
+ * Returns:
+ *  - 0 on success or if `name` already exists
+ *  - -1 on failure, errno is set and nothing is printed (ENOENT: missing
+ *    target, ELOOP: target or one of its directories is a symbolic link)
+ *
+ * Notes:
+ *  - Each directory is opened with open_folder_at, so no symbolic link is
+ *    followed and nothing is created through one. ".." is the parent of the
+ *    directory reached: the caller keeps target below its root (see
+ *    tree_link_inside).
+ */
+int link_file_beneath(int dirfd, const char *target, const char *name, bool create);
+
+/*
+ * remove_file_at
+ *
+ * Removes the file `name` relative to dirfd.
+ *
+ * Returns:
+ *  - 0 on success or if the file does not exist
+ *  - non-zero on failure
+ */
+int remove_file_at(int dirfd, const char *name);
+
+/*
+ * remove_folder_at
+ *
+ * Removes the empty directory `name` relative to dirfd.
+ *
+ * Returns:
+ *  - 0 on success, if the directory does not exist, or if it still holds
+ *    entries the template does not describe (a warning is printed and the
+ *    directory is kept)
+ *  - non-zero on failure
+ */
+int remove_folder_at(int dirfd, const char *name);
+#endif
+
 #endif
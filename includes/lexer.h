@@ -2,12 +2,15 @@
 // TreeMaker Base Lexer 
 // ---------------------------------------------------------------------
 // This header defines a minimal lexer for a TreeMaker-like "tree template"
-// syntax (no attribute braces). It recognizes:
+// syntax. It recognizes:
 //   - INDENT / DEDENT (Python-style indentation blocks)
 //   - NEWLINE, EOF
 //   - NAME (file or directory name)
 //   - DIR_MARK (implicit: NAME ending with '/')
 //   - COMMENT (text after '#')
+//   - INCLUDE ("@include <path>", mounts another template here)
+//   - ATTRS ("[key=value ...]" after a NAME on the same line)
+//   - SYMLINK / HARDLINK ("-> target" / "=> target" after a NAME on the same line)
 //
 // Error handling:
 //   - Inconsistent indentation (DEDENT to a non-existing level)
@@ -19,6 +22,11 @@
 //   - stop_on_first_error = true  -> stop tokenization on first error (default)
 //   - stop_on_first_error = false -> continue lexing and collect errors
 //
+// Large regular files can be lexed chunk-parallel (lexer_init_parallel):
+// the file is split at newline boundaries, workers lex the chunks with raw
+// indentation widths, and a sequential fix-up pass turns the widths into
+// INDENT/DEDENT and reports BAD_INDENT as the sequential lexer would.
+//
 // All code is written in clean, modern C (C11) with clear, English comments.
 // Licensed under MIT.
 
@@ -32,7 +40,22 @@
     #include <string.h>
     #include <sys/stat.h>
     #include <ctype.h>
+    #include <errno.h>
     #include "utils.h"
+    #include "pool.h"
+    #include "trace.h"
+
+    #ifndef _WIN32
+        #include <unistd.h>
+        #include <sys/mman.h>
+    #endif
+
+    // Inputs smaller than this are always streamed
+    #ifndef LEXER_PARALLEL_MIN
+        #define LEXER_PARALLEL_MIN ((size_t)4 << 20)
+    #endif
+    // Chunks per worker, so a slow chunk does not leave the others idle
+    #define LEXER_CHUNKS_PER_WORKER 4
 
 
     #ifdef __cplusplus
@@ -46,7 +69,11 @@
         T_NEWLINE,
         T_EOF,
         T_NAME,
-        T_COMMENT
+        T_COMMENT,
+        T_INCLUDE,     // lexeme holds the included template path
+        T_ATTRS,       // lexeme holds the text between the brackets
+        T_SYMLINK,     // lexeme holds the symbolic link target
+        T_HARDLINK     // lexeme holds the hard link target, relative to the link directory
     } Lx_TokenType;
 
     // Token structure
@@ -54,8 +81,7 @@
         Lx_TokenType type;     // token kind
         char*        lexeme;   // malloc'ed string (NULL for punctuation-like tokens)
         size_t       length;   // bytes in lexeme
-        int          line;     // 1-based
-        int          column;   // 1-based (begin of token)
+        size_t       offset;   // byte offset of the token in the input (see lexer_position)
     } Token;
 
     // Free resources held by a token (safe to call on zeroed tokens)
@@ -76,7 +102,8 @@
     // Error record
     typedef struct LexError {
         LexErrorKind kind; // error category
-        int line;             // source line
+        size_t offset;        // byte offset in the input
+        int line;             // source line, resolved from offset when the error is recorded
         int column;           // source column
         char* message;        // malloc'ed explanatory message (may be NULL)
     } LexError;
@@ -106,14 +133,16 @@
         struct Pending* next;
     } Pending;
 
+    // Refill callback for streamed input: copy up to cap bytes into buf and
+    // return the count, 0 at end of input
+    typedef size_t (*LexerRead)(void* ctx, char* buf, size_t cap);
+
     typedef struct Lexer {
-        const char* src;   // input buffer
+        const char* src;   // input buffer (the stream window for streamed input)
         size_t      len;   // size in bytes
         size_t      i;     // current index
-        int         line;  // 1-based
-        int         col;   // 1-based
-
         bool        at_line_start;
+        bool        after_name;  // the last token was a NAME, a link or an attribute list may follow
         IntStack indents;        // stack of indentation column counts
 
         Pending* qh;             // pending tokens (INDENT/DEDENT queue)
@@ -121,6 +150,31 @@
 
         LexerConfig cfg;         // configuration
 
+        // Streamed input (NULL read for in-memory sources)
+        LexerRead  read;         // refill callback
+        void*      read_ctx;     // refill callback argument
+        char*      buf;          // owned window, always holds at least one whole line
+        size_t     buf_cap;      // window capacity
+        bool       read_eof;     // refill callback reached the end of input
+        size_t     base;         // input offset of src[0] (bytes dropped from the window)
+        int        base_line;    // lines before base, counted when bytes are dropped
+        size_t     base_line_start; // input offset of the line holding base
+
+        // Newline offsets of in-memory input, built on the first position lookup
+        size_t*    nl_index;
+        size_t     nl_count;
+        bool       nl_built;
+
+        // Chunk-parallel input (NULL chunks otherwise)
+        struct LexChunk* chunks; // lexed chunks, replayed in order by the fix-up pass
+        size_t     chunk_count;
+        size_t     chunk_cur;    // chunk being replayed
+        size_t     chunk_pos;    // next token of that chunk
+        size_t     chunk_err;    // next error of that chunk to report
+        char*      map;          // whole input, owned (mapped on POSIX)
+        size_t     map_len;
+        bool       raw_indent;   // chunk worker: line starts yield T_INDENT with the raw width in length
+
         // Error reporting
         LexError*  errors;       // dynamic array of collected errors
         size_t        err_count;
@@ -130,6 +184,17 @@
 
     // ---------------- API ----------------
     void lexer_init(Lexer* L, const char* src, size_t len, const LexerConfig* cfg);
+    // Lex chunked input pulled from read(ctx, ...). Memory is bounded by the
+    // longest line: tokens never straddle a refill since every line is
+    // completed before it is lexed.
+    void lexer_init_stream(Lexer* L, LexerRead read, void* ctx, const LexerConfig* cfg);
+    // Lex a regular file chunk-parallel with workers threads (0 = one per
+    // processor). Returns false, leaving L untouched, when the input is not a
+    // regular file, is smaller than LEXER_PARALLEL_MIN or only one worker is
+    // available: the caller then streams it with lexer_init_stream.
+    bool lexer_init_parallel(Lexer* L, FILE* fp, unsigned int workers, const LexerConfig* cfg);
+    // LexerRead for a FILE* context; returns whatever is available on pipes
+    size_t lexer_read_file(void* ctx, char* buf, size_t cap);
     void lexer_free(Lexer* L);
     size_t lexer_tokenize_file(const char* filename, Token **out_tokens, const LexerConfig* cfg);
 
@@ -137,6 +202,11 @@
     // returns T_EOF immediately.
     Token lexer_next(Lexer* L);
 
+    // Line and column (1-based) of an input offset. Positions are not tracked
+    // while lexing: in-memory input is searched in a newline index built on
+    // the first call, streamed input is resolved within the current window.
+    void lexer_position(Lexer* L, size_t offset, int* line, int* column);
+
     // Access collected errors (valid until lexer_free)
     size_t lexer_error_count(const Lexer* L);
     const LexError* lexer_errors(const Lexer* L);
@@ -0,0 +1,101 @@
+#ifndef __PARAMS_H__
+    #define __PARAMS_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+
+    /* Compiled operation logs the instances are rendered from */
+    #include "plan.h"
+
+    /* Longest line of a bindings table */
+    #define PARAMS_LINE_MAX 8192
+    /* Segment variable index of a literal piece of name */
+    #define PARAM_LITERAL UINT32_MAX
+
+    /* Piece of a parameterized entry name */
+    typedef struct ParamSegment {
+        uint32_t var;               // Variable index, PARAM_LITERAL for text
+        uint32_t offset;            // Literal: offset of the text in the template name table
+        uint32_t length;            // Literal: length of the text
+    } ParamSegment;
+
+    /* Segments of one op name, count is 0 for a name without placeholder */
+    typedef struct ParamName {
+        uint32_t first;             // First segment
+        uint32_t count;             // Number of segments
+    } ParamName;
+
+    /* Bindings table: a header row naming the variables, then one row per instance.
+     * Cells are separated by tabs or spaces, '#' starts a comment line.
+     */
+    typedef struct ParamTable {
+        char **cells;               // Header cells, then the rows, row-major
+        size_t columns;             // Cells per row
+        size_t rows;                // Rows after the header
+    } ParamTable;
+
+    /* Plan whose entry names hold "${var}" placeholders, split once into
+     * segments so each instance is rendered by concatenation.
+     */
+    typedef struct ParamPlan {
+        const Plan *plan;           // Template plan, names unexpanded
+        char **vars;                // Variable names, in order of first use
+        size_t var_count;           // Number of variables
+        size_t *column;             // Table column of each variable (see params_bind)
+        ParamName *names;           // Segments of each op
+        ParamSegment *segments;     // Every segment
+        size_t segment_count;       // Number of segments
+        size_t segment_cap;         // Segment capacity
+        Plan instance;              // Last rendered instance, its buffers are reused
+        size_t base_len;            // Template names kept at the start of the instance name table
+    } ParamPlan;
+
+    /* Read a bindings table from path.
+     *
+     * Returns 0 on success, non-zero if the file is unreadable, has no
+     * header or a row with a different cell count.
+     */
+    int params_table_read(ParamTable *table, const char *path);
+
+    /* Free the cells of table. */
+    void params_table_free(ParamTable *table);
+
+    /* Split the names of plan into segments.
+     *
+     * plan must outlive params. Names without placeholder are kept as
+     * they are and never copied again.
+     * Returns 0 on success, non-zero on allocation failure.
+     */
+    int params_compile(ParamPlan *params, const Plan *plan);
+
+    /* Map every variable of params to its column in table.
+     *
+     * Returns 0 on success, non-zero if a variable has no column.
+     */
+    int params_bind(ParamPlan *params, const ParamTable *table);
+
+    /* Render the instance of table row (0-based, after the header).
+     *
+     * The returned plan is owned by params and valid until the next call.
+     * Returns NULL if a rendered name is empty, ".", ".." or holds a path
+     * separator, or on allocation failure.
+     */
+    const Plan *params_instantiate(ParamPlan *params, const ParamTable *table, size_t row);
+
+    /* Free the memory held by params (not the template plan). */
+    void params_free(ParamPlan *params);
+
+    /* Build one instance of root per row of table into each of dest_dirs.
+     *
+     * root is compiled and split into segments once, then every row is
+     * rendered into the reused instance and replayed (see plan_apply_many).
+     * A row giving an invalid name is skipped, the others are built.
+     * Returns 0 on full success, non-zero if a variable has no column or
+     * any row failed.
+     */
+    int params_build(const Tree root, const ParamTable *table, const char *const *dest_dirs, size_t dest_count, unsigned int jobs, bool preflight);
+
+#endif
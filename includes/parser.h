@@ -3,9 +3,73 @@
 
     #include "treeMaker.h"  // Include the treeMaker header for tree data structures and functions~
     #include "lexer.h"      // Include the lexer header for tokenize the input file
+    #include "filter.h"     // Include the path filter applied while parsing
 
+    #ifndef _WIN32
+        #include <pwd.h>        // Include user lookups for owner= attributes
+        #include <grp.h>        // Include group lookups for owner= and group= attributes
+    #endif
+
+
+    // Lexer configuration used for templates
+    #define PARSER_LEXER_CONFIG ((LexerConfig){ .tab_width = 4, .emit_blank_newlines = false, .stop_on_first_error = false })
+
+    // Token source pulled by the parser, must end with a T_EOF token
+    typedef Token (*TokenNext)(void *source);
+
+    // Optional parser callbacks
+    //  - on_node: called each time an entry is attached, mounted or reopened (merged
+    //    duplicate directory) at the given depth, once its attribute list if any is read;
+    //    every entry previously reported at the same depth or deeper is complete at that point
+    typedef struct ParseHooks {
+        void (*on_node)(void *ctx, Tree node, int depth);
+        void *ctx;
+    } ParseHooks;
+
+    // Function to parse the tokens pulled from next(source) and return a Tree structure
+    // path names the template, "@include" paths are resolved relative to it
+    // stats (optional) receives the entry counts, kept as entries are attached
+    Tree parse_source(const char *path, TokenNext next, void *source, const ParseHooks *hooks, TreeStats *stats);
 
     // Function to parse tokens and return a Tree structure based on its contents
+    // Templates larger than LEXER_PARALLEL_MIN are lexed chunk-parallel
     Tree parse_tokens(const char *path);
 
+    // Function to parse tokens like parse_tokens, also returning the entry counts in stats
+    Tree parse_tokens_stats(const char *path, TreeStats *stats);
+
+    // Function to set the worker count used to lex large templates (0 = one per processor, 1 = sequential)
+    void parser_set_jobs(unsigned int jobs);
+
+    // Function to give every top-level template parsed afterwards a path index (see tree_index)
+    void parser_set_index(bool enabled);
+
+    // Function to prune every top-level template parsed afterwards with filter (NULL or empty: keep all)
+    // Entries are matched on their path below the root, dropped subtrees are never allocated
+    // Included templates are kept or dropped as a whole; filter must outlive the parsing
+    void parser_set_filter(const PathFilter *filter);
+
+    // Function to get the filter set by parser_set_filter, NULL if none
+    const PathFilter *parser_filter(void);
+
+    // Function to merge an attribute list (text of a T_ATTRS token, "[...]" after a name) into attrs
+    //  - mode=OCTAL applies to the kind of the entry (is_dir), dmode= and fmode= to the directories
+    //    and files below it; every attribute is inherited by the entries below
+    //  - owner=USER[:GROUP] and group=GROUP take names or numeric ids
+    //  - mtime= takes seconds since the epoch or YYYY-MM-DD[THH:MM[:SS]][Z] (UTC)
+    // Returns 0 on success; on an invalid list a warning names the entry and attrs is left as is
+    int parser_read_attrs(const char *text, const char *name, bool is_dir, EntryAttrs *attrs);
+
+    // Function to resolve an "@include" target relative to the directory of the including file
+    // Returns a malloc'ed path, NULL on allocation failure
+    char *parser_resolve_include(const char *from, const char *target);
+
+    // Function to free the templates cached by "@include" directives
+    // Trees returned by parse_tokens may reference them: call it once they are cleaned
+    void parser_clear_cache(void);
+
+    // Function to get the real path of the i-th template cached by "@include" directives
+    // Returns NULL past the last one, the string is valid until parser_clear_cache
+    const char *parser_cached_include(size_t i);
+
 #endif  // End of include guard
@@ -0,0 +1,34 @@
+#ifndef __PIPELINE_H__
+    #define __PIPELINE_H__
+
+    /* Parser and token stream */
+    #include "parser.h"
+    /* Subtree builders and worker pool */
+    #include "builder.h"
+
+    #ifndef _WIN32
+        #include <pthread.h>
+        #include <sched.h>
+        #include <time.h>
+    #endif
+
+    /* Tokens moved per ring slot */
+    #define PIPELINE_BATCH 256
+    /* Ring slots between the lexer and the parser (power of two) */
+    #define PIPELINE_RING 64
+    /* Entries an open directory may gather before it is created early,
+     * so its completed children can be built while it is still parsed */
+    #define PIPELINE_SPLIT 1024
+
+    /* Lex, parse and build a template with the three stages overlapping.
+     *
+     * - A lexer thread pushes token batches through a lock-free
+     *   single-producer/single-consumer ring
+     * - The calling thread parses them and hands every completed subtree
+     *   whose parent already exists to the builder workers
+     * - jobs selects the builder worker count (0 = one per processor)
+     * Returns 0 on full success, non-zero if parsing or any creation failed.
+     */
+    int pipeline_build(const char *path, const char *dest_dir, unsigned int jobs);
+
+#endif
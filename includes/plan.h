@@ -0,0 +1,148 @@
+#ifndef __PLAN_H__
+    #define __PLAN_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+    #include <errno.h>
+
+    /* Platform-agnostic filesystem operations */
+    #include "fs.h"
+    /* Tree structure and node operations */
+    #include "treeMaker.h"
+    /* Worker pool used to replay file creations */
+    #include "pool.h"
+
+    #ifndef _WIN32
+        #include <stdatomic.h>
+    #endif
+
+    /* Plan file layout (native byte order, checked on load):
+     *  - PlanHeader
+     *  - op_count PlanOp records
+     *  - attrs_count PlanAttrs records, op attrs i > 0 names record i - 1
+     *  - names_len bytes of NUL-terminated entry names
+     */
+    #define PLAN_MAGIC "TMPLAN\0\3"
+    #define PLAN_BYTE_ORDER 0x01020304u
+    /* Parent index of the top-level entries: the destination directory */
+    #define PLAN_ROOT UINT32_MAX
+
+    /* Operation kinds */
+    typedef enum PlanKind {
+        PLAN_MKDIR = 1,             // Create a directory
+        PLAN_CREATE = 2,            // Create an empty file
+        PLAN_SYMLINK = 3,           // Create a symbolic link to target
+        PLAN_HARDLINK = 4           // Create a hard link to the file target, relative to the parent directory
+    } PlanKind;
+
+    /* One operation, relative to the directory created by op parent */
+    typedef struct PlanOp {
+        uint32_t parent;            // Index of the parent PLAN_MKDIR op, or PLAN_ROOT
+        uint32_t kind;              // PlanKind
+        uint64_t name;              // Offset of the entry name in the name table
+        uint32_t attrs;             // Interned attributes (see tree_attrs), 0 for the defaults
+        uint32_t reserved;          // Zero
+        uint64_t target;            // Offset of the link target in the name table, 0 for other kinds
+    } PlanOp;
+
+    /* Attribute set as written in a plan file, ids are only valid in the process that interned them */
+    typedef struct PlanAttrs {
+        int32_t dir_mode;           // EntryAttrs.dir_mode
+        int32_t file_mode;          // EntryAttrs.file_mode
+        int64_t uid;                // EntryAttrs.uid
+        int64_t gid;                // EntryAttrs.gid
+        int64_t mtime;              // EntryAttrs.mtime
+        uint32_t has_mtime;         // EntryAttrs.has_mtime
+        uint32_t reserved;          // Zero
+    } PlanAttrs;
+
+    typedef struct PlanHeader {
+        char magic[8];              // PLAN_MAGIC
+        uint32_t byte_order;        // PLAN_BYTE_ORDER as written
+        uint32_t attrs_count;       // Number of PlanAttrs records
+        uint64_t op_count;          // Number of PlanOp records
+        uint64_t names_len;         // Size of the name table
+    } PlanHeader;
+
+    /* Compiled op log.
+     *
+     * Directories come first, in pre-order so every parent precedes its
+     * children, then the files grouped by parent directory: the same
+     * order as build_tree.
+     */
+    typedef struct Plan {
+        PlanOp *ops;                // Operations
+        size_t count;               // Number of operations
+        size_t cap;                 // Operation capacity
+        char *names;                // Name table
+        size_t names_len;           // Used bytes in the name table
+        size_t names_cap;           // Name table capacity
+    } Plan;
+
+    /* Append the operations building root to plan.
+     *
+     * Several trees can be compiled into one plan. Entries nested under a
+     * file can never be created and are left out with a warning. Each op
+     * keeps the attributes of its entry, links keep their target; a hard
+     * link must name a file of the template (see tree_link_resolve).
+     * Returns 0 on success, non-zero on allocation failure.
+     */
+    int plan_compile(Plan *plan, const Tree root);
+
+    /* Write plan to path ("-" writes the standard output).
+     *
+     * The attribute sets the ops use are written once each.
+     * Returns 0 on success, non-zero on failure.
+     */
+    int plan_write(const Plan *plan, const char *path);
+
+    /* Load and validate a plan written by plan_write.
+     *
+     * Every op must name a plain entry (no separator, "." or "..") and
+     * refer to an earlier directory op, so a loaded plan never escapes
+     * the destination: a hard link target must also stay below the
+     * top-level directory holding it (see tree_link_inside). Its attribute
+     * sets are interned again.
+     * Returns 0 on success, non-zero if the file is unreadable or invalid.
+     */
+    int plan_read(Plan *plan, const char *path);
+
+    /* Replay plan under dest_dir.
+     *
+     * Directories are created in order relative to held descriptors, then
+     * each run of files sharing a parent is created by a pool task, its
+     * links last. Hard link targets are reached without following any
+     * symbolic link, and created first if missing (see link_file_beneath).
+     * Once every task of the destination is done, the directory attributes
+     * are set innermost first (creating the children would change the time).
+     * - jobs selects the worker count (0 = one per processor)
+     * - preflight first checks that dest_dir has room for every operation
+     * Returns 0 on full success, non-zero if any operation failed.
+     */
+    int plan_apply(const Plan *plan, const char *dest_dir, unsigned int jobs, bool preflight);
+
+    /* Replay plan under each of dest_dirs, on one shared pool.
+     *
+     * Every destination gets a directory pass task, so destinations are
+     * built side by side; the file runs they queue are spread over the
+     * same workers. A destination descriptor is held only while its
+     * tasks run.
+     * - preflight checks each filesystem for all the destinations it holds
+     * Returns 0 on full success, non-zero if any operation failed.
+     */
+    int plan_apply_many(const Plan *plan, const char *const *dest_dirs, size_t dest_count, unsigned int jobs, bool preflight);
+
+    /* Print plan for review, one "mkdir", "create" or "link" line per operation,
+     * followed by the attributes of the entry if it has some.
+     *
+     * Returns 0 on success, non-zero on allocation failure.
+     */
+    int plan_print(const Plan *plan, FILE *out);
+
+    /* Free the memory held by plan. */
+    void plan_free(Plan *plan);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __POOL_H__
+    #define __POOL_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+
+    /* Worker threads are only available on POSIX systems.
+     * On Windows the pool has no worker and runs every task inline,
+     * so callers can use the same code path on every platform.
+     */
+    #ifndef _WIN32
+        #include <pthread.h>
+        #include <unistd.h>
+    #endif
+
+    /* Function run by a worker for each submitted task */
+    typedef void (*PoolTask)(void *arg);
+
+    /* Queued task: function and its argument */
+    typedef struct PoolItem {
+        PoolTask fn;
+        void *arg;
+    } PoolItem;
+
+    /* Fixed-size pool of worker threads fed by a growable circular queue.
+     *
+     * Fields:
+     *  - items/cap/head/count: circular task queue
+     *  - active: number of tasks currently running
+     *  - worker_count: number of started worker threads (0 = inline mode)
+     *  - stopping: set by pool_destroy to make workers leave
+     */
+    typedef struct ThreadPool {
+        PoolItem *items;            // Circular task queue
+        size_t cap;                 // Queue capacity
+        size_t head;                // Index of the next task to run
+        size_t count;               // Number of queued tasks
+        size_t active;              // Number of running tasks
+        unsigned int worker_count;  // Number of worker threads
+        bool stopping;              // Shutdown flag
+    #ifndef _WIN32
+        pthread_t *workers;         // Worker threads
+        pthread_mutex_t lock;       // Protects every field above
+        pthread_cond_t has_work;    // Signaled when a task is queued
+        pthread_cond_t idle;        // Signaled when the pool drains
+    #endif
+    } ThreadPool;
+
+    /* Number of workers used when the user does not ask for a count.
+     *
+     * Returns the number of online processors (at least 1).
+     */
+    unsigned int pool_default_workers(void);
+
+    /* Start a pool with the given number of workers.
+     *
+     * Parameters:
+     *  - pool: pool to initialize
+     *  - workers: worker count, 0 selects pool_default_workers()
+     *
+     * Returns:
+     *  - 0 on success
+     *  - non-zero on failure
+     */
+    int pool_init(ThreadPool *pool, unsigned int workers);
+
+    /* Queue a task.
+     *
+     * Tasks may submit further tasks from inside a worker.
+     * Returns 0 on success, non-zero if the task could not be queued.
+     */
+    int pool_submit(ThreadPool *pool, PoolTask fn, void *arg);
+
+    /* Block until the queue is empty and no task is running. */
+    void pool_wait(ThreadPool *pool);
+
+    /* Stop the workers and free the pool resources.
+     *
+     * Pending tasks are drained before the workers leave.
+     */
+    void pool_destroy(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __PROGRESS_H__
+    #define __PROGRESS_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    /* Live reporting is only available on POSIX systems; on Windows every
+     * call is a no-op.
+     */
+    #ifndef _WIN32
+        #include <stdatomic.h>
+        #include <pthread.h>
+        #include <time.h>
+        #include <unistd.h>
+    #endif
+
+    /* Milliseconds between two progress lines */
+    #define PROGRESS_INTERVAL_MS 500
+
+    /* Counters of a running build and the thread reporting them.
+     *
+     * Builders only add to the counters, with relaxed atomics: nothing on
+     * their path locks, allocates or prints. The reporter thread samples the
+     * counters every PROGRESS_INTERVAL_MS and prints the entries done, the
+     * rate over the last interval and, when the entry count is known, the
+     * share done and the time left at that rate.
+     *
+     * Fields:
+     *  - enabled: counters are kept, set before the builders start
+     *  - done/failed: entries created or removed, and those that failed
+     *  - total: entries expected, 0 while unknown (streamed builds)
+     *  - out/tty: where lines go, rewritten in place on a terminal
+     *  - stopping/lock/wake/thread: reporter lifetime
+     */
+    typedef struct Progress {
+        bool enabled;               // Counting is on
+    #ifndef _WIN32
+        atomic_size_t done;         // Entries created or removed
+        atomic_size_t failed;       // Entries that could not be created or removed
+        atomic_size_t total;        // Entries expected, 0 if unknown
+        FILE *out;                  // Stream of the progress lines
+        bool tty;                   // out is a terminal: one line rewritten in place
+        bool stopping;              // progress_stop was called
+        pthread_mutex_t lock;       // Protects stopping
+        pthread_cond_t wake;        // Ends the reporter sleep early
+        pthread_t thread;           // Reporter thread
+    #endif
+    } Progress;
+
+    /* Start counting and the reporter thread, printing to out.
+     *
+     * Returns 0 on success, non-zero if the thread could not be started
+     * (the build then runs without progress).
+     */
+    int progress_start(FILE *out);
+
+    /* Add count entries to the expected total, for the ETA. */
+    void progress_expect(size_t count);
+
+    /* Count one entry created or removed (ok), or one that failed.
+     * Called by the filesystem operations, safe from any thread.
+     */
+    void progress_entry(bool ok);
+
+    /* Stop the reporter after a last line with the totals. */
+    void progress_stop(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef __SERVE_H__
+    #define __SERVE_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <errno.h>
+
+    /* Parser and include cache */
+    #include "parser.h"
+    /* Tree builders */
+    #include "builder.h"
+    /* Worker pool serving the connections */
+    #include "pool.h"
+
+    #ifndef _WIN32
+        #include <pthread.h>
+        #include <signal.h>
+        #include <sys/socket.h>
+        #include <sys/un.h>
+        #include <sys/time.h>
+        #include <time.h>
+    #endif
+
+    /* Wire protocol, one request and one response per connection:
+     *  - request:  "build|remove <TAB> template <TAB> destination <TAB> jobs <TAB> preflight <TAB> journal\n"
+     *  - response: "status=N entries=N cached=0|1 ms=T\n"
+     * Paths are absolute, the client resolves them; journal is empty without --resume.
+     */
+    #define SERVE_FIELDS 6
+    #define SERVE_LINE_MAX (3 * PATH_MAX + 32)
+    /* Seconds a connection may take to send its request */
+    #define SERVE_TIMEOUT 10
+
+    /* Serve build requests on a Unix domain socket until SIGINT or SIGTERM.
+     *
+     * Parsed templates stay cached between requests and are parsed again
+     * only when the template, or a template it includes, changes on disk
+     * (modification time, size or inode). Each connection is handled by a
+     * pool worker; builds share the cached trees under a read lock, and
+     * parsing takes the write lock since the include cache is global.
+     * - jobs selects the worker count (0 = one per processor)
+     * - preflight refuses builds the destination has no room for (see check_capacity)
+     * Returns 0 on a clean stop, non-zero if the socket could not be set up.
+     */
+    int serve_run(const char *socket_path, unsigned int jobs, bool preflight);
+
+    /* Ask the server listening on socket_path to build or remove a template.
+     *
+     * Relative paths are resolved against the client working directory.
+     * The options are applied to this request only:
+     * - jobs selects the removal workers (0 = one, the server runs requests side by side)
+     * - preflight = false skips the capacity check, a server started without it never checks
+     * - journal_path makes the build resumable (see build_tree_resume), NULL for none
+     * Returns the status reported by the server, non-zero if it cannot be reached.
+     */
+    int serve_send(const char *socket_path, const char *template_path, const char *dest_dir, bool remove,
+                   unsigned int jobs, bool preflight, const char *journal_path);
+
+#endif
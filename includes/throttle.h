@@ -0,0 +1,90 @@
+#ifndef __THROTTLE_H__
+    #define __THROTTLE_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+    #include <errno.h>
+
+    /* Pacing is only available on POSIX systems, where builders run on
+     * worker threads; on Windows every call is a no-op.
+     */
+    #ifndef _WIN32
+        #include <pthread.h>
+        #include <time.h>
+    #endif
+
+    /* Weight of the newest latency sample in the moving average, as a shift (1/8) */
+    #define THROTTLE_EWMA_SHIFT 3
+    /* Operations over which the uncontended latency follows a lasting change, as a divisor */
+    #define THROTTLE_BASE_DRIFT 256
+    /* Average latency over the uncontended one that halves the window */
+    #define THROTTLE_SLOWDOWN 2.0
+
+    /* Metadata operation pacing shared by every builder thread.
+     *
+     * Operations are admitted while fewer than `window` are in flight. The
+     * window follows AIMD on the observed latency: it opens by one per
+     * completed operation until the first slowdown (slow start), then by one
+     * per window of operations, and is halved (at most once per window of
+     * operations) when the moving average latency exceeds THROTTLE_SLOWDOWN
+     * times the uncontended latency, i.e. when the filesystem starts queueing.
+     * The uncontended latency is the lowest average seen, drifting slowly
+     * towards the current one so a lasting change is not mistaken for queueing.
+     * An optional cap spaces operation starts to at most `rate` per second.
+     *
+     * Fields:
+     *  - enabled: set by throttle_configure, checked without the lock
+     *  - adaptive/window/max_window: in-flight window and its bound
+     *  - in_flight: operations admitted and not yet finished
+     *  - avg_ns/base_ns: moving average latency and its lowest value
+     *  - since_decrease/slow_start: AIMD state
+     *  - interval_ns/next_ns: rate cap, as the spacing of starts
+     *  - ops/decreases: totals reported by throttle_report
+     */
+    typedef struct Throttle {
+        bool enabled;               // Pacing is on
+        bool adaptive;              // The window follows the latency
+        double window;              // Operations allowed in flight
+        unsigned int max_window;    // Upper bound of window
+        unsigned int in_flight;     // Operations in flight
+        double avg_ns;              // Moving average latency
+        double base_ns;             // Lowest moving average, the uncontended latency
+        uint64_t since_decrease;    // Operations finished since the window was last halved
+        bool slow_start;            // No slowdown seen yet
+        uint64_t interval_ns;       // Spacing of starts, 0 for no rate cap
+        uint64_t next_ns;           // Earliest start of the next operation
+        uint64_t ops;               // Operations finished
+        uint64_t decreases;         // Times the window was halved
+    #ifndef _WIN32
+        pthread_mutex_t lock;       // Protects every field but enabled
+        pthread_cond_t room;        // Signaled when an operation leaves the window
+    #endif
+    } Throttle;
+
+    /* Turn pacing on for the rest of the process.
+     *
+     * Parameters:
+     *  - adaptive: adapt the in-flight window to the latency (otherwise it stays at max_window)
+     *  - max_window: most operations in flight, usually the worker count (at least 1)
+     *  - ops_per_sec: cap on operation starts per second, 0 for none
+     *
+     * Nothing is paced unless adaptive is set or ops_per_sec is positive.
+     * Must be called before the builder threads start.
+     */
+    void throttle_configure(bool adaptive, unsigned int max_window, double ops_per_sec);
+
+    /* Wait for room in the window and for the rate cap, then admit one operation.
+     *
+     * Returns the start time to pass to throttle_end (0 when pacing is off).
+     */
+    uint64_t throttle_begin(void);
+
+    /* Finish an operation admitted by throttle_begin, feeding its latency to the window. */
+    void throttle_end(uint64_t start);
+
+    /* Print the operation count, the final window and the latencies to out, if pacing is on. */
+    void throttle_report(FILE *out);
+
+#endif
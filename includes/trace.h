@@ -0,0 +1,99 @@
+#ifndef __TRACE_H__
+    #define __TRACE_H__
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+    #include <errno.h>
+
+    /* Recording is only available on POSIX systems; on Windows every call
+     * is a no-op.
+     */
+    #ifndef _WIN32
+        #include <stdatomic.h>
+        #include <time.h>
+        #include <unistd.h>
+    #endif
+
+    /* Static probes (USDT) for perf, bpftrace and SystemTap, provider "treemaker".
+     * They are nops in the binary until a tracer attaches; without
+     * <sys/sdt.h> (systemtap-sdt-dev) they are left out entirely.
+     */
+    #if defined(__has_include)
+        #if __has_include(<sys/sdt.h>)
+            #include <sys/sdt.h>
+            #define TRACE_USDT 1
+        #endif
+    #endif
+    #ifdef TRACE_USDT
+        #define TRACE_PROBE1(name, a) DTRACE_PROBE1(treemaker, name, a)
+        #define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(treemaker, name, a, b)
+    #else
+        #define TRACE_PROBE1(name, a) ((void)(a))
+        #define TRACE_PROBE2(name, a, b) ((void)(a), (void)(b))
+    #endif
+
+    /* Events per chunk of a thread buffer */
+    #define TRACE_CHUNK 4096
+    /* Events kept per thread, later ones are counted as dropped */
+    #define TRACE_MAX_EVENTS (1u << 20)
+    /* Filesystem calls shorter than this are not recorded (nanoseconds) */
+    #define TRACE_SLOW_NS 100000
+    /* Bytes of the event detail kept, NUL included */
+    #define TRACE_DETAIL 40
+
+    /* One complete span; name is a string literal, detail is copied (truncated) */
+    typedef struct TraceEvent {
+        const char *name;           // Phase or call name
+        uint64_t start_ns;          // Start, from the trace start
+        uint64_t dur_ns;            // Duration
+        char detail[TRACE_DETAIL];  // File, subtree or entry name
+    } TraceEvent;
+
+    /* Fixed block of events, never moved once allocated */
+    typedef struct TraceChunk {
+        struct TraceChunk *next;    // Previous (full) chunk
+        TraceEvent events[TRACE_CHUNK];
+    } TraceChunk;
+
+    /* Events of one thread.
+     *
+     * Only the owning thread writes to its buffer, so recording takes no
+     * lock: an event is written, then published by a release store of
+     * count. Buffers are registered once per thread on a lock-free list
+     * and read by trace_stop once the workers are done.
+     */
+    typedef struct TraceBuffer {
+        struct TraceBuffer *next;   // Next registered buffer
+        unsigned int tid;           // Trace thread id, 1 for the first thread seen
+        TraceChunk *chunk;          // Chunk being filled, older ones follow it
+    #ifndef _WIN32
+        atomic_size_t count;        // Events recorded
+    #endif
+        size_t dropped;             // Events over TRACE_MAX_EVENTS
+    } TraceBuffer;
+
+    /* Start recording; events are written to path as Chrome trace-event
+     * JSON (chrome://tracing, Perfetto) by trace_stop.
+     *
+     * Returns 0 on success, non-zero if path can not be written.
+     */
+    int trace_start(const char *path);
+
+    /* Start time of a span to pass to trace_end or trace_slow (0 when not recording). */
+    uint64_t trace_begin(void);
+
+    /* Record the span started at start under name, with an optional detail. */
+    void trace_end(uint64_t start, const char *name, const char *detail);
+
+    /* Record the span like trace_end only if it lasted TRACE_SLOW_NS or more. */
+    void trace_slow(uint64_t start, const char *name, const char *detail);
+
+    /* Write the recorded events and free the buffers.
+     * Every thread that recorded must be done.
+     */
+    void trace_stop(void);
+
+#endif
@@ -2,34 +2,166 @@
     #define __TREEMAKER_H__
 
     #include <stdbool.h>    // Include for boolean type support (true, false)
+    #include <stdint.h>     // Include fixed-width integers (attribute ids)
     #include <stdlib.h>     // Include standard library for memory allocation and exit functions
     #include <stdio.h>      // Include standard I/O for input and output functions
     #include <string.h>     // Include string manipulation functions
     #include "utils.h"      // Include custom utility functions (not defined here)
     #include "fs.h"        // Include file system related functions (not defined here)
+    #ifndef _WIN32
+        #include <pthread.h>   // Include POSIX threads (attribute sets are interned under a lock)
+    #endif
+
+    // Kind of link a file node stands for
+    typedef enum TreeLink {
+        TREE_LINK_NONE = 0,        // Plain entry
+        TREE_LINK_SYMBOLIC,        // Symbolic link to target
+        TREE_LINK_HARD             // Hard link to the file target, relative to the link directory
+    } TreeLink;
 
     // Structure representing a node in the tree
     typedef struct TreeNode {
         char *path;                // Path associated with this node (file or directory)
+        char *name;                // Last component of path (points into path)
         bool is_directory;         // Flag indicating if this node is a directory
+        bool is_shared;            // Root of an included subtree, owned by the include cache and mounted by reference
+        bool is_sealed;            // Handed over to a builder while parsing, must not be extended
+        uint8_t link;              // TreeLink kind, links are files without children
+        uint32_t attrs;            // Id of the entry attributes (see tree_attrs), 0 for the defaults
         size_t child_count;        // Number of child nodes
         struct TreeNode *parent;   // Pointer to the parent node
-        struct TreeNode **children; // Array of pointers to child nodes
+        union {
+            struct TreeNode **children; // Array of pointers to child nodes
+            char *target;          // Link target (owned) when link is set, links have no children
+        };
+        struct TreeIndex *index;   // Path index shared by the nodes of an indexed tree (NULL if not indexed)
     } TreeNode, *Tree;            // Type definition for TreeNode and Tree (pointer to TreeNode)
 
+    // Entries of a parsed tree, included subtrees counted at each mount point
+    typedef struct TreeStats {
+        size_t directories;        // Directories, the root included
+        size_t files;              // Files
+        size_t shape;              // Hash of the attached names and depths, tells two templates apart
+    } TreeStats;
+
+    // Slot of the path index
+    typedef struct TreeIndexSlot {
+        size_t hash;               // Hash of key
+        const char *key;           // Full path: node path, or interned when mounted under a prefix
+        Tree node;                 // Indexed node, NULL for an empty slot
+    } TreeIndexSlot;
+
+    // Block of interned keys, never moved so keys stay valid
+    typedef struct TreeIndexBlock {
+        struct TreeIndexBlock *next; // Previous block
+        size_t used;               // Bytes used in data
+        size_t cap;                // Size of data
+        char data[];               // Keys
+    } TreeIndexBlock;
+
+    // Open addressing table of every node of a tree keyed on its full path
+    typedef struct TreeIndex {
+        TreeIndexSlot *slots;      // Slot array, capacity is a power of two
+        size_t cap;                // Number of slots
+        size_t count;              // Number of used slots
+        TreeIndexBlock *keys;      // Interned keys of mounted (included) nodes
+        Tree root;                 // Tree owning the index, freed with it
+        bool failed;               // An update could not be stored: lookups fall back to a walk
+    } TreeIndex;
+
+    // Frames kept on the C stack before tree_walk moves its stack to the heap
+    #define TREE_WALK_INLINE 64
+
+    // Action returned by the visitor hooks of tree_walk
+    typedef enum TreeWalkAction {
+        TREE_WALK_CONTINUE = 0,    // Visit the children, then call post
+        TREE_WALK_SKIP,            // From pre: skip the children and post
+        TREE_WALK_STOP             // End the walk
+    } TreeWalkAction;
+
+    // Node being visited, one per level on the walk stack
+    typedef struct TreeFrame {
+        Tree node;                 // Visited node
+        size_t depth;              // Depth below the walk root (0 for the root)
+        size_t next;               // Index of the next child to visit
+        void *data;                // Visitor slot, kept from pre to post
+        size_t mark;               // Visitor scalar slot, kept from pre to post
+    } TreeFrame;
+
+    // Hooks called by tree_walk; parent is NULL for the walk root
+    // Frame pointers are only valid during the call
+    typedef struct TreeVisitor {
+        TreeWalkAction (*pre)(TreeFrame *frame, TreeFrame *parent, void *ctx);   // Before the children (optional)
+        TreeWalkAction (*post)(TreeFrame *frame, TreeFrame *parent, void *ctx);  // After the children (optional)
+        void *ctx;                 // Passed to both hooks
+    } TreeVisitor;
+
+    // Function to walk a tree depth-first with an explicit stack, children in order
+    // Empty child slots are skipped, depth is limited by memory only
+    // On a stop or an allocation failure the open frames are unwound through post
+    // Returns 0 once every node is visited, non-zero if the walk was stopped or failed
+    int tree_walk(Tree root, const TreeVisitor *visitor);
+
+    // Entry attribute sets interned per block, blocks are never moved or freed
+    #define TREE_ATTRS_BLOCK 1024
+    // Maximum number of blocks, so at most TREE_ATTRS_BLOCK * TREE_ATTRS_BLOCKS distinct sets
+    #define TREE_ATTRS_BLOCKS 4096
+
+    // Function to intern a set of entry attributes and return its id for TreeNode.attrs
+    // Equal sets share one id; the defaults, NULL and an allocation failure give 0
+    // Safe to call from several threads
+    uint32_t tree_attrs_intern(const EntryAttrs *attrs);
+
+    // Function to get the attributes interned under id, NULL for 0
+    // Readers need no lock: a set never moves once its id is returned
+    const EntryAttrs *tree_attrs(uint32_t id);
+
     // Function to create a new tree with a specified root path
     Tree new_tree(const char *path);
 
+    // Function to turn a childless file node into a link to target (copied)
+    // Hard link targets must stay inside the template (see tree_link_inside)
+    // Returns 0 on success, non-zero if node can not be a link or on allocation failure
+    int tree_set_link(Tree node, TreeLink link, const char *target);
+
+    // Function to check that a hard link target is relative and stays below the template root
+    // levels is the number of directories holding the link, the root included
+    bool tree_link_inside(const char *target, size_t levels);
+
+    // Function to find the file a hard link node names, walking the nodes from the link directory
+    // Returns NULL if the target is missing, is not a file, or passes through (or is) a link node
+    // The tree must be complete: a target declared after the link is only found once parsed
+    Tree tree_link_resolve(const Tree node);
+
     // Function to attach a child node to a parent node with a specified name
     Tree attach_child(Tree parent, const char *name);
 
+    // Function to mount a shared subtree under a parent node without copying it
+    // The subtree keeps its own paths, relative to the parent mount point
+    Tree mount_subtree(Tree parent, Tree subtree);
+
+    // Function to index every node of root by full path ("root/dir/file", PATH_SEPARATOR between names)
+    // attach_child and mount_subtree keep the index up to date afterwards, clean_tree frees it
+    // When a path is declared twice the first node is kept
+    // Returns 0 on success, non-zero on allocation failure (lookups then walk the tree)
+    int tree_index(Tree root);
+
+    // Function to find the node at path below root, NULL if there is none
+    // O(1) on an indexed root, otherwise the tree is walked one name at a time
+    Tree tree_find(Tree root, const char *path);
+
+    // Function to check if path names a node below root
+    bool tree_contains(Tree root, const char *path);
+
     // Function to check if a tree is empty (i.e., has no nodes)
     bool is_empty_tree(Tree tree);
 
     // Function to print the tree structure, indented by level
+    // Output goes through the buffered exporter (see export.h)
     void print_tree(Tree tree, int level);
 
     // Function to clean up and free resources associated with a tree
+    // Shared (included) children are left to their owner
     void clean_tree(Tree *tree);
 
 #endif  // End of include guard
@@ -8,4 +8,9 @@
     // Allocates memory for the new string and returns a pointer to it
     char *_strndup(const char *src, size_t n);
 
+    // Function to hash n bytes (FNV-1a), chained from a previous hash value
+    // Pass HASH_SEED to start a new hash
+    #define HASH_SEED ((size_t)14695981039346656037ULL)
+    size_t hash_bytes(const void *data, size_t n, size_t seed);
+
 #endif  // End of include guard
@@ -0,0 +1,37 @@
+#ifndef __WATCH_H__
+    #define __WATCH_H__
+
+    /* Parser and include cache */
+    #include "parser.h"
+    /* Template deltas */
+    #include "diff.h"
+
+    #ifdef __linux__
+        #include <sys/inotify.h>
+        #include <poll.h>
+        #include <signal.h>
+        #include <time.h>
+    #endif
+
+    /* Quiet time after the last event before a save is re-applied, so an
+     * editor writing the file in several steps triggers a single pass */
+    #ifndef WATCH_SETTLE_MS
+        #define WATCH_SETTLE_MS 20
+    #endif
+
+    /* Build a template, then keep the destination in sync with its edits.
+     *
+     * The parsed tree and the destination descriptor stay in memory. The
+     * template directory is watched with inotify, so in-place writes and
+     * editors replacing the file by rename are both seen. Each save is
+     * parsed again and diffed against the previous tree, and only the new
+     * entries are created. Entries dropped from the template are listed
+     * but kept on disk, so no file is lost to a half-finished edit. A save
+     * that fails to parse keeps the previous tree. Included templates are
+     * read once per session.
+     * Runs until SIGINT or SIGTERM.
+     * Returns 0 on a clean stop, non-zero if the watch could not start.
+     */
+    int watch_template(const char *path, const char *dest_dir);
+
+#endif
@@ -3,10 +3,39 @@
 int init_args(Args *args){
     args->input_files = NULL;
     args->file_count = 0;
+    args->dest_paths = NULL;
+    args->dest_count = 0;
     args->debug_mode = false;
+    args->remove_mode = false;
+    args->jobs = 0;
+    args->pipeline_mode = false;
+    args->direct_mode = false;
+    args->export_mode = false;
+    args->export_format = EXPORT_TEXT;
+    args->plan_path = NULL;
+    args->apply_plan_path = NULL;
+    args->show_plan_path = NULL;
+    args->diff_old = NULL;
+    args->diff_new = NULL;
+    args->update_mode = false;
+    args->watch_mode = false;
+    args->serve_path = NULL;
+    args->client_path = NULL;
+    args->find_path = NULL;
+    args->filter = (PathFilter){ 0 };
+    args->preflight = true;
+    args->journal_path = NULL;
+    args->batch_path = NULL;
+    args->dedup = false;
+    args->throttle = false;
+    args->max_ops = 0;
+    args->progress = false;
+    args->trace_path = NULL;
 
-    /* Allocate a buffer for destination path */
-    args->dest_path = malloc(PATH_MAX);
+    /* The destination defaults to the current directory, named relatively:
+     * no getcwd call nor PATH_MAX buffer on every start.
+     */
+    args->dest_path = strdup(".");
     if(!args->dest_path){
         /* Allocation failed: print an error and free any allocated resources. */
         fprintf(stderr, "fatal : attocation failed\n");
@@ -14,14 +43,6 @@ int init_args(Args *args){
         return EXIT_FAILURE;
     }
 
-    /* Get the current working directory and store it in dest_path.
-     * If getcwd fails, print an error and return failure.
-     */
-    if(getcwd(args->dest_path, PATH_MAX) == NULL){
-        fprintf(stderr, "fatal : failed to get the courant path\n");
-        return EXIT_FAILURE;
-    }
-    
     return EXIT_SUCCESS;
 }
 
@@ -38,6 +59,51 @@ int add_input_file(Args *args, const char *filename){
     return EXIT_SUCCESS;
 }
 
+int add_dest_path(Args *args, const char *path){
+    char **tmp = realloc(args->dest_paths, sizeof(char*) * (args->dest_count + 1));
+    char *copy = strdup(path);
+    if(!tmp || !copy){
+        free(copy);
+        if(tmp)
+            args->dest_paths = tmp;
+        return EXIT_FAILURE;
+    }
+    args->dest_paths = tmp;
+    args->dest_paths[args->dest_count++] = copy;
+
+    if(args->dest_count == 1){
+        /* The first destination is the one of the single-destination modes */
+        char *dest = strdup(path);
+        if(!dest)
+            return EXIT_FAILURE;
+        free(args->dest_path);
+        args->dest_path = dest;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Add every destination listed in a file, one per line ('#' starts a comment line)
+static int add_dest_file(Args *args, const char *path){
+    FILE *fp = fopen(path, "r");
+    if(!fp){
+        fprintf(stderr, "fatal : cannot open destinations file \"%s\"\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char line[PATH_MAX + 2];
+    int status = EXIT_SUCCESS;
+    while(status == EXIT_SUCCESS && fgets(line, sizeof(line), fp)){
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if(len == 0 || line[0] == '#')
+            continue;
+        status = add_dest_path(args, line);
+    }
+
+    fclose(fp);
+    return status;
+}
+
 void free_args(Args *args){
     /* Free each input file */
     for(unsigned int i = 0; i < args->file_count; i++){
@@ -45,6 +111,15 @@ void free_args(Args *args){
     }
     free(args->input_files);    /* Free the input files array */
     free(args->dest_path);      /* Free the dest */
+    for(unsigned int i = 0; i < args->dest_count; i++)
+        free(args->dest_paths[i]);
+    free(args->dest_paths);     /* Free the destination list */
+    filter_free(&args->filter); /* Free the compiled patterns */
+}
+
+// Check if an argument is an option ("-" alone names the standard input)
+static bool is_option(const char *arg){
+    return arg[0] == '-' && arg[1] != '\0';
 }
 
 int parse_args(int argc, char **argv, Args *args){
@@ -54,15 +129,15 @@ int parse_args(int argc, char **argv, Args *args){
     // Loop to check given arguments
     for(int i = 1; i < argc; i++){
         if(strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--tree") == 0){   /* Check the --tree or -t option */
-            while(i + 1 < argc && argv[i + 1][0] != '-')
+            while(i + 1 < argc && !is_option(argv[i + 1]))
                 if(add_input_file(args, argv[++i]) != 0)                    /* Add given input files and check return value */
                     return EXIT_FAILURE;                                    /* Exit if the function failed */
         }
 
         else if(strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--dest") == 0){  /* Check the --dest or -d option */
             if(i + 1 < argc){                                                   /* Check the specified dest path */
-                free(args->dest_path);                                          /* Free the default dest path */
-                args->dest_path = strdup(argv[++i]);                            /* Reaffect the dest path */
+                if(add_dest_path(args, argv[++i]) != 0)                         /* Add it, the first one replaces the default */
+                    return EXIT_FAILURE;
             } else{
                 // Print the error
                 fprintf(stderr, "fatal : --dest/-d need to specify a argument\n");
@@ -70,11 +145,154 @@ int parse_args(int argc, char **argv, Args *args){
             }
         }
 
+        else if(strcmp(argv[i], "--dests") == 0){   /* Check the destinations file option */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : --dests need a file listing the destinations\n");
+                return EXIT_FAILURE;
+            }
+            if(add_dest_file(args, argv[++i]) != 0)
+                return EXIT_FAILURE;
+        }
+
         else if(strcmp(argv[i], "--debug") == 0)    /* Check the debug option */
             args->debug_mode = true;                /* Pass debug mode to true */
 
+        else if(strcmp(argv[i], "--remove") == 0)   /* Check the remove option */
+            args->remove_mode = true;               /* Pass remove mode to true */
+
+        else if(strcmp(argv[i], "--pipeline") == 0) /* Check the pipeline option */
+            args->pipeline_mode = true;             /* Pass pipeline mode to true */
+
+        else if(strcmp(argv[i], "--direct") == 0)   /* Check the direct option */
+            args->direct_mode = true;               /* Pass direct mode to true */
+
+        else if(strcmp(argv[i], "--watch") == 0)    /* Check the watch option */
+            args->watch_mode = true;                /* Pass watch mode to true */
+
+        else if(strcmp(argv[i], "--no-preflight") == 0) /* Check the no-preflight option */
+            args->preflight = false;                /* Skip the capacity check */
+
+        else if(strcmp(argv[i], "--dedup") == 0)    /* Check the dedup option */
+            args->dedup = true;                     /* Hard link identical files */
+
+        else if(strcmp(argv[i], "--throttle") == 0) /* Check the throttle option */
+            args->throttle = true;                  /* Adapt the operations in flight to the latency */
+
+        else if(strcmp(argv[i], "--progress") == 0) /* Check the progress option */
+            args->progress = true;                  /* Report the build progress on stderr */
+
+        else if(strcmp(argv[i], "--max-ops") == 0){ /* Check the max-ops option */
+            char *end = NULL;
+            double n = (i + 1 < argc) ? strtod(argv[i + 1], &end) : -1;
+            if(!(n > 0) || !end || *end != '\0'){                             /* Check the given rate */
+                fprintf(stderr, "fatal : --max-ops need a positive number\n");
+                return EXIT_FAILURE;
+            }
+            args->max_ops = n;
+            i++;
+        }
+
+        else if(strcmp(argv[i], "--export") == 0){  /* Check the export option */
+            if(i + 1 >= argc || export_format_parse(argv[i + 1], &args->export_format) != 0){
+                fprintf(stderr, "fatal : --export need a format: text, json or paths0\n");
+                return EXIT_FAILURE;
+            }
+            args->export_mode = true;
+            i++;
+        }
+
+        else if(strcmp(argv[i], "--plan") == 0 || strcmp(argv[i], "--apply-plan") == 0 || strcmp(argv[i], "--show-plan") == 0){ /* Check the plan options */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : %s need a plan file\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            if(strcmp(argv[i], "--plan") == 0)
+                args->plan_path = argv[i + 1];
+            else if(strcmp(argv[i], "--apply-plan") == 0)
+                args->apply_plan_path = argv[i + 1];
+            else
+                args->show_plan_path = argv[i + 1];
+            i++;
+        }
+
+        else if(strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--client") == 0){ /* Check the server options */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : %s need a socket path\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            if(strcmp(argv[i], "--serve") == 0)
+                args->serve_path = argv[i + 1];
+            else
+                args->client_path = argv[i + 1];
+            i++;
+        }
+
+        else if(strcmp(argv[i], "--resume") == 0){  /* Check the resume option */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : --resume need a journal file\n");
+                return EXIT_FAILURE;
+            }
+            args->journal_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "--batch") == 0){   /* Check the batch option */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : --batch need a bindings table\n");
+                return EXIT_FAILURE;
+            }
+            args->batch_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "--trace") == 0){   /* Check the trace option */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : --trace need an output file\n");
+                return EXIT_FAILURE;
+            }
+            args->trace_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "--find") == 0){    /* Check the find option */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : --find need a path\n");
+                return EXIT_FAILURE;
+            }
+            args->find_path = argv[++i];
+        }
+
+        else if(strcmp(argv[i], "--only") == 0 || strcmp(argv[i], "--exclude") == 0){ /* Check the filter options */
+            if(i + 1 >= argc){
+                fprintf(stderr, "fatal : %s need a path pattern\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            if(filter_add(&args->filter, argv[i + 1], strcmp(argv[i], "--exclude") == 0) != 0)
+                return EXIT_FAILURE;
+            i++;
+        }
+
+        else if(strcmp(argv[i], "--diff") == 0 || strcmp(argv[i], "--update") == 0){ /* Check the diff options */
+            if(i + 2 >= argc){
+                fprintf(stderr, "fatal : %s need an old and a new template\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            args->update_mode = (strcmp(argv[i], "--update") == 0);
+            args->diff_old = argv[i + 1];
+            args->diff_new = argv[i + 2];
+            i += 2;
+        }
+
+        else if(strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0){ /* Check the --jobs or -j option */
+            char *end = NULL;
+            long n = (i + 1 < argc) ? strtol(argv[i + 1], &end, 10) : -1;
+            if(n < 0 || !end || *end != '\0'){                                 /* Check the given count */
+                fprintf(stderr, "fatal : --jobs/-j need a positive number\n");
+                return EXIT_FAILURE;
+            }
+            args->jobs = (unsigned int)n;
+            i++;
+        }
+
         // Others arguments who are not option
-        else if(argv[i][0] != '-'){
+        else if(!is_option(argv[i])){
             if(add_input_file(args, argv[i]) != 0) /* Consider arg as input file */
                 return EXIT_FAILURE;
         } else{                                    /* If the arg begin with '-' consider that as unkwown option */
@@ -86,6 +304,31 @@ int parse_args(int argc, char **argv, Args *args){
         }
     }
 
+    if(args->watch_mode && args->file_count != 1){ /* A watch follows exactly one template */
+        fprintf(stderr, "fatal : --watch need exactly one input file\n");
+        return EXIT_FAILURE;
+    }
+
+    if(args->batch_path && (args->remove_mode || args->direct_mode || args->pipeline_mode || args->watch_mode
+                            || args->client_path || args->journal_path)){ /* Instances are replayed from a compiled plan */
+        fprintf(stderr, "fatal : --batch can not be used with --remove, --direct, --pipeline, --watch, --client or --resume\n");
+        return EXIT_FAILURE;
+    }
+
+    if(args->client_path && (args->pipeline_mode || args->direct_mode || args->export_mode || args->plan_path || filter_active(&args->filter)
+                             || args->dedup || args->throttle || args->max_ops > 0)){ /* The server builds from its shared parsed trees */
+        fprintf(stderr, "fatal : --client can not be used with --pipeline, --direct, --export, --plan, --only, --exclude, --dedup, --throttle or --max-ops\n");
+        return EXIT_FAILURE;
+    }
+
+    // Only the tree builds, removals and plan replays fan out
+    bool single = args->direct_mode || args->pipeline_mode || args->watch_mode || args->update_mode
+               || args->client_path || args->journal_path;
+    if(args->dest_count > 1 && single){
+        fprintf(stderr, "fatal : --direct, --pipeline, --watch, --update, --client and --resume need a single destination\n");
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;    /* Exit with success */
 }
 
@@ -94,6 +337,31 @@ void print_help(){
     printf("Create tree templates from tree file.\n\n"
     "treemaker [options] [input_file]\n\n"
     "--debug, -d\tActivate the debug mode.\n"
-    "--tree, -t\tThe input file to create the project tree.\n"
-    "--path, -p\tThe destination path to create the project tree.\n\n");
+    "--tree, -t\tThe input file to create the project tree (\"-\" reads the standard input).\n"
+    "--path, -p\tThe destination path to create the project tree.\n"
+    "--remove\tRemove the entries described by the input file instead of creating them.\n"
+    "--jobs, -j\tNumber of worker threads (default: one per processor).\n"
+    "--pipeline\tLex, parse and build at the same time on separate threads.\n"
+    "--direct\tCreate entries as they are read, without building a tree in memory.\n"
+    "--export FMT\tPrint the parsed tree as text, json or paths0 (NUL-separated) instead of creating it.\n"
+    "--plan FILE\tCompile the templates into a binary operation log instead of creating them.\n"
+    "--apply-plan FILE\tReplay a compiled plan into the destination, without reading any template.\n"
+    "--show-plan FILE\tPrint the operations of a compiled plan for review.\n"
+    "--diff OLD NEW\tPrint the entries added (+), removed (-), retyped (~) and with new attributes (*) between two templates.\n"
+    "--update OLD NEW\tApply that delta to a destination built from OLD, touching only what changed.\n"
+    "--watch\t\tBuild the template, then create the new entries each time it is saved.\n"
+    "--serve SOCKET\tServe build requests on a Unix socket, keeping parsed templates warm.\n"
+    "--client SOCKET\tSend the build (or --remove) to the server listening on SOCKET.\n"
+    "--find PATH\tPrint the type of the entry at PATH (root/dir/file) in the template, fail if it is missing.\n"
+    "--only PATTERN\tOnly create the entries matching PATTERN (below the root, * ? and ** globs), with their parents.\n"
+    "--exclude PATTERN\tSkip the entries matching PATTERN and everything below them.\n"
+    "--no-preflight\tDo not check the free inodes and space of the destination before building.\n"
+    "--resume FILE\tJournal the build to FILE; run again with the same FILE after an interruption to continue where it stopped.\n"
+    "--dests FILE\tBuild into every destination listed in FILE (one per line), like repeating --dest.\n"
+    "--batch TABLE\tBuild one instance per row of TABLE, its header naming the ${var} placeholders of the template.\n"
+    "--dedup\t\tCreate identical files as hard links of one inode, saving inodes and creations.\n"
+    "--throttle\tAdapt the operations in flight to the filesystem latency, backing off when it queues.\n"
+    "--max-ops N\tStart at most N filesystem operations per second.\n"
+    "--progress\tPrint the entries done, the rate and the time left on stderr while building.\n"
+    "--trace FILE\tRecord the lex, parse and build phases and the slow filesystem calls to FILE as Chrome trace-event JSON.\n\n");
 }
@@ -15,33 +15,462 @@ char *build_full_path(const Tree node, const char *base_path){
     return full_path;       /* Return the built path */
 }
 
-int build_directories_only(const Tree node, const char *base_path){
-    if(node == NULL){
-        fprintf(stderr, "fatal (build directory): can not create the directory because tree is empty.\n");
+/* Creation pass run by build_walk */
+typedef enum BuildPass {
+    BUILD_DIRECTORIES,          // Directories only, files and their children are skipped
+    BUILD_FILES                 // Files, looking through every directory
+} BuildPass;
+
+/* Pre-order index range [start, end) of a completed subtree */
+typedef struct BuildRange {
+    size_t start;               // Index of the subtree root
+    size_t end;                 // Index past its last node
+} BuildRange;
+
+/* Checkpoint journal of a resumable build.
+ *
+ * Every node visited by a pass gets its pre-order index. The journal is
+ * appended with the prefix of the pass known done ("P pass k"), flushed
+ * every BUILD_JOURNAL_EVERY nodes, and with the range of each completed
+ * subtree of BUILD_JOURNAL_SPAN nodes or more ("R pass start end").
+ * A failure makes the following indices unreliable (a failed entry is not
+ * descended into): the pass then stops reading and writing the journal.
+ */
+typedef struct BuildJournal {
+    FILE *fp;                   // Journal being appended
+    BuildRange *ranges[2];      // Subtrees completed by earlier runs, per pass, sorted by start
+    size_t range_count[2];      // Number of ranges per pass
+    size_t prefix[2];           // Nodes done by earlier runs, per pass
+    size_t next;                // Index of the next node of the pass
+    size_t cursor;              // First range of the pass that may start at next or later
+    size_t marked;              // Index of the last prefix record
+    bool failed;                // The pass failed, the journal is left alone until the next one
+    bool any_failed;            // Some pass failed, the journal is kept for a resume
+} BuildJournal;
+
+#ifndef _WIN32
+/* File standing for every later file with the same attributes */
+typedef struct BuildSource {
+    uint32_t attrs;             // Attribute set of the file
+    int dirfd;                  // Directory holding it (owned)
+    char *name;                 // Its name (owned)
+} BuildSource;
+
+/* Content deduplication state of one walk or direct stream, see build_set_dedup */
+typedef struct BuildDedup {
+    BuildSource sources[BUILD_DEDUP_SETS]; // One source per attribute set met so far
+    size_t count;               // Number of sources
+} BuildDedup;
+#endif
+
+static bool dedup_files = false;    // Hard link identical files, see build_set_dedup
+
+void build_set_dedup(bool enabled){
+    dedup_files = enabled;
+}
+
+typedef struct BuildWalk {
+    BuildPass pass;             // What to create
+    const char *base_path;      // Base path of the walk root
+    bool root_created;          // The root already exists as a directory, only its children are built
+    int status;                 // Failure of any entry of the walk
+    bool root_failed;           // The walk root itself failed, nothing below it was built
+    BuildJournal *journal;      // Checkpoint journal, NULL when the build is not resumable
+#ifndef _WIN32
+    int base_fd;                // Directory holding the walk root
+    BuildDedup *dedup;          // Files already created, NULL unless deduplicating
+#endif
+} BuildWalk;
+
+static const char build_pass_tag[2] = { 'D', 'F' };
+
+// Visit a node in the journal: returns the end of its subtree if an earlier run completed it, 0 otherwise
+static size_t journal_enter(BuildJournal *j, BuildPass pass, TreeFrame *frame, bool *done){
+    size_t i = j->next++;
+    frame->mark = i;
+    *done = false;
+    if(j->failed)
+        return 0;
+
+    // Indices only grow, so the range cursor only moves forward
+    while(j->cursor < j->range_count[pass] && j->ranges[pass][j->cursor].start < i)
+        j->cursor++;
+    if(j->cursor < j->range_count[pass] && j->ranges[pass][j->cursor].start == i)
+        return j->ranges[pass][j->cursor].end;
+
+    *done = (i < j->prefix[pass]);
+    if(i - j->marked >= BUILD_JOURNAL_EVERY){
+        // Every node before this one is done
+        fprintf(j->fp, "P %c %zu\n", build_pass_tag[pass], i);
+        fflush(j->fp);
+        j->marked = i;
+    }
+    return 0;
+}
+
+static void journal_fail(BuildJournal *j){
+    if(j){
+        j->failed = true;
+        j->any_failed = true;
+    }
+}
+
+// Order ranges by start, the widest first
+static int range_cmp(const void *a, const void *b){
+    const BuildRange *x = a, *y = b;
+    if(x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+    return (x->end > y->end) ? -1 : (x->end < y->end);
+}
+
+/* Size of a journal header: the stats and the real path of the destination */
+#define BUILD_JOURNAL_HEADER (PATH_MAX + 128)
+
+// First line of the journal of a tree with these stats built into dest_dir
+static void journal_header(char *header, size_t cap, const char *dest_dir, const TreeStats *stats){
+    #ifdef _WIN32
+        char *real = _fullpath(NULL, dest_dir, 0);
+    #else
+        char *real = realpath(dest_dir, NULL);
+    #endif
+    snprintf(header, cap, "treemaker-journal 2 %zu %zu %zx %s\n", stats->directories, stats->files, stats->shape, real ? real : dest_dir);
+    free(real);
+}
+
+// Whether the first line read from in is header
+static bool journal_header_matches(FILE *in, const char *header){
+    char line[BUILD_JOURNAL_HEADER];
+    return in && fgets(line, sizeof(line), in) && strcmp(line, header) == 0;
+}
+
+bool build_journal_matches(const char *journal_path, const char *dest_dir, const TreeStats *stats){
+    char header[BUILD_JOURNAL_HEADER];
+    journal_header(header, sizeof(header), dest_dir, stats);
+    FILE *in = fopen(journal_path, "r");
+    bool match = journal_header_matches(in, header);
+    if(in)
+        fclose(in);
+    return match;
+}
+
+// Open the journal at path, loading what an earlier run of the same tree into the same destination recorded
+static int journal_open(BuildJournal *j, const char *path, const char *dest_dir, const TreeStats *stats){
+    memset(j, 0, sizeof(*j));
+
+    char header[BUILD_JOURNAL_HEADER];
+    journal_header(header, sizeof(header), dest_dir, stats);
+
+    FILE *in = fopen(path, "r");
+    char line[128];
+    bool resume = journal_header_matches(in, header);
+    if(in && !resume)
+        fprintf(stderr, "warning (build tree): journal \"%s\" was written for another template or destination, starting over.\n", path);
+
+    while(resume && fgets(line, sizeof(line), in)){
+        char tag;
+        size_t a, b;
+        size_t len = strlen(line);
+        if(len == 0 || line[len - 1] != '\n')
+            break;                              /* Torn last record of a killed run */
+        int n = sscanf(line, "P %c %zu", &tag, &a);
+        int pass = (tag == 'D') ? BUILD_DIRECTORIES : (tag == 'F') ? BUILD_FILES : -1;
+        if(n == 2 && pass >= 0){
+            if(a > j->prefix[pass])
+                j->prefix[pass] = a;
+            continue;
+        }
+        n = sscanf(line, "R %c %zu %zu", &tag, &a, &b);
+        pass = (tag == 'D') ? BUILD_DIRECTORIES : (tag == 'F') ? BUILD_FILES : -1;
+        if(n != 3 || pass < 0 || b <= a)
+            continue;
+        BuildRange *tmp = realloc(j->ranges[pass], (j->range_count[pass] + 1) * sizeof(BuildRange));
+        if(!tmp){
+            fprintf(stderr, "fatal (build tree): memory allocation failed for journal \"%s\".\n", path);
+            fclose(in);
+            return EXIT_FAILURE;
+        }
+        tmp[j->range_count[pass]++] = (BuildRange){ a, b };
+        j->ranges[pass] = tmp;
+    }
+    if(in)
+        fclose(in);
+
+    for(int pass = 0; pass < 2; pass++)
+        if(j->range_count[pass] > 1)
+            qsort(j->ranges[pass], j->range_count[pass], sizeof(BuildRange), range_cmp);
+
+    j->fp = fopen(path, resume ? "a" : "w");
+    if(!j->fp){
+        fprintf(stderr, "fatal (build tree): cannot write journal \"%s\".\n", path);
+        return EXIT_FAILURE;
+    }
+    if(!resume)
+        fputs(header, j->fp);
+    fflush(j->fp);
+    return EXIT_SUCCESS;
+}
+
+#ifndef _WIN32
+// Each frame of a directory with children to build holds its descriptor
+// (fd + 1, NULL for none): entries are created relative to their parent, so
+// shared (included) subtrees need no rebasing and no path is resolved twice
+static int frame_fd(const TreeFrame *frame){
+    return (int)(intptr_t)frame->data - 1;
+}
+
+// Whether a pass has something to create below node
+static bool build_descends(const Tree node, BuildPass pass){
+    for(size_t i = 0; i < node->child_count; i++)
+        if(node->children[i] && (pass == BUILD_FILES || node->children[i]->is_directory))
+            return true;
+    return false;
+}
+
+// Create an empty file as a hard link to the first one with the same attributes:
+// every file is empty, so files only differ by what their inode carries
+static int dedup_create(BuildDedup *dedup, int dirfd, const char *name, uint32_t attrs){
+    BuildSource *src = NULL;
+    for(size_t i = 0; i < dedup->count && !src; i++)
+        if(dedup->sources[i].attrs == attrs)
+            src = &dedup->sources[i];
+    if(src && link_file_at(src->dirfd, src->name, dirfd, name) == 0)
+        return EXIT_SUCCESS;
+
+    // First of its kind, or the source can take no more links: this file becomes the source
+    if(create_file_attrs_at(dirfd, name, tree_attrs(attrs)) != 0)
+        return EXIT_FAILURE;
+    if(!src && dedup->count < BUILD_DEDUP_SETS)
+        src = &dedup->sources[dedup->count++];
+    else if(src){
+        close(src->dirfd);
+        free(src->name);
+    }
+    if(src){
+        *src = (BuildSource){ attrs, fcntl(dirfd, F_DUPFD_CLOEXEC, 0), strdup(name) };
+        if(src->dirfd < 0 || !src->name){
+            // Deduplication is an optimization: without a source the next file is created again
+            if(src->dirfd >= 0)
+                close(src->dirfd);
+            free(src->name);
+            *src = dedup->sources[--dedup->count];
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static void dedup_free(BuildDedup *dedup){
+    for(size_t i = 0; i < dedup->count; i++){
+        close(dedup->sources[i].dirfd);
+        free(dedup->sources[i].name);
+    }
+    dedup->count = 0;
+}
+
+// Create a hard link to a file of the template, relative to the link directory
+// The target stays inside the template (see tree_link_inside) and is reached without following any link
+static int build_hardlink(int dirfd, const Tree node){
+    if(!tree_link_resolve(node)){
+        fprintf(stderr, "error : \"%s\" links to \"%s\", which is not a file of the template.\n", node->path, node->target);
         return EXIT_FAILURE;
     }
+    // Not created yet (declared later, or built by another task): the target and its directories
+    // are created now, their own visit finds them there
+    if(link_file_beneath(dirfd, node->target, node->name, true) == 0)
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "error : failed to link \"%s\" to \"%s\" (%s).\n", node->name, node->target, strerror(errno));
+    return EXIT_FAILURE;
+}
+
+// Create one entry relative to dirfd
+static int build_create(BuildWalk *walk, int dirfd, const Tree node){
+    const EntryAttrs *attrs = tree_attrs(node->attrs);
+    if(node->is_directory)
+        return create_folder_attrs_at(dirfd, node->name, attrs);
+    if(node->link == TREE_LINK_SYMBOLIC)
+        return create_symlink_at(dirfd, node->name, node->target);
+    if(node->link == TREE_LINK_HARD)
+        return build_hardlink(dirfd, node);
+    if(walk->dedup)
+        return dedup_create(walk->dedup, dirfd, node->name, node->attrs);
+    return create_file_attrs_at(dirfd, node->name, attrs);
+}
+
+static int build_enter(TreeFrame *frame, TreeFrame *parent, BuildWalk *walk, bool create){
+    Tree node = frame->node;
+    int dirfd = parent ? frame_fd(parent) : walk->base_fd;
 
-    /* Construct the full path for this node */
-    char *full_path = build_full_path(node, base_path);
-    if(!full_path)
+    frame->data = NULL;
+    if(create && build_create(walk, dirfd, node) != 0)
         return EXIT_FAILURE;
+    if(!node->is_directory || !build_descends(node, walk->pass))
+        return EXIT_SUCCESS;
 
-    if(node->is_directory){
-        /* Create the directory represented by this node */
-        if(create_folder(full_path) != 0){
-            free(full_path);
+    int fd = open_folder_at(dirfd, node->name);
+    if(fd < 0){
+        fprintf(stderr, "error : failed to open directory \"%s\".\n", node->name);
+        return EXIT_FAILURE;
+    }
+    frame->data = (void *)(intptr_t)(fd + 1);
+    return EXIT_SUCCESS;
+}
+
+// Set the attributes of a complete directory, then let its descriptor go
+static int build_leave(TreeFrame *frame, TreeFrame *parent, BuildWalk *walk){
+    Tree node = frame->node;
+    int fd = frame_fd(frame);
+    int status = EXIT_SUCCESS;
+
+    // Only once the files pass is done: creating the children would change the time again
+    if(walk->pass == BUILD_FILES && node->is_directory && node->attrs != 0){
+        const EntryAttrs *attrs = tree_attrs(node->attrs);
+        status = (fd >= 0) ? apply_folder_attrs(fd, node->name, attrs)
+                           : apply_attrs_at(parent ? frame_fd(parent) : walk->base_fd, node->name, true, attrs);
+    }
+    if(fd >= 0)
+        close(fd);
+    return status;
+}
+#else
+// Each frame holds the base path of its node: shared (included) subtrees keep
+// paths relative to their mount point, so they get the full path of the parent
+static int build_enter(TreeFrame *frame, TreeFrame *parent, BuildWalk *walk, bool create){
+    Tree node = frame->node;
+    frame->data = (void *)(parent ? parent->data : walk->base_path);
+    if(parent && node->is_shared){
+        frame->data = build_full_path(parent->node, parent->data);
+        if(!frame->data)
             return EXIT_FAILURE;
-        }
-        /* Recursively create directories for children that are directories */
-        for(size_t i = 0; i < node->child_count; i++)
-            if(node->children[i] && node->children[i]->is_directory)
-                build_directories_only(node->children[i], base_path);
-        
     }
 
-    free(full_path);
+    int status = EXIT_SUCCESS;
+    if(create && node->link != TREE_LINK_NONE)
+        fprintf(stderr, "warning (build tree): links are not supported on this platform, \"%s\" skipped.\n", node->path);
+    else if(create){
+        char *full_path = build_full_path(node, frame->data);
+        status = full_path ? (node->is_directory ? create_folder(full_path) : create_file(full_path)) : EXIT_FAILURE;
+        free(full_path);
+    }
+    if(status != EXIT_SUCCESS && parent && node->is_shared)
+        free(frame->data);
+    return status;
+}
+
+// No attributes without descriptors: only the rebased path is freed
+static int build_leave(TreeFrame *frame, TreeFrame *parent, BuildWalk *walk){
+    (void)walk;
+    if(parent && frame->node->is_shared)
+        free(frame->data);
     return EXIT_SUCCESS;
 }
+#endif
+
+static TreeWalkAction build_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    BuildWalk *walk = ctx;
+    Tree node = frame->node;
+
+    // Completed by an earlier run: skip the whole subtree, or at least the creation
+    bool done = false;
+    if(walk->journal){
+        size_t end = journal_enter(walk->journal, walk->pass, frame, &done);
+        if(end > 0){
+            walk->journal->next = end;
+            return TREE_WALK_SKIP;
+        }
+    }
+
+    bool create = !done && node->is_directory == (walk->pass == BUILD_DIRECTORIES);
+    if(!parent && walk->root_created)
+        create = false;
+    else if(walk->pass == BUILD_DIRECTORIES && parent && !node->is_directory)
+        return TREE_WALK_SKIP;
+
+    // A failed entry is not descended into, like before any child is built
+    if(build_enter(frame, parent, walk, create) != EXIT_SUCCESS){
+        walk->status = EXIT_FAILURE;
+        walk->root_failed = walk->root_failed || !parent;
+        journal_fail(walk->journal);
+        return TREE_WALK_SKIP;
+    }
+
+    // Only the directory pass stops at a file root
+    return (walk->pass == BUILD_DIRECTORIES && !node->is_directory) ? TREE_WALK_SKIP : TREE_WALK_CONTINUE;
+}
+
+static TreeWalkAction build_post(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    BuildWalk *walk = ctx;
+    if(build_leave(frame, parent, walk) != EXIT_SUCCESS){
+        walk->status = EXIT_FAILURE;
+        journal_fail(walk->journal);
+    }
+
+    // The subtree is complete: record it if skipping it on a resume is worth a line
+    BuildJournal *j = walk->journal;
+    if(j && !j->failed && j->next - frame->mark >= BUILD_JOURNAL_SPAN)
+        fprintf(j->fp, "R %c %zu %zu\n", build_pass_tag[walk->pass], frame->mark, j->next);
+    return TREE_WALK_CONTINUE;
+}
+
+// Walk one pass; root_failed (optional) tells if the walk root itself could not be built
+static int build_walk_journaled(const Tree node, const char *base_path, BuildPass pass, bool root_created, BuildJournal *journal, bool *root_failed){
+    BuildWalk walk = { .pass = pass, .base_path = base_path, .root_created = root_created, .status = EXIT_SUCCESS, .journal = journal };
+    if(journal){
+        journal->next = journal->cursor = journal->marked = 0;
+        journal->failed = false;
+    }
+
+    #ifndef _WIN32
+        // Hold the directory of the walk root: base_path, then the parents in node->path one at a
+        // time, so a symbolic link planted in place of one can not lead the walk outside
+        char *parents = strdup(node->path), *save = NULL;
+        if(!parents)
+            return EXIT_FAILURE;
+        char *last = strrchr(parents, PATH_SEPARATOR);
+        if(last)
+            *last = '\0';
+        walk.base_fd = open(base_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        for(char *name = last ? strtok_r(parents, "/", &save) : NULL; walk.base_fd >= 0 && name; name = strtok_r(NULL, "/", &save)){
+            int next = open_folder_at(walk.base_fd, name);
+            close(walk.base_fd);
+            walk.base_fd = next;
+        }
+        if(walk.base_fd < 0){
+            fprintf(stderr, "error : failed to open directory \"%s\" in \"%s\".\n", last ? parents : ".", base_path);
+            free(parents);
+            return EXIT_FAILURE;
+        }
+        free(parents);
+    #endif
+
+    #ifndef _WIN32
+        BuildDedup dedup = { .count = 0 };
+        if(dedup_files && pass == BUILD_FILES)
+            walk.dedup = &dedup;
+    #endif
+
+    TreeVisitor visitor = { build_pre, build_post, &walk };
+    int status = (tree_walk(node, &visitor) != 0) ? EXIT_FAILURE : walk.status;
+    if(root_failed)
+        *root_failed = walk.root_failed;
+    #ifndef _WIN32
+        dedup_free(&dedup);
+        close(walk.base_fd);
+    #endif
+    return status;
+}
+
+static int build_walk(const Tree node, const char *base_path, BuildPass pass, bool root_created){
+    return build_walk_journaled(node, base_path, pass, root_created, NULL, NULL);
+}
+
+int build_directories_only(const Tree node, const char *base_path){
+    if(node == NULL){
+        fprintf(stderr, "fatal (build directory): can not create the directory because tree is empty.\n");
+        return EXIT_FAILURE;
+    }
+
+    return build_walk(node, base_path, BUILD_DIRECTORIES, false);
+}
 
 int build_directory_recursive(const Tree node, const char *base_path){
     // Check if the node is empty
@@ -51,30 +480,8 @@ int build_directory_recursive(const Tree node, const char *base_path){
         return EXIT_FAILURE;    /* Exit and return a failure code */
     }
 
-    // Build the path
-    char *full_path = build_full_path(node, base_path);
-    // Check if the path is not built and exit with a failure code 
-    if(!full_path)
-        return EXIT_FAILURE;
-
-    // Check if the node is a directory
-    if(node->is_directory){
-        if(create_folder(full_path) != 0){      /* Check if the function failed */
-            free(full_path);                    /* Free the full path */
-            return EXIT_FAILURE;                /* Exit with a failure code */
-        }
-        free(full_path);                        /* Free the full path if the function did not fail */
-
-        // Recursivelly call the function for each node child
-        for(size_t i = 0; i < node->child_count; i++)
-            if(node->children[i] && node->children[i]->is_directory)
-                build_directory_recursive(node->children[i], base_path);
-        
-    } 
-    else
-        free(full_path);                        /* Free the full path if the node is not a directory */
-    
-    return EXIT_SUCCESS;                        /* Exit successfully */
+    // Create the directory of node, then its child directories in pre-order
+    return build_walk(node, base_path, BUILD_DIRECTORIES, false);
 }
 
 int build_file_recursive(const Tree node, const char *base_path){
@@ -84,57 +491,532 @@ int build_file_recursive(const Tree node, const char *base_path){
         return EXIT_FAILURE;
     }
 
-    if(!node->is_directory){                                    /* Check if the node is not a directory */
-        char *full_path = build_full_path(node, base_path);     /* Build the full path */
-        if(!full_path)                                          /* Check if the full path is built */
-            return EXIT_FAILURE;                                /* Exit and return a failure code */    
+    // Create the files of node and of every directory below it
+    return build_walk(node, base_path, BUILD_FILES, false);
+}
+
+int build_tree(const Tree root, const char *dest_dir){
+    return build_tree_resume(root, dest_dir, NULL, NULL);
+}
 
-        // Create the file path of the node and manage erros
-        if(create_file(full_path) != 0){        
-            free(full_path);
-            return EXIT_FAILURE;
+int build_tree_resume(const Tree root, const char *dest_dir, const char *journal_path, const TreeStats *stats){
+    // Check if the root is empty print the error and exit with a failure code
+    if(is_empty_tree(root)){
+        fprintf(stderr, "fatal (build tree): tree is empty, nothing to create.\n");
+        return EXIT_FAILURE;
+    }
+
+    BuildJournal journal;
+    BuildJournal *j = (journal_path && stats) ? &journal : NULL;
+    if(j && journal_open(j, journal_path, dest_dir, stats) != 0){
+        free(journal.ranges[BUILD_DIRECTORIES]);
+        free(journal.ranges[BUILD_FILES]);
+        return EXIT_FAILURE;
+    }
+
+    // Build all directories from the root on, then all files once the root exists
+    // A failed entry fails the build but the files pass still builds the rest, unless the root itself is missing
+    bool root_failed = true;
+    uint64_t span = trace_begin();
+    int status = build_walk_journaled(root, dest_dir, BUILD_DIRECTORIES, false, j, &root_failed);
+    trace_end(span, "build directories", dest_dir);
+    if(!root_failed){
+        span = trace_begin();
+        if(build_walk_journaled(root, dest_dir, BUILD_FILES, true, j, NULL) != 0)
+            status = EXIT_FAILURE;
+        trace_end(span, "build files", dest_dir);
+    }
+
+    if(j){
+        // A complete build has nothing left to resume, a failed one keeps its journal and fails
+        fclose(j->fp);
+        if(j->any_failed)
+            status = EXIT_FAILURE;
+        if(status == 0)
+            remove(journal_path);
+        free(j->ranges[BUILD_DIRECTORIES]);
+        free(j->ranges[BUILD_FILES]);
+    }
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#ifndef _WIN32
+/* One directory being removed.
+ *
+ * The job holds the directory descriptor until every child directory job
+ * is done, then removes the directory from its parent and releases the
+ * parent job in turn, so removal runs bottom-up without a global barrier.
+ */
+typedef struct RemoveJob {
+    Tree node;                  // Directory node to remove
+    int parent_fd;              // Descriptor of the parent directory (owned by the parent job)
+    int dirfd;                  // Descriptor of this directory
+    atomic_size_t pending;      // Running child jobs + 1 for this job own pass
+    struct RemoveJob *parent;   // Parent job (NULL for the root)
+    ThreadPool *pool;           // Pool running the jobs
+    atomic_int *status;         // Shared failure flag
+} RemoveJob;
+
+static void remove_job_release(RemoveJob *job);
+
+// Allocate a job for a directory node
+static RemoveJob *remove_job_new(Tree node, int parent_fd, RemoveJob *parent, ThreadPool *pool, atomic_int *status){
+    RemoveJob *job = malloc(sizeof(RemoveJob));
+    if(!job){
+        fprintf(stderr, "fatal (remove tree): memory allocation failed for \"%s\".\n", node->path);
+        atomic_store(status, EXIT_FAILURE);
+        return NULL;
+    }
+    job->node = node;
+    job->parent_fd = parent_fd;
+    job->dirfd = -1;
+    atomic_init(&job->pending, 1);
+    job->parent = parent;
+    job->pool = pool;
+    job->status = status;
+    return job;
+}
+
+// Pool task: remove the files of a directory and queue its child directories
+static void remove_job_run(void *arg){
+    RemoveJob *job = arg;
+    Tree node = job->node;
+    uint64_t span = trace_begin();
+
+    job->dirfd = open_folder_at(job->parent_fd, node->name);
+    if(job->dirfd < 0){
+        // A missing directory has nothing left to remove
+        if(errno != ENOENT){
+            fprintf(stderr, "error : failed to open directory \"%s\".\n", node->path);
+            atomic_store(job->status, EXIT_FAILURE);
         }
+        remove_job_release(job);
+        return;
+    }
 
-        // Finally free the full path 
-        free(full_path);
+    for(size_t i = 0; i < node->child_count; i++){
+        Tree child = node->children[i];
+        if(is_empty_tree(child))
+            continue;
+
+        if(!child->is_directory){
+            if(remove_file_at(job->dirfd, child->name) != 0)
+                atomic_store(job->status, EXIT_FAILURE);
+            continue;
+        }
+
+        // Child directories are removed by their own job
+        RemoveJob *sub = remove_job_new(child, job->dirfd, job, job->pool, job->status);
+        if(!sub)
+            continue;
+        atomic_fetch_add(&job->pending, 1);
+        if(pool_submit(job->pool, remove_job_run, sub) != 0){
+            atomic_store(job->status, EXIT_FAILURE);
+            atomic_fetch_sub(&job->pending, 1);
+            free(sub);
+        }
     }
 
-    // Repeat the process for each node child 
-    for(size_t i = 0; i < node->child_count; i++)
-        if(node->children[i])
-            build_file_recursive(node->children[i], base_path);
-        
-    return EXIT_SUCCESS;        // Exit successfully
+    trace_end(span, "remove directory", node->path);
+    remove_job_release(job);
 }
 
-int build_tree(const Tree root, const char *dest_dir){
+// Drop one reference; the last one removes the directory and walks up
+static void remove_job_release(RemoveJob *job){
+    while(job && atomic_fetch_sub(&job->pending, 1) == 1){
+        RemoveJob *parent = job->parent;
+
+        if(job->dirfd >= 0){
+            close(job->dirfd);
+            if(remove_folder_at(job->parent_fd, job->node->name) != 0)
+                atomic_store(job->status, EXIT_FAILURE);
+        }
+
+        free(job);
+        job = parent;
+    }
+}
+#endif
+
+int remove_tree(const Tree root, const char *dest_dir, unsigned int jobs){
     // Check if the root is empty print the error and exit with a failure code
     if(is_empty_tree(root)){
-        fprintf(stderr, "fatal (build tree): tree is empty, nothing to create.\n");
+        fprintf(stderr, "fatal (remove tree): tree is empty, nothing to remove.\n");
         return EXIT_FAILURE;
     }
 
-    // Build and check the full path
-    char *full_root_path = build_full_path(root, dest_dir);
-    if(!full_root_path)
+    #ifndef _WIN32
+        // Hold the destination directory, every removal is relative to it
+        int dest_fd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(dest_fd < 0){
+            fprintf(stderr, "fatal (remove tree): cannot open destination \"%s\".\n", dest_dir);
+            return EXIT_FAILURE;
+        }
+
+        ThreadPool pool;
+        if(pool_init(&pool, jobs) != 0){
+            close(dest_fd);
+            return EXIT_FAILURE;
+        }
+
+        atomic_int status;
+        atomic_init(&status, EXIT_SUCCESS);
+
+        RemoveJob *job = remove_job_new(root, dest_fd, NULL, &pool, &status);
+        if(job && pool_submit(&pool, remove_job_run, job) != 0){
+            free(job);
+            atomic_store(&status, EXIT_FAILURE);
+        }
+
+        pool_wait(&pool);               /* The root job is the last one to finish */
+        pool_destroy(&pool);
+        close(dest_fd);
+
+        return atomic_load(&status);
+    #else
+        (void)dest_dir; (void)jobs;
+        fprintf(stderr, "fatal (remove tree): removal is not supported on this platform.\n");
         return EXIT_FAILURE;
+    #endif
+}
+
+#ifndef _WIN32
+/* Entry last declared at one depth of a direct build */
+typedef struct DirectLevel {
+    char *name;         // Entry name without the directory mark (owned)
+    bool is_dir;        // Entry is a directory
+    int fd;             // Directory descriptor, -1 until a child needs it
+    EntryAttrs attrs;   // Attributes, inherited by the entries below
+    bool has_attrs;     // attrs differ from the defaults
+    TreeLink link;      // Link kind of a file
+    char *target;       // Link target (owned), NULL for plain entries
+} DirectLevel;
+
+/* Templates being streamed, innermost first, to detect include cycles */
+typedef struct DirectInclude {
+    const char *key;                    // Real path of the template
+    const struct DirectInclude *up;     // Including template
+} DirectInclude;
+
+static int direct_stream(const char *path, int base_fd, const DirectInclude *chain, BuildDedup *dedup);
 
-    // Create the root and manage errors
-    if(create_folder(full_root_path) != 0){
-        free(full_root_path);
+// Descriptor of the directory holding the entries of a depth, opened on first use
+static int direct_parent_fd(DirectLevel *levels, size_t depth, int base_fd){
+    if(depth == 0)
+        return base_fd;
+
+    DirectLevel *parent = &levels[depth - 1];
+    if(!parent->is_dir)
+        return -1;
+    if(parent->fd < 0)
+        parent->fd = open_folder_at(direct_parent_fd(levels, depth - 1, base_fd), parent->name);
+    return parent->fd;
+}
+
+// Match the entry name at depth against the filter, its path is rebuilt from the open levels
+static FilterVerdict direct_filter(const PathFilter *filter, const DirectLevel *levels, size_t depth, const char *name, bool is_dir, bool selected, char **buf, size_t *cap){
+    size_t need = strlen(name) + 1;
+    for(size_t d = 1; d < depth; d++)
+        need += strlen(levels[d].name) + 1;
+    if(need > *cap){
+        char *tmp = realloc(*buf, need);
+        if(!tmp){
+            fprintf(stderr, "fatal (direct build): failed to grow the filter path.\n");
+            return FILTER_SKIP;
+        }
+        *buf = tmp;
+        *cap = need;
+    }
+
+    char *p = *buf;
+    for(size_t d = 1; d < depth; d++){
+        size_t len = strlen(levels[d].name);
+        memcpy(p, levels[d].name, len);
+        p += len;
+        *p++ = '/';
+    }
+    strcpy(p, name);
+    return filter_check(filter, *buf, is_dir, selected);
+}
+
+// Link to a file already created: no tree is kept, so a target declared later can not be told from a missing one
+static int direct_hardlink(int parent_fd, const DirectLevel *l){
+    if(link_file_beneath(parent_fd, l->target, l->name, false) == 0)
+        return EXIT_SUCCESS;
+    if(errno == ENOENT || errno == ELOOP || errno == ENOTDIR || errno == EISDIR || errno == EINVAL)
+        fprintf(stderr, "error (direct build): \"%s\" links to \"%s\", which is not a file declared before it.\n", l->name, l->target);
+    else
+        fprintf(stderr, "error (direct build): failed to link \"%s\" to \"%s\" (%s).\n", l->name, l->target, strerror(errno));
+    return EXIT_FAILURE;
+}
+
+// Create the entry declared last, once its link or attribute list is known
+static int direct_create(DirectLevel *levels, size_t top, int base_fd, BuildDedup *dedup){
+    DirectLevel *l = &levels[top - 1];
+    int parent_fd = direct_parent_fd(levels, top - 1, base_fd);
+    const EntryAttrs *attrs = l->has_attrs ? &l->attrs : NULL;
+    if(l->is_dir)
+        return create_folder_attrs_at(parent_fd, l->name, attrs);
+    if(l->link == TREE_LINK_SYMBOLIC)
+        return create_symlink_at(parent_fd, l->name, l->target);
+    if(l->link == TREE_LINK_HARD)
+        return direct_hardlink(parent_fd, l);
+    if(dedup)
+        return dedup_create(dedup, parent_fd, l->name, tree_attrs_intern(attrs));
+    return create_file_attrs_at(parent_fd, l->name, attrs);
+}
+
+// Forget the entries at depth and deeper, their directories are complete
+static int direct_close(DirectLevel *levels, size_t *top, size_t depth, int base_fd){
+    int status = EXIT_SUCCESS;
+    while(*top > depth){
+        DirectLevel *l = &levels[--(*top)];
+        if(l->is_dir && l->has_attrs){
+            // The held descriptor if any, the parent one is open since the entry was created in it
+            int applied = (l->fd >= 0) ? apply_folder_attrs(l->fd, l->name, &l->attrs)
+                                       : apply_attrs_at(*top > 0 ? levels[*top - 1].fd : base_fd, l->name, true, &l->attrs);
+            if(applied != 0)
+                status = EXIT_FAILURE;
+        }
+        if(l->fd >= 0)
+            close(l->fd);
+        free(l->name);
+        free(l->target);
+    }
+    return status;
+}
+
+static int direct_stream(const char *path, int base_fd, const DirectInclude *chain, BuildDedup *dedup){
+    // Open the template, "-" streams it from the standard input
+    bool use_stdin = (strcmp(path, "-") == 0);
+    char *key = use_stdin ? NULL : realpath(path, NULL);
+    if(!use_stdin && !key && chain){
+        // Reported like the parser does, the include is skipped
+        fprintf(stderr, "error (direct build): cannot open included template \"%s\".\n", path);
+        return EXIT_SUCCESS;
+    }
+    for(const DirectInclude *c = chain; key && c; c = c->up){
+        if(strcmp(c->key, key) == 0){
+            fprintf(stderr, "error (direct build): include cycle through \"%s\".\n", path);
+            free(key);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    FILE *fp = use_stdin ? stdin : fopen(path, "rb");
+    if(!fp){
+        fprintf(stderr, "fatal (direct build): cannot open '%s'.\n", path);
+        free(key);
         return EXIT_FAILURE;
     }
-    free(full_root_path);
+    DirectInclude link = { key ? key : "-", chain };
+
+    LexerConfig cfg = PARSER_LEXER_CONFIG;
+    Lexer L;
+    lexer_init_stream(&L, lexer_read_file, fp, &cfg);
+
+    DirectLevel *levels = NULL;
+    size_t top = 0, cap = 0;
+    size_t level = 0;
+    int skip_level = -1;        /* Entries deeper than this level belong to a dropped entry */
+    char *root = NULL;          /* Name of the first top-level entry */
+    int status = EXIT_SUCCESS;
+
+    // Like the parser, included templates are streamed whole
+    const PathFilter *filter = chain ? NULL : parser_filter();
+    int select_level = -1;      /* Entries deeper than this level are selected by the filter */
+    char *rel = NULL;           /* Path below the root matched against the filter */
+    size_t rel_cap = 0;
+    bool pending = false;       /* The last entry waits for its attribute list to be created */
+
+    for(Token tok = lexer_next(&L); tok.type != T_EOF; token_free(&tok), tok = lexer_next(&L)){
+        if(tok.type == T_ATTRS){
+            DirectLevel *l = &levels[top - 1];
+            if(pending && parser_read_attrs(tok.lexeme, l->name, l->is_dir, &l->attrs) == 0)
+                l->has_attrs = true;
+            continue;
+        }
+        if(tok.type == T_SYMLINK || tok.type == T_HARDLINK){
+            // Only a file declared right there can become a link, like in the parser
+            DirectLevel *l = &levels[top - 1];
+            if(pending && !l->is_dir && top > 1 && !l->target
+               && (tok.type == T_SYMLINK || tree_link_inside(tok.lexeme, top - 1))){
+                l->link = (tok.type == T_SYMLINK) ? TREE_LINK_SYMBOLIC : TREE_LINK_HARD;
+                l->target = tok.lexeme;
+                tok.lexeme = NULL;
+            }
+            else if(pending)
+                fprintf(stderr, "warning (direct build): \"%s\" can not be a link, \"%s\" ignored.\n", l->name, tok.lexeme);
+            continue;
+        }
+        if(pending){
+            pending = false;
+            if(direct_create(levels, top, base_fd, dedup) != 0){
+                levels[top - 1].has_attrs = false;
+                skip_level = (int)top - 1;
+                status = EXIT_FAILURE;
+                direct_close(levels, &top, top - 1, base_fd);
+            }
+        }
+
+        if(tok.type == T_INDENT){
+            level++;
+            continue;
+        }
+        if(tok.type == T_DEDENT){
+            if(level > 0)
+                level--;
+            continue;
+        }
+        if((tok.type != T_NAME && tok.type != T_INCLUDE) || tok.length == 0)
+            continue;
+        if(skip_level >= 0 && (int)level > skip_level)
+            continue;
+        skip_level = -1;
+
+        // Everything at this depth or deeper is done
+        if(direct_close(levels, &top, level, base_fd) != 0)
+            status = EXIT_FAILURE;
+        if(level > top){
+            skip_level = (int)level;        /* The parent was dropped */
+            continue;
+        }
+
+        if(tok.type == T_INCLUDE){
+            skip_level = (int)level;        /* Nothing can be nested under an include */
+            int parent_fd = (level > 0) ? direct_parent_fd(levels, level, base_fd) : -1;
+            if(parent_fd < 0){
+                fprintf(stderr, "warning (direct build): \"@include %s\" must be placed inside a directory, ignored.\n", tok.lexeme);
+                continue;
+            }
+            char *included = parser_resolve_include(path, tok.lexeme);
+            if(!included || direct_stream(included, parent_fd, &link, dedup) != 0)
+                status = EXIT_FAILURE;
+            free(included);
+            continue;
+        }
+
+        // Take the name over from the token
+        char *name = tok.lexeme;
+        tok.lexeme = NULL;
+        bool is_dir = (level == 0 || name[tok.length - 1] == '/');   /* The root is always a directory */
+        if(name[tok.length - 1] == '/')
+            name[tok.length - 1] = '\0';
+
+        if(filter && level > 0){
+            // Pruned subtrees are skipped token by token, nothing is opened nor created for them
+            bool selected = (select_level >= 0 && (int)level > select_level);
+            if(!selected)
+                select_level = -1;
+            FilterVerdict verdict = direct_filter(filter, levels, level, name, is_dir, selected, &rel, &rel_cap);
+            if(verdict == FILTER_SKIP){
+                skip_level = (int)level;
+                free(name);
+                continue;
+            }
+            if(verdict == FILTER_SELECT && !selected)
+                select_level = (int)level;
+        }
+
+        if(level == 0){
+            // A template has a single root
+            if(root && strcmp(root, name) != 0){
+                fprintf(stderr, "warning (direct build): \"%s\" is outside the root \"%s\", entry ignored.\n", name, root);
+                skip_level = 0;
+                free(name);
+                continue;
+            }
+            if(!root && !(root = strdup(name))){
+                fprintf(stderr, "fatal (direct build): memory allocation failed for \"%s\".\n", name);
+                free(name);
+                status = EXIT_FAILURE;
+                break;
+            }
+        }
+
+        int parent_fd = direct_parent_fd(levels, level, base_fd);
+        if(parent_fd < 0){
+            fprintf(stderr, "error (direct build): cannot create \"%s\" inside \"%s\".\n", name, levels[level - 1].name);
+            skip_level = (int)level;
+            status = EXIT_FAILURE;
+            free(name);
+            continue;
+        }
+
+        // Only the current path is known: the entry on disk stands for earlier declarations
+        struct stat st;
+        if(fstatat(parent_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) != is_dir){
+            fprintf(stderr, "warning (direct build): \"%s\" is declared both as a file and a directory, keeping the first one.\n", name);
+            skip_level = (int)level;
+            free(name);
+            continue;
+        }
+
+        // Remember the entry, it is created with its attributes and children are created in it
+        if(top == cap){
+            size_t new_cap = cap ? cap * 2 : 16;
+            DirectLevel *tmp = realloc(levels, new_cap * sizeof(DirectLevel));
+            if(!tmp){
+                fprintf(stderr, "fatal (direct build): failed to grow the level stack.\n");
+                free(name);
+                status = EXIT_FAILURE;
+                break;
+            }
+            levels = tmp;
+            cap = new_cap;
+        }
+        levels[top] = (DirectLevel){ name, is_dir, -1, ENTRY_ATTRS_DEFAULT, false, TREE_LINK_NONE, NULL };
+        if(level > 0 && levels[level - 1].has_attrs){
+            levels[top].attrs = levels[level - 1].attrs;
+            levels[top].has_attrs = true;
+        }
+        top++;
+        pending = true;
+    }
 
-    // Build recursivelly all directories
-    for(size_t i = 0; i < root->child_count; i++)
-        if(root->children[i] && root->children[i]->is_directory)
-            build_directory_recursive(root->children[i], dest_dir);
+    if(pending && direct_create(levels, top, base_fd, dedup) != 0){
+        levels[top - 1].has_attrs = false;
+        status = EXIT_FAILURE;
+    }
+
+    for(size_t e = 0; e < lexer_error_count(&L); e++)
+        lex_error_print(&lexer_errors(&L)[e], path);
+
+    if(direct_close(levels, &top, 0, base_fd) != 0)
+        status = EXIT_FAILURE;
+    free(levels);
+    free(rel);
+    free(root);
+    free(key);
+    lexer_free(&L);
+    if(!use_stdin)
+        fclose(fp);
+    return status;
+}
+#endif
 
-    // Build recursivelly all files
-    for(size_t i = 0; i < root->child_count; i++)
-        if(root->children[i])
-            build_file_recursive(root->children[i], dest_dir);
-        
-    return EXIT_SUCCESS;    /* Exit successfully */
+int build_direct(const char *path, const char *dest_dir){
+    #ifndef _WIN32
+        // Hold the destination directory, every creation is relative to it
+        int dest_fd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(dest_fd < 0){
+            fprintf(stderr, "fatal (direct build): cannot open destination \"%s\".\n", dest_dir);
+            return EXIT_FAILURE;
+        }
+        BuildDedup dedup = { .count = 0 };
+        uint64_t span = trace_begin();
+        int status = direct_stream(path, dest_fd, NULL, dedup_files ? &dedup : NULL);
+        trace_end(span, "direct build", path);
+        dedup_free(&dedup);
+        close(dest_fd);
+        return status;
+    #else
+        // No descriptor-relative calls: parse then build
+        Tree tree = parse_tokens(path);
+        if(is_empty_tree(tree))
+            return EXIT_FAILURE;
+        int status = build_tree(tree, dest_dir);
+        clean_tree(&tree);
+        return status;
+    #endif
 }
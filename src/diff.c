@@ -0,0 +1,412 @@
+#include "diff.h"
+
+/* Destination directory, opened on first use */
+typedef struct DiffDir {
+    struct DiffDir *up;             // Parent directory, NULL for the destination
+    const char *name;               // Name in the parent
+    int fd;                         // Descriptor, -1 until needed
+    bool missing;                   // Removal only: the directory is already gone
+} DiffDir;
+
+typedef struct DiffCtx {
+    FILE *out;                      // Change listing, NULL for none
+    bool apply;                     // Apply the delta to the destination
+    bool keep_removed;              // List removed entries without deleting them
+    char *path;                     // Relative path of the current entry
+    size_t path_len;                // Length of path
+    size_t path_cap;                // Capacity of path
+    DiffStats *stats;               // Counters
+    int status;                     // First failure
+} DiffCtx;
+
+// Append a component to the current path, returns the length to restore
+static size_t path_push(DiffCtx *ctx, const char *name){
+    size_t saved = ctx->path_len;
+    size_t n = strlen(name);
+    size_t need = ctx->path_len + n + 2;
+
+    if(need > ctx->path_cap){
+        size_t cap = ctx->path_cap ? ctx->path_cap : 256;
+        while(cap < need)
+            cap *= 2;
+        char *tmp = realloc(ctx->path, cap);
+        if(!tmp){
+            fprintf(stderr, "fatal (diff): memory allocation failed for \"%s\".\n", name);
+            exit(EXIT_FAILURE);
+        }
+        ctx->path = tmp;
+        ctx->path_cap = cap;
+    }
+
+    if(ctx->path_len > 0)
+        ctx->path[ctx->path_len++] = PATH_SEPARATOR;
+    memcpy(ctx->path + ctx->path_len, name, n + 1);
+    ctx->path_len += n;
+    return saved;
+}
+
+static void path_pop(DiffCtx *ctx, size_t saved){
+    ctx->path_len = saved;
+    ctx->path[saved] = '\0';
+}
+
+static void diff_print(DiffCtx *ctx, char mark, bool is_dir){
+    if(ctx->out)
+        fprintf(ctx->out, "%c %s%s\n", mark, ctx->path, is_dir ? "/" : "");
+}
+
+#ifndef _WIN32
+static int diff_dir_fd(DiffDir *dir){
+    if(dir->fd < 0 && dir->up){
+        int parent = diff_dir_fd(dir->up);
+        if(parent >= 0)
+            dir->fd = open_folder_at(parent, dir->name);
+        if(parent >= 0 && dir->fd < 0)
+            fprintf(stderr, "error (diff): cannot open directory \"%s\".\n", dir->name);
+    }
+    return dir->fd;
+}
+#endif
+
+static void diff_dir_close(DiffDir *dir){
+    #ifndef _WIN32
+        if(dir->fd >= 0)
+            close(dir->fd);
+    #endif
+    dir->fd = -1;
+}
+
+/* One-sided subtree walk: everything added or everything removed */
+typedef struct DiffWalk {
+    DiffCtx *ctx;                   // Diff state
+    DiffDir *here;                  // Directory holding the walk root
+    bool root_is_dir;               // Type of the walk root (top-level entries are directories)
+    bool print_root;                // List the walk root (retyped entries are listed as ~ instead)
+} DiffWalk;
+
+// Visit one node: push its path, list it, return its type and the directory holding it
+static bool diff_walk_enter(DiffWalk *walk, TreeFrame *frame, TreeFrame *parent, char mark, DiffDir **here){
+    DiffCtx *ctx = walk->ctx;
+    bool is_dir = parent ? frame->node->is_directory : walk->root_is_dir;
+    *here = parent ? parent->data : walk->here;
+
+    frame->mark = path_push(ctx, frame->node->name);
+    if(parent || walk->print_root){
+        diff_print(ctx, mark, is_dir);
+        if(mark == '+')
+            ctx->stats->added++;
+        else
+            ctx->stats->removed++;
+    }
+    return is_dir;
+}
+
+static DiffDir *diff_dir_new(DiffCtx *ctx, DiffDir *up, const char *name){
+    DiffDir *dir = malloc(sizeof(DiffDir));
+    if(!dir){
+        fprintf(stderr, "fatal (diff): memory allocation failed for \"%s\".\n", ctx->path);
+        ctx->status = EXIT_FAILURE;
+        return NULL;
+    }
+    *dir = (DiffDir){ up, name, -1, up->missing };
+    return dir;
+}
+
+// Entry only in the new template: create it, then its contents
+static TreeWalkAction add_pre(TreeFrame *frame, TreeFrame *parent, void *arg){
+    DiffWalk *walk = arg;
+    DiffCtx *ctx = walk->ctx;
+    DiffDir *here;
+    bool is_dir = diff_walk_enter(walk, frame, parent, '+', &here);
+
+    #ifndef _WIN32
+        if(ctx->apply){
+            int fd = diff_dir_fd(here);
+            const EntryAttrs *attrs = tree_attrs(frame->node->attrs);
+            Tree node = frame->node;
+            int created = EXIT_FAILURE;
+            if(fd >= 0){
+                if(is_dir)
+                    created = create_folder_attrs_at(fd, node->name, attrs);
+                else if(node->link == TREE_LINK_SYMBOLIC)
+                    created = create_symlink_at(fd, node->name, node->target);
+                else if(node->link == TREE_LINK_HARD){
+                    // Like the builder, the target is a file of the template reached without following a link,
+                    // created first if it is added after the link: its own visit finds it there
+                    if(!tree_link_resolve(node))
+                        fprintf(stderr, "error (diff): \"%s\" links to \"%s\", which is not a file of the template.\n", node->name, node->target);
+                    else if(link_file_beneath(fd, node->target, node->name, true) == 0)
+                        created = EXIT_SUCCESS;
+                    else
+                        fprintf(stderr, "error (diff): cannot link \"%s\" to \"%s\".\n", node->name, node->target);
+                }
+                else
+                    created = create_file_attrs_at(fd, node->name, attrs);
+            }
+            if(created != EXIT_SUCCESS)
+                ctx->status = EXIT_FAILURE;
+        }
+    #endif
+
+    // Entries under a file can never be created
+    frame->data = is_dir ? diff_dir_new(ctx, here, frame->node->name) : NULL;
+    if(!frame->data){
+        path_pop(ctx, frame->mark);
+        return TREE_WALK_SKIP;
+    }
+    return TREE_WALK_CONTINUE;
+}
+
+static TreeWalkAction add_post(TreeFrame *frame, TreeFrame *parent, void *arg){
+    (void)parent;
+    DiffWalk *walk = arg;
+    #ifndef _WIN32
+        // The directory is complete: its attributes go last, on the descriptor if its children opened it
+        DiffDir *dir = frame->data;
+        if(walk->ctx->apply && frame->node->attrs != 0 && (dir->fd >= 0 || diff_dir_fd(dir->up) >= 0)){
+            const EntryAttrs *attrs = tree_attrs(frame->node->attrs);
+            if((dir->fd >= 0 ? apply_folder_attrs(dir->fd, dir->name, attrs) : apply_attrs_at(dir->up->fd, dir->name, true, attrs)) != 0)
+                walk->ctx->status = EXIT_FAILURE;
+        }
+    #endif
+    diff_dir_close(frame->data);
+    free(frame->data);
+    path_pop(walk->ctx, frame->mark);
+    return TREE_WALK_CONTINUE;
+}
+
+// Unlink one entry of here, unless removal is disabled or here is already gone
+static void diff_unlink(DiffCtx *ctx, DiffDir *here, const Tree node, bool is_dir){
+    #ifndef _WIN32
+        if(ctx->apply && !ctx->keep_removed && !here->missing){
+            int fd = diff_dir_fd(here);
+            if(fd < 0 || (is_dir ? remove_folder_at(fd, node->name) : remove_file_at(fd, node->name)) != 0)
+                ctx->status = EXIT_FAILURE;
+        }
+    #else
+        (void)ctx; (void)here; (void)node; (void)is_dir;
+    #endif
+}
+
+// Unlink a file that is recreated as another kind of file (link or not), even when removals are kept
+static void diff_replace(DiffCtx *ctx, DiffDir *here, const Tree node){
+    #ifndef _WIN32
+        if(ctx->apply && !here->missing){
+            int fd = diff_dir_fd(here);
+            if(fd < 0 || remove_file_at(fd, node->name) != 0)
+                ctx->status = EXIT_FAILURE;
+        }
+    #else
+        (void)ctx; (void)here; (void)node;
+    #endif
+}
+
+// Entry only in the old template: remove its contents, then the entry
+static TreeWalkAction remove_pre(TreeFrame *frame, TreeFrame *parent, void *arg){
+    DiffWalk *walk = arg;
+    DiffCtx *ctx = walk->ctx;
+    DiffDir *here;
+    bool is_dir = diff_walk_enter(walk, frame, parent, '-', &here);
+
+    if(!is_dir){
+        diff_unlink(ctx, here, frame->node, false);
+        path_pop(ctx, frame->mark);
+        return TREE_WALK_SKIP;
+    }
+
+    DiffDir *child = diff_dir_new(ctx, here, frame->node->name);
+    if(!child){
+        path_pop(ctx, frame->mark);
+        return TREE_WALK_SKIP;
+    }
+    #ifndef _WIN32
+        // A directory that is already gone has nothing left to remove
+        int fd = (ctx->apply && !ctx->keep_removed && !here->missing) ? diff_dir_fd(here) : -1;
+        if(fd >= 0){
+            child->fd = open_folder_at(fd, frame->node->name);
+            child->missing = (child->fd < 0 && errno == ENOENT);
+            if(child->fd < 0 && !child->missing){
+                fprintf(stderr, "error (diff): cannot open directory \"%s\".\n", ctx->path);
+                ctx->status = EXIT_FAILURE;
+                child->missing = true;
+            }
+        }
+    #endif
+    frame->data = child;
+    return TREE_WALK_CONTINUE;
+}
+
+static TreeWalkAction remove_post(TreeFrame *frame, TreeFrame *parent, void *arg){
+    DiffWalk *walk = arg;
+    DiffDir *child = frame->data;
+    diff_dir_close(child);
+    diff_unlink(walk->ctx, child->up, frame->node, true);
+    free(child);
+    path_pop(walk->ctx, frame->mark);
+    (void)parent;
+    return TREE_WALK_CONTINUE;
+}
+
+static void diff_add(DiffCtx *ctx, const Tree node, bool is_dir, DiffDir *here, bool print_self){
+    DiffWalk walk = { ctx, here, is_dir, print_self };
+    TreeVisitor visitor = { add_pre, add_post, &walk };
+    if(tree_walk(node, &visitor) != 0)
+        ctx->status = EXIT_FAILURE;
+}
+
+static void diff_remove(DiffCtx *ctx, const Tree node, bool is_dir, DiffDir *here, bool print_self){
+    DiffWalk walk = { ctx, here, is_dir, print_self };
+    TreeVisitor visitor = { remove_pre, remove_post, &walk };
+    if(tree_walk(node, &visitor) != 0)
+        ctx->status = EXIT_FAILURE;
+}
+
+static int by_name(const void *a, const void *b){
+    return strcmp((*(const Tree *)a)->name, (*(const Tree *)b)->name);
+}
+
+// Copy of a child list without holes, sorted by name
+static Tree *sorted_children(Tree *children, size_t n, size_t *count){
+    Tree *sorted = malloc((n ? n : 1) * sizeof(Tree));
+    if(!sorted)
+        return NULL;
+
+    size_t k = 0;
+    for(size_t i = 0; i < n; i++)
+        if(children[i])
+            sorted[k++] = children[i];
+    qsort(sorted, k, sizeof(Tree), by_name);
+    *count = k;
+    return sorted;
+}
+
+// Entry kept with other attributes: list it, and set the new ones (the defaults again when it has none)
+// Owner and time left out of the new set stay as they are, there is nothing to restore them to
+static void diff_attrs(DiffCtx *ctx, DiffDir *here, const Tree node, bool is_dir){
+    size_t saved = path_push(ctx, node->name);
+    diff_print(ctx, '*', is_dir);
+    ctx->stats->changed++;
+    path_pop(ctx, saved);
+
+    #ifndef _WIN32
+        if(ctx->apply && !here->missing){
+            EntryAttrs defaults = ENTRY_ATTRS_DEFAULT;
+            const EntryAttrs *attrs = node->attrs ? tree_attrs(node->attrs) : &defaults;
+            EntryAttrs set = *attrs;
+            if(set.dir_mode < 0)
+                set.dir_mode = 0755;
+            if(set.file_mode < 0)
+                set.file_mode = 0644;
+            int fd = diff_dir_fd(here);
+            if(fd < 0 || apply_attrs_at(fd, node->name, is_dir, &set) != 0)
+                ctx->status = EXIT_FAILURE;
+        }
+    #else
+        (void)here;
+    #endif
+}
+
+// Check if two files of the same name differ by their link kind or link target
+static bool link_changed(const Tree a, const Tree b){
+    if(a->link != b->link)
+        return true;
+    return a->link != TREE_LINK_NONE && strcmp(a->target, b->target) != 0;
+}
+
+// Merge two child lists of the same directory; top-level entries are always directories
+static void diff_lists(DiffCtx *ctx, Tree *old_list, size_t n_old, Tree *new_list, size_t n_new, DiffDir *here, bool top){
+    size_t na = 0, nb = 0;
+    Tree *a = sorted_children(old_list, n_old, &na);
+    Tree *b = sorted_children(new_list, n_new, &nb);
+    if(!a || !b){
+        fprintf(stderr, "fatal (diff): failed to sort the entries of \"%s\".\n", ctx->path ? ctx->path : "");
+        ctx->status = EXIT_FAILURE;
+        free(a);
+        free(b);
+        return;
+    }
+
+    size_t i = 0, j = 0;
+    while(i < na || j < nb){
+        int cmp = (i == na) ? 1 : (j == nb) ? -1 : strcmp(a[i]->name, b[j]->name);
+        if(cmp < 0){
+            diff_remove(ctx, a[i], top || a[i]->is_directory, here, true);
+            i++;
+            continue;
+        }
+        if(cmp > 0){
+            diff_add(ctx, b[j], top || b[j]->is_directory, here, true);
+            j++;
+            continue;
+        }
+
+        bool old_dir = top || a[i]->is_directory;
+        bool new_dir = top || b[j]->is_directory;
+        if(old_dir != new_dir || (!old_dir && link_changed(a[i], b[j]))){
+            // Retyped: the old entry goes, the new one is created in its place
+            size_t saved = path_push(ctx, b[j]->name);
+            diff_print(ctx, '~', new_dir);
+            ctx->stats->retyped++;
+            path_pop(ctx, saved);
+            if(old_dir != new_dir)
+                diff_remove(ctx, a[i], old_dir, here, false);
+            else
+                diff_replace(ctx, here, a[i]);
+            diff_add(ctx, b[j], new_dir, here, false);
+        } else if(a[i] != b[j]){
+            // Same entry in both: its contents can differ (a shared include is identical), then its attributes
+            if(old_dir){
+                size_t saved = path_push(ctx, a[i]->name);
+                DiffDir child = { here, a[i]->name, -1, false };
+                diff_lists(ctx, a[i]->children, a[i]->child_count, b[j]->children, b[j]->child_count, &child, false);
+                diff_dir_close(&child);
+                path_pop(ctx, saved);
+            }
+            // Links take no attributes of their own: setting them would reach the target
+            if(a[i]->attrs != b[j]->attrs && b[j]->link == TREE_LINK_NONE)
+                diff_attrs(ctx, here, b[j], old_dir);
+        }
+        i++;
+        j++;
+    }
+
+    free(a);
+    free(b);
+}
+
+int diff_trees_at(const Tree old_root, const Tree new_root, int dest_fd, bool keep_removed, FILE *out, DiffStats *stats){
+    DiffStats local;
+    if(!stats)
+        stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    DiffCtx ctx = { .out = out, .apply = (dest_fd >= 0), .keep_removed = keep_removed, .stats = stats, .status = EXIT_SUCCESS };
+    DiffDir dest = { NULL, ".", dest_fd, false };
+
+    // A missing old tree diffs as empty: everything in the new one is added
+    Tree old_list[1] = { old_root };
+    Tree new_list[1] = { new_root };
+    diff_lists(&ctx, old_list, 1, new_list, 1, &dest, true);
+
+    free(ctx.path);
+    return ctx.status;
+}
+
+int diff_trees(const Tree old_root, const Tree new_root, const char *dest_dir, FILE *out, DiffStats *stats){
+    if(!dest_dir)
+        return diff_trees_at(old_root, new_root, -1, false, out, stats);
+
+    #ifndef _WIN32
+        int fd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(fd < 0){
+            fprintf(stderr, "fatal (diff): cannot open destination \"%s\".\n", dest_dir);
+            return EXIT_FAILURE;
+        }
+        int status = diff_trees_at(old_root, new_root, fd, false, out, stats);
+        close(fd);
+        return status;
+    #else
+        fprintf(stderr, "fatal (diff): applying a delta is not supported on this platform.\n");
+        return EXIT_FAILURE;
+    #endif
+}
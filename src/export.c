@@ -0,0 +1,212 @@
+#include "export.h"
+
+static const char *format_names[] = { "text", "json", "paths0" };
+
+int export_format_parse(const char *name, ExportFormat *format){
+    for(size_t i = 0; i < sizeof(format_names) / sizeof(format_names[0]); i++){
+        if(strcmp(name, format_names[i]) == 0){
+            *format = (ExportFormat)i;
+            return EXIT_SUCCESS;
+        }
+    }
+    return EXIT_FAILURE;
+}
+
+// Hand the buffered bytes to the kernel
+static void ex_flush(Exporter *ex){
+    size_t done = 0;
+    while(done < ex->len && ex->status == EXIT_SUCCESS){
+        ssize_t n = write(ex->fd, ex->buf + done, ex->len - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0){
+            fprintf(stderr, "error (export): write failed.\n");
+            ex->status = EXIT_FAILURE;
+            break;
+        }
+        done += (size_t)n;
+    }
+    ex->len = 0;
+}
+
+static void ex_put(Exporter *ex, const char *s, size_t n){
+    if(n > EXPORT_BUFFER - ex->len){
+        ex_flush(ex);
+        // Longer than the whole buffer: pass it through in buffer-sized pieces
+        while(n > EXPORT_BUFFER){
+            memcpy(ex->buf, s, EXPORT_BUFFER);
+            ex->len = EXPORT_BUFFER;
+            ex_flush(ex);
+            s += EXPORT_BUFFER;
+            n -= EXPORT_BUFFER;
+        }
+    }
+    memcpy(ex->buf + ex->len, s, n);
+    ex->len += n;
+}
+
+static void ex_putc(Exporter *ex, char c){
+    if(ex->len == EXPORT_BUFFER)
+        ex_flush(ex);
+    ex->buf[ex->len++] = c;
+}
+
+// JSON string contents, escaped
+static void ex_put_json(Exporter *ex, const char *s, size_t n){
+    size_t run = 0;
+    for(size_t i = 0; i < n; i++){
+        unsigned char c = (unsigned char)s[i];
+        if(c != '"' && c != '\\' && c >= 0x20)
+            continue;
+
+        ex_put(ex, s + run, i - run);
+        char esc[8];
+        int m = (c == '"' || c == '\\') ? snprintf(esc, sizeof(esc), "\\%c", c) : snprintf(esc, sizeof(esc), "\\u%04x", c);
+        ex_put(ex, esc, (size_t)m);
+        run = i + 1;
+    }
+    ex_put(ex, s + run, n - run);
+}
+
+// Append a component to the current path, the buffer is reused for every node
+static int path_push(Exporter *ex, const char *name, size_t *saved){
+    size_t n = strlen(name);
+    size_t need = ex->path_len + n + 2;
+    *saved = ex->path_len;
+
+    if(need > ex->path_cap){
+        size_t cap = ex->path_cap ? ex->path_cap : 256;
+        while(cap < need)
+            cap *= 2;
+        char *tmp = realloc(ex->path, cap);
+        if(!tmp){
+            fprintf(stderr, "fatal (export): memory allocation failed for \"%s\".\n", name);
+            return EXIT_FAILURE;
+        }
+        ex->path = tmp;
+        ex->path_cap = cap;
+    }
+
+    if(ex->path_len > 0)
+        ex->path[ex->path_len++] = PATH_SEPARATOR;
+    memcpy(ex->path + ex->path_len, name, n + 1);
+    ex->path_len += n;
+    return EXIT_SUCCESS;
+}
+
+/* State of one export walk */
+typedef struct ExportWalk {
+    Exporter *ex;                   // Output
+    ExportFormat format;            // Output format
+    int level;                      // Indentation of the root in text mode
+    bool need_comma;                // JSON: a sibling was written before the next node
+} ExportWalk;
+
+static TreeWalkAction export_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    (void)parent;
+    ExportWalk *walk = ctx;
+    Exporter *ex = walk->ex;
+    Tree node = frame->node;
+
+    size_t saved;
+    if(ex->status != EXIT_SUCCESS || path_push(ex, node->name, &saved) != 0){
+        ex->status = EXIT_FAILURE;
+        return TREE_WALK_STOP;
+    }
+    frame->mark = saved;
+
+    switch(walk->format){
+        case EXPORT_TEXT:
+            for(size_t i = 0; i < frame->depth + (size_t)walk->level; i++)
+                ex_put(ex, "    ", 4);
+            ex_put(ex, ex->path, ex->path_len);
+            if(node->is_directory)
+                ex_putc(ex, '/');
+            if(node->link != TREE_LINK_NONE){
+                ex_put(ex, node->link == TREE_LINK_SYMBOLIC ? " -> " : " => ", 4);
+                ex_put(ex, node->target, strlen(node->target));
+            }
+            ex_putc(ex, '\n');
+            break;
+
+        case EXPORT_PATHS0:
+            ex_put(ex, ex->path, ex->path_len);
+            ex_putc(ex, '\0');
+            break;
+
+        case EXPORT_JSON:
+            if(walk->need_comma)
+                ex_putc(ex, ',');
+            ex_put(ex, "{\"name\":\"", 9);
+            ex_put_json(ex, node->name, strlen(node->name));
+            ex_put(ex, "\",\"path\":\"", 10);
+            ex_put_json(ex, ex->path, ex->path_len);
+            if(node->is_directory)
+                ex_put(ex, "\",\"type\":\"directory\"", 20);
+            else if(node->link != TREE_LINK_NONE){
+                if(node->link == TREE_LINK_SYMBOLIC)
+                    ex_put(ex, "\",\"type\":\"symlink\",\"target\":\"", 29);
+                else
+                    ex_put(ex, "\",\"type\":\"hardlink\",\"target\":\"", 30);
+                ex_put_json(ex, node->target, strlen(node->target));
+                ex_putc(ex, '"');
+            }
+            else
+                ex_put(ex, "\",\"type\":\"file\"", 15);
+            // Files never have children in a valid template, list them anyway if the tree has some
+            if(node->is_directory || node->child_count > 0)
+                ex_put(ex, ",\"children\":[", 13);
+            walk->need_comma = false;
+            break;
+    }
+    return TREE_WALK_CONTINUE;
+}
+
+static TreeWalkAction export_post(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    (void)parent;
+    ExportWalk *walk = ctx;
+    Exporter *ex = walk->ex;
+    Tree node = frame->node;
+
+    if(walk->format == EXPORT_JSON){
+        bool has_children = node->is_directory || node->child_count > 0;
+        ex_put(ex, has_children ? "]}" : "}", has_children ? 2 : 1);
+        walk->need_comma = true;
+    }
+
+    ex->path_len = frame->mark;
+    ex->path[frame->mark] = '\0';
+    return ex->status == EXIT_SUCCESS ? TREE_WALK_CONTINUE : TREE_WALK_STOP;
+}
+
+static int export_run(const Tree root, ExportFormat format, int level, int fd){
+    if(is_empty_tree(root)){
+        fprintf(stderr, "fatal (export): tree is empty, nothing to export.\n");
+        return EXIT_FAILURE;
+    }
+
+    Exporter ex = { .fd = fd, .buf = malloc(EXPORT_BUFFER), .status = EXIT_SUCCESS };
+    if(!ex.buf){
+        fprintf(stderr, "fatal (export): failed to allocate the output buffer.\n");
+        return EXIT_FAILURE;
+    }
+
+    ExportWalk walk = { &ex, format, level, false };
+    TreeVisitor visitor = { export_pre, export_post, &walk };
+    tree_walk(root, &visitor);
+    if(format == EXPORT_JSON)
+        ex_putc(&ex, '\n');
+    ex_flush(&ex);
+
+    free(ex.buf);
+    free(ex.path);
+    return ex.status;
+}
+
+int export_tree(const Tree root, ExportFormat format, int fd){
+    return export_run(root, format, 0, fd);
+}
+
+int export_text(const Tree root, int level, int fd){
+    return export_run(root, EXPORT_TEXT, level, fd);
+}
@@ -0,0 +1,145 @@
+#include "filter.h"
+
+static bool is_sep(char c){
+    return c == '/' || c == PATH_SEPARATOR;
+}
+
+int filter_add(PathFilter *filter, const char *pattern, bool exclude){
+    FilterPattern p = { strdup(pattern), NULL, 0 };
+    if(!p.text){
+        fprintf(stderr, "fatal (filter): memory allocation failed for \"%s\".\n", pattern);
+        return EXIT_FAILURE;
+    }
+
+    // Split in place, dropping empty and "." names
+    size_t len = strlen(p.text);
+    p.parts = malloc((len / 2 + 1) * sizeof(char *));
+    if(!p.parts){
+        fprintf(stderr, "fatal (filter): memory allocation failed for \"%s\".\n", pattern);
+        free(p.text);
+        return EXIT_FAILURE;
+    }
+    for(char *s = p.text; *s; ){
+        while(is_sep(*s))
+            *s++ = '\0';
+        if(!*s)
+            break;
+        char *name = s;
+        while(*s && !is_sep(*s))
+            s++;
+        bool dot = (s - name == 1 && name[0] == '.');
+        if(!dot)
+            p.parts[p.count++] = name;
+    }
+
+    if(p.count == 0){
+        fprintf(stderr, "fatal (filter): empty pattern \"%s\".\n", pattern);
+        free(p.parts);
+        free(p.text);
+        return EXIT_FAILURE;
+    }
+
+    FilterPattern **list = exclude ? &filter->exclude : &filter->only;
+    size_t *count = exclude ? &filter->exclude_count : &filter->only_count;
+    FilterPattern *tmp = realloc(*list, (*count + 1) * sizeof(FilterPattern));
+    if(!tmp){
+        fprintf(stderr, "fatal (filter): memory allocation failed for \"%s\".\n", pattern);
+        free(p.parts);
+        free(p.text);
+        return EXIT_FAILURE;
+    }
+    tmp[(*count)++] = p;
+    *list = tmp;
+    return EXIT_SUCCESS;
+}
+
+bool filter_active(const PathFilter *filter){
+    return filter && (filter->only_count > 0 || filter->exclude_count > 0);
+}
+
+// Glob over one name: "*" is any run of characters, "?" any one character
+static bool name_match(const char *pat, const char *name, size_t len){
+    const char *star = NULL;
+    size_t i = 0, resume = 0;
+    while(i < len){
+        if(*pat == '*'){
+            star = ++pat;
+            resume = i;
+        } else if(*pat && (*pat == '?' || *pat == name[i])){
+            pat++;
+            i++;
+        } else if(star){
+            pat = star;
+            i = ++resume;
+        } else
+            return false;
+    }
+    while(*pat == '*')
+        pat++;
+    return *pat == '\0';
+}
+
+// Match the pattern parts from index i against the path names from p
+static FilterMatch parts_match(const FilterPattern *pattern, size_t i, const char *p){
+    while(is_sep(*p))
+        p++;
+
+    if(*p == '\0'){
+        // Path exhausted: a full match if only "**" is left, else more names could match
+        while(i < pattern->count && strcmp(pattern->parts[i], "**") == 0)
+            i++;
+        return i == pattern->count ? FILTER_FULL : FILTER_PREFIX;
+    }
+    if(i == pattern->count)
+        return FILTER_NONE;
+
+    size_t len = 0;
+    while(p[len] && !is_sep(p[len]))
+        len++;
+
+    if(strcmp(pattern->parts[i], "**") == 0){
+        // Match no name, or swallow this one and stay on "**"
+        FilterMatch skip = parts_match(pattern, i + 1, p);
+        if(skip == FILTER_FULL)
+            return FILTER_FULL;
+        FilterMatch eat = parts_match(pattern, i, p + len);
+        return eat > skip ? eat : skip;
+    }
+
+    return name_match(pattern->parts[i], p, len) ? parts_match(pattern, i + 1, p + len) : FILTER_NONE;
+}
+
+FilterVerdict filter_check(const PathFilter *filter, const char *path, bool is_dir, bool selected){
+    for(size_t i = 0; i < filter->exclude_count; i++)
+        if(parts_match(&filter->exclude[i], 0, path) == FILTER_FULL)
+            return FILTER_SKIP;
+
+    if(selected || filter->only_count == 0)
+        return FILTER_SELECT;
+
+    FilterMatch best = FILTER_NONE;
+    for(size_t i = 0; i < filter->only_count && best != FILTER_FULL; i++){
+        FilterMatch m = parts_match(&filter->only[i], 0, path);
+        if(m > best)
+            best = m;
+    }
+
+    if(best == FILTER_FULL)
+        return FILTER_SELECT;
+    // Only a directory can lead to a match below it
+    return (best == FILTER_PREFIX && is_dir) ? FILTER_KEEP : FILTER_SKIP;
+}
+
+void filter_free(PathFilter *filter){
+    for(size_t i = 0; i < filter->only_count; i++){
+        free(filter->only[i].parts);
+        free(filter->only[i].text);
+    }
+    for(size_t i = 0; i < filter->exclude_count; i++){
+        free(filter->exclude[i].parts);
+        free(filter->exclude[i].text);
+    }
+    free(filter->only);
+    free(filter->exclude);
+    memset(filter, 0, sizeof(*filter));
+}
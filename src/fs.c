@@ -1,19 +1,47 @@
 #include "fs.h"
 
+#ifndef _WIN32
+// Metadata operation in progress: paced by the throttle, timed for the trace
+typedef struct FsOp {
+    uint64_t throttle;      // Start given by throttle_begin
+    uint64_t trace;         // Start given by trace_begin
+} FsOp;
+
+static FsOp fs_op_begin(void){
+    FsOp op = { throttle_begin(), 0 };
+    op.trace = trace_begin();       /* After the throttle wait: only the call is timed */
+    return op;
+}
+
+// End the operation, recording call as a slow syscall if it was one; errno is kept
+static void fs_op_end(FsOp op, const char *call, const char *name){
+    trace_slow(op.trace, call, name);
+    throttle_end(op.throttle);
+}
+#endif
+
 int create_folder(const char *path){
     #ifdef _WIN32   /* Create the directory depending on the os */
         // Create a directory for windows operaring system and manage errors
-        if(_mkdir(path) == 0 || errno == EEXIST)
+        if(_mkdir(path) == 0 || errno == EEXIST){
+            progress_entry(true);
             return EXIT_SUCCESS;
-        else{
+        } else{
+            progress_entry(false);
             fprintf(stderr, "error : failed to create directory \"%s\".\n", path);
             return EXIT_FAILURE;
         }
     #else
         // Create a directory for unix operaring systems and manage errors
-        if(mkdir(path, 0755) == 0 || errno == EEXIST)
+        TRACE_PROBE1(create_folder, path);
+        FsOp op = fs_op_begin();
+        int rc = mkdir(path, 0755);
+        fs_op_end(op, "mkdir", path);
+        if(rc == 0 || errno == EEXIST){
+            progress_entry(true);
             return EXIT_SUCCESS;
-        else{
+        } else{
+            progress_entry(false);
             fprintf(stderr, "error : failed to create file \"%s\".\n", path);
             return EXIT_FAILURE;
         }
@@ -25,21 +53,300 @@ int create_file(const char *path){
         // Create a file for windows operaring system and manage errors
         FILE *f = fopen(path, "w");
         if(f == NULL){
+            progress_entry(false);
             fprintf(stderr, "error : failed to create file \"%s\".\n", path);
             return EXIT_FAILURE;
         }
         // Close the created file and exit successfully
         fclose(f);
+        progress_entry(true);
         return EXIT_SUCCESS;
     #else
         // Create a file for unix operaring system and manage errors
+        TRACE_PROBE1(create_file, path);
+        FsOp op = fs_op_begin();
         int fd = open(path, O_CREAT | O_WRONLY, 0644);
         if(fd < 0){
+            fs_op_end(op, "open", path);
+            progress_entry(false);
             fprintf(stderr, "error : failed to create file \"%s\".\n", path);
             return EXIT_FAILURE;
         }
         // Close the created file and exit successfully
         close(fd);
+        fs_op_end(op, "open", path);
+        progress_entry(true);
         return EXIT_SUCCESS;
     #endif
-}
\ No newline at end of file
+}
+
+int check_capacity(const char *dest_dir, size_t directories, size_t files){
+    #ifdef _WIN32   /* Only the free space is known on windows */
+        ULARGE_INTEGER avail;
+        DWORD sectors, sector_size, free_clusters, clusters;
+        if(!GetDiskFreeSpaceExA(dest_dir, &avail, NULL, NULL) || !GetDiskFreeSpaceA(NULL, &sectors, &sector_size, &free_clusters, &clusters))
+            return EXIT_SUCCESS;
+        unsigned long long need = (unsigned long long)directories * sectors * sector_size;
+        if(need > avail.QuadPart){
+            fprintf(stderr, "fatal : \"%s\" has %llu bytes free, the build needs up to about %llu (entries already there are counted, see --no-preflight).\n", dest_dir, avail.QuadPart, need);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    #else
+        struct statvfs vfs;
+        if(statvfs(dest_dir, &vfs) != 0)
+            return EXIT_SUCCESS;    /* The build reports a missing destination itself */
+
+        int status = EXIT_SUCCESS;
+        unsigned long long inodes = (unsigned long long)directories + files;
+        if(vfs.f_files > 0 && inodes > vfs.f_favail){
+            fprintf(stderr, "fatal : \"%s\" has %llu free inodes, the build needs up to %llu (entries already there are counted, see --no-preflight).\n", dest_dir, (unsigned long long)vfs.f_favail, inodes);
+            status = EXIT_FAILURE;
+        }
+
+        unsigned long long need = (unsigned long long)directories * vfs.f_bsize;
+        unsigned long long avail = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+        if(vfs.f_blocks > 0 && need > avail){
+            fprintf(stderr, "fatal : \"%s\" has %llu bytes free, the build needs up to about %llu (entries already there are counted, see --no-preflight).\n", dest_dir, avail, need);
+            status = EXIT_FAILURE;
+        }
+        return status;
+    #endif
+}
+
+#ifndef _WIN32
+int open_folder_at(int dirfd, const char *name){
+    FsOp op = fs_op_begin();
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    fs_op_end(op, "openat", name);
+    return fd;
+}
+
+int create_folder_at(int dirfd, const char *name){
+    return create_folder_attrs_at(dirfd, name, NULL);
+}
+
+int create_file_at(int dirfd, const char *name){
+    return create_file_attrs_at(dirfd, name, NULL);
+}
+
+// Mode given at creation: directories keep owner access until apply_folder_attrs
+static mode_t creation_mode(const EntryAttrs *attrs, bool is_dir){
+    int mode = attrs ? (is_dir ? attrs->dir_mode : attrs->file_mode) : -1;
+    if(mode < 0)
+        return is_dir ? 0755 : 0644;
+    return is_dir ? ((mode_t)mode | S_IRWXU) : (mode_t)mode;
+}
+
+// Set owner, mode and time on an open entry; the owner goes first since chown clears set-id bits
+static int apply_attrs_fd(int fd, const char *name, bool is_dir, const EntryAttrs *attrs){
+    int mode = is_dir ? attrs->dir_mode : attrs->file_mode;
+    bool failed = false;
+
+    if((attrs->uid >= 0 || attrs->gid >= 0) && fchown(fd, (uid_t)attrs->uid, (gid_t)attrs->gid) != 0)
+        failed = true;
+    // The umask may have cut the creation mode, an explicit one is set exactly
+    if(mode >= 0 && fchmod(fd, (mode_t)mode) != 0)
+        failed = true;
+    if(attrs->has_mtime){
+        struct timespec times[2] = { { 0, UTIME_OMIT }, { (time_t)attrs->mtime, 0 } };
+        if(futimens(fd, times) != 0)
+            failed = true;
+    }
+
+    if(failed){
+        fprintf(stderr, "error : failed to set the attributes of \"%s\" (%s).\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int create_folder_attrs_at(int dirfd, const char *name, const EntryAttrs *attrs){
+    // Create the directory relative to dirfd and manage errors
+    TRACE_PROBE1(create_folder, name);
+    FsOp op = fs_op_begin();
+    int rc = mkdirat(dirfd, name, creation_mode(attrs, true));
+    fs_op_end(op, "mkdirat", name);
+    progress_entry(rc == 0 || errno == EEXIST);
+    if(rc == 0 || errno == EEXIST)
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "error : failed to create directory \"%s\".\n", name);
+    return EXIT_FAILURE;
+}
+
+int create_file_attrs_at(int dirfd, const char *name, const EntryAttrs *attrs){
+    // Create the file relative to dirfd and manage errors
+    TRACE_PROBE1(create_file, name);
+    FsOp op = fs_op_begin();
+    // A symbolic link planted in its place is not followed: the attributes would land outside the destination
+    int fd = openat(dirfd, name, O_CREAT | O_WRONLY | O_NOFOLLOW | O_NOCTTY | O_CLOEXEC, creation_mode(attrs, false));
+    if(fd < 0){
+        fs_op_end(op, "openat", name);
+        progress_entry(false);
+        if(errno == ELOOP)
+            fprintf(stderr, "error : failed to create file \"%s\", a symbolic link is in the way.\n", name);
+        else
+            fprintf(stderr, "error : failed to create file \"%s\".\n", name);
+        return EXIT_FAILURE;
+    }
+    // Set the attributes on the descriptor, close the file and exit
+    int status = attrs ? apply_attrs_fd(fd, name, false, attrs) : EXIT_SUCCESS;
+    close(fd);
+    fs_op_end(op, "openat", name);
+    progress_entry(status == EXIT_SUCCESS);
+    return status;
+}
+
+int apply_folder_attrs(int fd, const char *name, const EntryAttrs *attrs){
+    FsOp op = fs_op_begin();
+    int status = apply_attrs_fd(fd, name, true, attrs);
+    fs_op_end(op, "set attributes", name);
+    return status;
+}
+
+int apply_attrs_at(int dirfd, const char *name, bool is_dir, const EntryAttrs *attrs){
+    int mode = is_dir ? attrs->dir_mode : attrs->file_mode;
+    bool failed = false;
+    FsOp op = fs_op_begin();
+
+    // fchmodat follows symbolic links: refuse one planted in place of the entry
+    struct stat st;
+    if(fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0){
+        fs_op_end(op, "fstatat", name);
+        fprintf(stderr, "error : failed to set the attributes of \"%s\" (%s).\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(S_ISLNK(st.st_mode)){
+        fs_op_end(op, "fstatat", name);
+        fprintf(stderr, "error : failed to set the attributes of \"%s\", it is a symbolic link.\n", name);
+        return EXIT_FAILURE;
+    }
+
+    if((attrs->uid >= 0 || attrs->gid >= 0) && fchownat(dirfd, name, (uid_t)attrs->uid, (gid_t)attrs->gid, AT_SYMLINK_NOFOLLOW) != 0)
+        failed = true;
+    if(mode >= 0 && fchmodat(dirfd, name, (mode_t)mode, 0) != 0)
+        failed = true;
+    if(attrs->has_mtime){
+        struct timespec times[2] = { { 0, UTIME_OMIT }, { (time_t)attrs->mtime, 0 } };
+        if(utimensat(dirfd, name, times, AT_SYMLINK_NOFOLLOW) != 0)
+            failed = true;
+    }
+    fs_op_end(op, "set attributes", name);
+
+    if(failed){
+        fprintf(stderr, "error : failed to set the attributes of \"%s\" (%s).\n", name, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int create_symlink_at(int dirfd, const char *name, const char *target){
+    // Create the link relative to dirfd, an existing link is kept like an existing file
+    struct stat st;
+    FsOp op = fs_op_begin();
+    int rc = symlinkat(target, dirfd, name);
+    fs_op_end(op, "symlinkat", name);
+    bool ok = rc == 0 || (errno == EEXIST && fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode));
+    progress_entry(ok);
+    if(ok)
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "error : failed to create symbolic link \"%s\".\n", name);
+    return EXIT_FAILURE;
+}
+
+int link_file_at(int target_dirfd, const char *target, int dirfd, const char *name){
+    FsOp op = fs_op_begin();
+    int rc = linkat(target_dirfd, target, dirfd, name, 0);
+    fs_op_end(op, "linkat", name);
+    // A failure is left to the caller, which may create the target and try again
+    if(rc == 0 || errno == EEXIST){
+        progress_entry(true);
+        return 0;
+    }
+    return -1;
+}
+
+// Close fd and keep errno for the caller
+static void close_keep_errno(int fd){
+    int err = errno;
+    close(fd);
+    errno = err;
+}
+
+int link_file_beneath(int dirfd, const char *target, const char *name, bool create){
+    char path[PATH_MAX];
+    if(snprintf(path, sizeof(path), "%s", target) >= (int)sizeof(path)){
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    // Walk the directories of target from a copy of dirfd, never through a symbolic link
+    int fd = fcntl(dirfd, F_DUPFD_CLOEXEC, 0);
+    char *seg = path;
+    for(char *sep = strchr(seg, '/'); fd >= 0 && sep; seg = sep + 1, sep = strchr(seg, '/')){
+        *sep = '\0';
+        if(*seg == '\0' || strcmp(seg, ".") == 0)
+            continue;
+        int next;
+        if(strcmp(seg, "..") == 0)
+            next = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        else {
+            next = open_folder_at(fd, seg);
+            if(next < 0 && errno == ENOENT && create && create_folder_at(fd, seg) == 0)
+                next = open_folder_at(fd, seg);
+        }
+        close_keep_errno(fd);
+        fd = next;
+    }
+    if(fd < 0)
+        return -1;
+
+    // The target itself must be a regular file, a link could still lead outside
+    struct stat st;
+    int rc = fstatat(fd, seg, &st, AT_SYMLINK_NOFOLLOW);
+    if(rc != 0 && errno == ENOENT && create && create_file_at(fd, seg) == 0)
+        rc = fstatat(fd, seg, &st, AT_SYMLINK_NOFOLLOW);
+    if(rc == 0 && !S_ISREG(st.st_mode)){
+        errno = S_ISLNK(st.st_mode) ? ELOOP : S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        rc = -1;
+    }
+    if(rc == 0)
+        rc = link_file_at(fd, seg, dirfd, name);
+    close_keep_errno(fd);
+    return rc;
+}
+
+int remove_file_at(int dirfd, const char *name){
+    // Remove the file, a missing file is already what we want
+    FsOp op = fs_op_begin();
+    int rc = unlinkat(dirfd, name, 0);
+    fs_op_end(op, "unlinkat", name);
+    progress_entry(rc == 0 || errno == ENOENT);
+    if(rc == 0 || errno == ENOENT)
+        return EXIT_SUCCESS;
+
+    fprintf(stderr, "error : failed to remove file \"%s\".\n", name);
+    return EXIT_FAILURE;
+}
+
+int remove_folder_at(int dirfd, const char *name){
+    // Remove the directory, a missing directory is already what we want
+    FsOp op = fs_op_begin();
+    int rc = unlinkat(dirfd, name, AT_REMOVEDIR);
+    fs_op_end(op, "unlinkat", name);
+    progress_entry(rc == 0 || errno == ENOENT || errno == ENOTEMPTY || errno == EEXIST);
+    if(rc == 0 || errno == ENOENT)
+        return EXIT_SUCCESS;
+
+    // Keep directories holding entries that are not part of the template
+    if(errno == ENOTEMPTY || errno == EEXIST){
+        fprintf(stderr, "warning : directory \"%s\" is not empty, kept.\n", name);
+        return EXIT_SUCCESS;
+    }
+
+    fprintf(stderr, "error : failed to remove directory \"%s\".\n", name);
+    return EXIT_FAILURE;
+}
+#endif
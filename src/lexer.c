@@ -27,6 +27,10 @@ const char* token_type_name(Lx_TokenType t){
         case T_EOF: return "EOF";
         case T_NAME: return "NAME";
         case T_COMMENT: return "COMMENT";
+        case T_INCLUDE: return "INCLUDE";
+        case T_ATTRS: return "ATTRS";
+        case T_SYMLINK: return "SYMLINK";
+        case T_HARDLINK: return "HARDLINK";
         default: return "?";
     }
 }
@@ -97,10 +101,9 @@ static void q_push(Pending** h, Pending** t, Token tok){
     n->tok = tok; n->next = NULL;
     if(*t)
         (*t)->next = n; 
-    else{
+    else
         *h = n; 
-        *t = n;
-    }
+    *t = n;
 }
 
 static bool q_pop(Pending** h, Pending** t, Token* out){
@@ -138,23 +141,76 @@ static inline char peek2(Lexer* L){
 }
 
 static inline char getc_(Lexer* L){
-    if(L->i >= L->len) return '\0';
-    char c = L->src[L->i++];
-    if(c == '\n'){ L->line++; L->col = 1; L->at_line_start = true; }
-    else{ L->col++; }
-    return c;
+    return L->i < L->len ? L->src[L->i++] : '\0';
+}
+
+// Input offset of the current byte
+static inline size_t pos_(const Lexer* L){
+    return L->base + L->i;
 }
 
-static void add_error(Lexer* L, LexErrorKind kind, int line, int col, const char* msg, size_t nmsg){
+// Skip to the start of the next line (the window always holds the whole line)
+static void skip_line(Lexer* L){
+    const char* nl = (const char*)memchr(L->src + L->i, '\n', L->len - L->i);
+    L->i = nl ? (size_t)(nl - L->src) + 1 : L->len;
+    L->at_line_start = true;
+}
+
+// Make sure the window holds the whole current line (or the rest of the input)
+static void fill_line(Lexer* L){
+    if(!L->read)
+        return;
+
+    while(!L->read_eof && (L->i >= L->len || !memchr(L->src + L->i, '\n', L->len - L->i))){
+        // Drop the consumed bytes, then grow the window if the line fills it
+        if(L->i > 0){
+            // Count the dropped lines, positions in the window are resolved from them
+            const char* p = L->buf;
+            const char* end = L->buf + L->i;
+            while(p < end && (p = (const char*)memchr(p, '\n', (size_t)(end - p)))){
+                L->base_line++;
+                L->base_line_start = L->base + (size_t)(p - L->buf) + 1;
+                p++;
+            }
+            L->base += L->i;
+            memmove(L->buf, L->buf + L->i, L->len - L->i);
+            L->len -= L->i;
+            L->i = 0;
+        }
+        if(L->len == L->buf_cap){
+            size_t new_cap = L->buf_cap ? L->buf_cap * 2 : 65536;
+            char* tmp = (char*)realloc(L->buf, new_cap);
+            if(!tmp){
+                fprintf(stderr, "fatal (tokenizing): allocation failed for the input window.\n");
+                L->read_eof = true;
+                break;
+            }
+            L->buf = tmp;
+            L->buf_cap = new_cap;
+        }
+        L->src = L->buf;
+
+        size_t n = L->read(L->read_ctx, L->buf + L->len, L->buf_cap - L->len);
+        if(n == 0)
+            L->read_eof = true;
+        L->len += n;
+    }
+}
+
+static void add_error(Lexer* L, LexErrorKind kind, size_t offset, const char* msg, size_t nmsg){
     if(L->err_count == L->err_cap){
         L->err_cap = L->err_cap ? L->err_cap*2 : 4;
         L->errors = (LexError*)realloc(L->errors, L->err_cap * sizeof(LexError));
     }
 
     LexError* e = &L->errors[L->err_count++];
-    e->kind = kind; e->line = line; e->column = col;
+    e->kind = kind; e->offset = offset; e->line = 0; e->column = 0;
     e->message = msg ? _strndup(msg, nmsg) : NULL;
 
+    // Chunk workers only know chunk offsets, the fix-up pass resolves them
+    if(!L->raw_indent)
+        lexer_position(L, offset, &e->line, &e->column);
+
     if(L->cfg.stop_on_first_error) 
         L->had_fatal = true;
 }
@@ -181,24 +237,23 @@ static int count_indent(const char* s, size_t n, size_t* adv, int tabw){
     return spaces;
 }
 
-static Token make_tok(Lx_TokenType ty, const char* start, size_t n, int line, int col){
+static Token make_tok(Lx_TokenType ty, const char* start, size_t n, size_t offset){
     Token t; 
     t.type = ty; 
     t.length = n;
-    t.line = line; 
-    t.column = col; 
+    t.offset = offset; 
     t.lexeme = start ? _strndup(start, n) : NULL; 
     return t;
 }
 
-static void emit_indent_dedent(Lexer* L, int new_indent){
+static void emit_indent_dedent(Lexer* L, int new_indent, size_t offset){
     int curr = stack_top(&L->indents);
     if(new_indent == curr) 
         return;
 
     if(new_indent > curr){
         stack_push(&L->indents, new_indent);
-        Token t = make_tok(T_INDENT, NULL, 0, L->line, 1);
+        Token t = make_tok(T_INDENT, NULL, 0, offset);
         q_push(&L->qh, &L->qt, t);
         return;
     }
@@ -206,14 +261,14 @@ static void emit_indent_dedent(Lexer* L, int new_indent){
     // new_indent < curr: must match a previous indent level
     while(stack_top(&L->indents) > new_indent){
         stack_pop(&L->indents);
-        Token t = make_tok(T_DEDENT, NULL, 0, L->line, 1);
+        Token t = make_tok(T_DEDENT, NULL, 0, offset);
         q_push(&L->qh, &L->qt, t);
     }
 
     if(stack_top(&L->indents) != new_indent){
         // inconsistent dedent, report error
         const char* msg = "inconsistent indentation level";
-        add_error(L, LEX_ERR_BAD_INDENT, L->line, 1, msg, strlen(msg));
+        add_error(L, LEX_ERR_BAD_INDENT, offset, msg, strlen(msg));
     }
 }
 
@@ -221,17 +276,37 @@ static bool is_name_char(unsigned char c){
     return isalnum(c) || c == '_' || c == '-' || c == '.' || c == '+' || c == '@' || c == '@';
 }
 
+// Length of the "${identifier}" placeholder at the cursor, 0 if there is none
+// (the window always holds the whole line)
+static size_t placeholder_len(Lexer* L){
+    const char* p = L->src + L->i;
+    size_t left = L->len - L->i;
+    if(left < 4 || p[0] != '$' || p[1] != '{')
+        return 0;
+    size_t k = 2;
+    while(k < left && (isalnum((unsigned char)p[k]) || p[k] == '_'))
+        k++;
+    return (k > 2 && k < left && p[k] == '}') ? k + 1 : 0;
+}
+
 static Token lex_name_or_dir(Lexer* L){
-    int line = L->line, col = L->col;
+    size_t at = pos_(L);
     const char* start = &L->src[L->i];
     size_t n = 0;
 
     while(!__eof(L)){
         unsigned char c = (unsigned char)peek(L);
+        size_t var = (c == '$') ? placeholder_len(L) : 0;
         if(is_name_char(c)){
             getc_(L); 
             n++;
         }
+        else if(var > 0){
+            // Kept verbatim, expanded by the batch mode (see params.h)
+            for(size_t k = 0; k < var; k++)
+                getc_(L);
+            n += var;
+        }
         else 
             break;
     }
@@ -240,9 +315,97 @@ static Token lex_name_or_dir(Lexer* L){
     if(!__eof(L) && peek(L) == '/'){
         getc_(L);
         n++;
-        return make_tok(T_NAME, start, n, line, col);
     }
-    return make_tok(T_NAME, start, n, line, col);
+    L->after_name = true;
+    return make_tok(T_NAME, start, n, at);
+}
+
+// "[key=value ...]" after a name: the list must end on the same line
+static Token lex_attrs(Lexer* L){
+    size_t at = pos_(L);
+    getc_(L);
+
+    const char* start = &L->src[L->i];
+    size_t n = 0;
+    while(!__eof(L) && peek(L) != '\n' && peek(L) != ']'){
+        getc_(L);
+        n++;
+    }
+
+    if(__eof(L) || peek(L) != ']'){
+        const char* msg = "unterminated attribute list";
+        add_error(L, LEX_ERR_UNEXPECTED_CHAR, at, msg, strlen(msg));
+        return make_tok(T_NAME, "", 0, at);
+    }
+    getc_(L);
+    return make_tok(T_ATTRS, start, n, at);
+}
+
+static bool at_include(Lexer* L){
+    static const char kw[] = "@include";
+    size_t n = sizeof(kw) - 1;
+    if(L->len - L->i <= n || strncmp(L->src + L->i, kw, n) != 0)
+        return false;
+    char c = L->src[L->i + n];
+    return c == ' ' || c == '\t';
+}
+
+// "@include <path>": the path runs to the end of the line or to a comment
+static Token lex_include(Lexer* L){
+    size_t at = pos_(L);
+    for(size_t k = 0; k < sizeof("@include") - 1; k++)
+        getc_(L);
+    while(!__eof(L) && (peek(L) == ' ' || peek(L) == '\t'))
+        getc_(L);
+
+    const char* start = &L->src[L->i];
+    size_t n = 0;
+    while(!__eof(L) && peek(L) != '\n' && peek(L) != '#'){
+        getc_(L);
+        n++;
+    }
+    while(n > 0 && isspace((unsigned char)start[n - 1]))
+        n--;
+
+    if(n == 0){
+        const char* msg = "missing path after @include";
+        add_error(L, LEX_ERR_UNEXPECTED_CHAR, at, msg, strlen(msg));
+        return make_tok(T_NAME, "", 0, at);
+    }
+    return make_tok(T_INCLUDE, start, n, at);
+}
+
+// "-> target" or "=> target" after a name: the target runs to the end of the line or to a comment
+static bool at_link(Lexer* L){
+    if(L->len - L->i < 3 || (L->src[L->i] != '-' && L->src[L->i] != '=') || L->src[L->i + 1] != '>')
+        return false;
+    char c = L->src[L->i + 2];
+    return c == ' ' || c == '\t';
+}
+
+static Token lex_link(Lexer* L){
+    size_t at = pos_(L);
+    Lx_TokenType type = (peek(L) == '-') ? T_SYMLINK : T_HARDLINK;
+    getc_(L);
+    getc_(L);
+    while(!__eof(L) && (peek(L) == ' ' || peek(L) == '\t'))
+        getc_(L);
+
+    const char* start = &L->src[L->i];
+    size_t n = 0;
+    while(!__eof(L) && peek(L) != '\n' && peek(L) != '#'){
+        getc_(L);
+        n++;
+    }
+    while(n > 0 && isspace((unsigned char)start[n - 1]))
+        n--;
+
+    if(n == 0){
+        const char* msg = "missing link target";
+        add_error(L, LEX_ERR_UNEXPECTED_CHAR, at, msg, strlen(msg));
+        return make_tok(T_NAME, "", 0, at);
+    }
+    return make_tok(type, start, n, at);
 }
 
 // ---------------- Public API ----------------
@@ -253,8 +416,6 @@ void lexer_init(Lexer* L, const char* src, size_t len, const LexerConfig* cfg){
     L->src = src; 
     L->len = len; 
     L->i = 0; 
-    L->line = 1; 
-    L->col = 1; 
     L->at_line_start = true;
     stack_init(&L->indents); 
     stack_push(&L->indents, 0);
@@ -271,8 +432,228 @@ void lexer_init(Lexer* L, const char* src, size_t len, const LexerConfig* cfg){
     }
 }
 
+void lexer_init_stream(Lexer* L, LexerRead read, void* ctx, const LexerConfig* cfg){
+    lexer_init(L, NULL, 0, cfg);
+    L->read = read;
+    L->read_ctx = ctx;
+}
+
+size_t lexer_read_file(void* ctx, char* buf, size_t cap){
+    FILE* fp = (FILE*)ctx;
+    #ifndef _WIN32
+        // read(2) returns as soon as a pipe has data, fread would wait for cap bytes
+        for(;;){
+            ssize_t n = read(fileno(fp), buf, cap);
+            if(n >= 0)
+                return (size_t)n;
+            if(errno != EINTR){
+                fprintf(stderr, "fatal (tokenizing): read error on input.\n");
+                return 0;
+            }
+        }
+    #else
+        return fread(buf, 1, cap, fp);
+    #endif
+}
+
+// ---------------- Chunk-parallel lexing ----------------
+typedef struct LexChunk {
+    const char* src;        // first byte, always a line start
+    size_t      len;        // ends after a newline, except for the last chunk
+    LexerConfig cfg;        // worker configuration
+    Token*      toks;       // tokens, a raw T_INDENT at every line start
+    size_t      count;
+    size_t      cap;
+    LexError*   errors;     // offsets relative to the chunk, lines unresolved
+    size_t      err_count;
+    bool        fatal;      // the worker stopped on an error
+} LexChunk;
+
+// Pool task: lex one chunk, leaving indentation widths unresolved
+static void chunk_run(void* arg){
+    LexChunk* c = (LexChunk*)arg;
+    uint64_t span = trace_begin();
+    Lexer W;
+    lexer_init(&W, c->src, c->len, &c->cfg);
+    W.raw_indent = true;
+
+    for(;;){
+        Token t = lexer_next(&W);
+        if(t.type == T_EOF)
+            break;
+        if(c->count == c->cap){
+            size_t new_cap = c->cap ? c->cap * 2 : 1024;
+            Token* tmp = (Token*)realloc(c->toks, new_cap * sizeof(Token));
+            if(!tmp){
+                const char* msg = "allocation failed for the chunk tokens";
+                add_error(&W, LEX_ERR_INTERNAL, t.offset, msg, strlen(msg));
+                W.had_fatal = true;
+                token_free(&t);
+                break;
+            }
+            c->toks = tmp;
+            c->cap = new_cap;
+        }
+        c->toks[c->count++] = t;
+    }
+
+    // Hand the errors over, the fix-up pass reports them in input order
+    c->errors = W.errors;
+    c->err_count = W.err_count;
+    c->fatal = W.had_fatal;
+    W.errors = NULL;
+    W.err_count = W.err_cap = 0;
+    lexer_free(&W);
+    trace_end(span, "lex chunk", NULL);
+}
+
+// Report a chunk error at its input offset
+static void replay_error(Lexer* L, LexError* e, size_t base){
+    add_error(L, e->kind, e->offset + base, e->message, e->message ? strlen(e->message) : 0);
+    lex_error_free(e);
+}
+
+// Fix-up pass: replay the chunk tokens in order, turning raw widths into INDENT/DEDENT
+static Token replay_next(Lexer* L){
+    Token out;
+    while(!q_pop(&L->qh, &L->qt, &out)){
+        if(L->chunk_cur == L->chunk_count){
+            // End of input: close the open blocks like next_core
+            if(stack_top(&L->indents) > 0){
+                stack_pop(&L->indents);
+                return make_tok(T_DEDENT, NULL, 0, L->map_len);
+            }
+            return make_tok(T_EOF, NULL, 0, L->map_len);
+        }
+
+        LexChunk* c = &L->chunks[L->chunk_cur];
+        size_t base = (size_t)(c->src - L->map);
+        if(L->chunk_pos == c->count){
+            // Chunk done: report what is left and move on
+            while(L->chunk_err < c->err_count)
+                replay_error(L, &c->errors[L->chunk_err++], base);
+            bool fatal = c->fatal;
+            free(c->toks); c->toks = NULL;
+            free(c->errors); c->errors = NULL;
+            L->chunk_cur++; L->chunk_pos = 0; L->chunk_err = 0;
+            if(fatal){
+                L->had_fatal = true;
+                return make_tok(T_EOF, NULL, 0, base + c->len);
+            }
+            continue;
+        }
+
+        Token t = c->toks[L->chunk_pos++];
+        t.offset += base;
+
+        // Errors met before this token come first; on a line start they follow the indentation check
+        while(L->chunk_err < c->err_count){
+            size_t at = c->errors[L->chunk_err].offset + base;
+            if(t.type == T_INDENT ? at >= t.offset : at > t.offset)
+                break;
+            replay_error(L, &c->errors[L->chunk_err++], base);
+        }
+
+        if(t.type == T_INDENT){
+            emit_indent_dedent(L, (int)t.length, t.offset);
+            continue;
+        }
+        return t;
+    }
+    return out;
+}
+
+bool lexer_init_parallel(Lexer* L, FILE* fp, unsigned int workers, const LexerConfig* cfg){
+    if(workers == 0)
+        workers = pool_default_workers();
+    if(workers < 2)
+        return false;
+
+    struct stat st;
+    if(fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < LEXER_PARALLEL_MIN)
+        return false;
+    size_t size = (size_t)st.st_size;
+
+    // The whole input must be addressable so chunks can start anywhere
+    #ifndef _WIN32
+        char* data = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if(data == MAP_FAILED)
+            return false;
+    #else
+        char* data = (char*)malloc(size);
+        if(!data || fread(data, 1, size, fp) != size){
+            free(data);
+            rewind(fp);
+            return false;
+        }
+    #endif
+
+    size_t n = (size_t)workers * LEXER_CHUNKS_PER_WORKER;
+    LexChunk* chunks = (LexChunk*)calloc(n, sizeof(LexChunk));
+    ThreadPool pool;
+    if(!chunks || pool_init(&pool, workers) != 0){
+        free(chunks);
+        #ifndef _WIN32
+            munmap(data, size);
+        #else
+            free(data);
+            rewind(fp);
+        #endif
+        return false;
+    }
+
+    lexer_init(L, NULL, 0, cfg);
+    L->map = data;
+    L->map_len = size;
+
+    // Split at newline boundaries and lex every chunk on the pool
+    size_t count = 0, start = 0;
+    for(size_t k = 1; k <= n && start < size; k++){
+        size_t end = (k == n) ? size : size / n * k;
+        if(end < start)
+            end = start;
+        const char* nl = (const char*)memchr(data + end, '\n', size - end);
+        end = nl ? (size_t)(nl - data) + 1 : size;
+
+        chunks[count] = (LexChunk){ .src = data + start, .len = end - start, .cfg = L->cfg };
+        if(pool_submit(&pool, chunk_run, &chunks[count]) != 0)
+            chunk_run(&chunks[count]);          /* Could not queue it, lex it here */
+        count++;
+        start = end;
+    }
+    pool_wait(&pool);
+    pool_destroy(&pool);
+
+    L->chunks = chunks;
+    L->chunk_count = count;
+    return true;
+}
+
 void lexer_free(Lexer* L){
     if(!L) return;
+    free(L->buf); L->buf = NULL; L->src = NULL;
+
+    // Chunk tokens not replayed yet (the replayed ones belong to the caller)
+    for(size_t c = L->chunk_cur; c < L->chunk_count; ++c){
+        LexChunk* k = &L->chunks[c];
+        for(size_t t = (c == L->chunk_cur) ? L->chunk_pos : 0; t < k->count; ++t)
+            token_free(&k->toks[t]);
+        for(size_t e = 0; e < k->err_count; ++e)
+            lex_error_free(&k->errors[e]);
+        free(k->toks);
+        free(k->errors);
+    }
+    free(L->chunks); L->chunks = NULL;
+    L->chunk_count = L->chunk_cur = 0;
+    #ifndef _WIN32
+        if(L->map)
+            munmap(L->map, L->map_len);
+    #else
+        free(L->map);
+    #endif
+    L->map = NULL;
+    free(L->nl_index); L->nl_index = NULL;
+    L->nl_count = 0; L->nl_built = false;
     stack_free(&L->indents);
     q_clear(&L->qh, &L->qt);
 
@@ -287,16 +668,23 @@ static Token next_core(Lexer* L){
     if(q_pop(&L->qh, &L->qt, &out))
         return out;
 
+    bool after_name = L->after_name;
+    L->after_name = false;
+
+    if(L->at_line_start || L->i >= L->len)
+        fill_line(L);
+
     if(__eof(L)){
         if(stack_top(&L->indents) > 0){
             stack_pop(&L->indents);
-            return make_tok(T_DEDENT, NULL, 0, L->line, L->col);
+            return make_tok(T_DEDENT, NULL, 0, pos_(L));
         }
-        return make_tok(T_EOF, NULL, 0, L->line, L->col);
+        return make_tok(T_EOF, NULL, 0, pos_(L));
     }
 
     // ----- Start-of-line indentation management -----
     if(L->at_line_start){
+        size_t line_start = pos_(L);
         size_t adv = 0;
         int spaces = count_indent(L->src + L->i, L->len - L->i, &adv, L->cfg.tab_width);
 
@@ -305,21 +693,24 @@ static Token next_core(Lexer* L){
 
         if(c == '\n' || c == '\0'){
             L->i += adv;
-            if(c == '\n') (void)getc_(L);
+            if(c == '\n') (void)getc_(L);     /* Blank line, still at a line start */
             return next_core(L);
         }
 
         if(c == '#'){
             L->i += adv;
-            while(!__eof(L) && getc_(L) != '\n') {}
+            skip_line(L);
             return next_core(L);
         }
 
         L->i += adv;
-        L->col += (int)adv;
         L->at_line_start = false;
 
-        emit_indent_dedent(L, spaces);
+        // Chunk worker: the fix-up pass resolves the width against the open blocks
+        if(L->raw_indent)
+            return make_tok(T_INDENT, NULL, (size_t)spaces, line_start);
+
+        emit_indent_dedent(L, spaces, line_start);
         if(q_pop(&L->qh, &L->qt, &out))
             return out;
     }
@@ -331,7 +722,7 @@ static Token next_core(Lexer* L){
             continue;
         }
         if(c == '#'){
-            while(!__eof(L) && getc_(L) != '\n') {}
+            skip_line(L);
             return next_core(L);
         }
         break;
@@ -340,29 +731,41 @@ static Token next_core(Lexer* L){
     if(__eof(L)){
         if(stack_top(&L->indents) > 0){
             stack_pop(&L->indents);
-            return make_tok(T_DEDENT, NULL, 0, L->line, L->col);
+            return make_tok(T_DEDENT, NULL, 0, pos_(L));
         }
-        return make_tok(T_EOF, NULL, 0, L->line, L->col);
+        return make_tok(T_EOF, NULL, 0, pos_(L));
     }
 
     if(peek(L) == '\n'){
+        size_t at = pos_(L);
         (void)getc_(L);
+        L->at_line_start = true;
         if(L->cfg.emit_blank_newlines){
-            return make_tok(T_NEWLINE, NULL, 0, L->line - 1, 1);
+            return make_tok(T_NEWLINE, NULL, 0, at);
         }else{
             return next_core(L);
         }
     }
 
+    // INCLUDE
+    if(at_include(L))
+        return lex_include(L);
+
+    // ATTRS and links, only right after a name
+    if(after_name && peek(L) == '[')
+        return lex_attrs(L);
+    if(after_name && at_link(L))
+        return lex_link(L);
+
     // NAME
     if(!__eof(L)){
         unsigned char c =(unsigned char)peek(L);
-        if(is_name_char(c)){
+        if(is_name_char(c) || (c == '$' && placeholder_len(L) > 0)){
             return lex_name_or_dir(L);
         }
         // Any other visible non-space character is unexpected here
         if(!isspace(c) && c != '\0'){
-            int line = L->line, col = L->col;
+            size_t at = pos_(L);
             char msgbuf[64];
             int m = snprintf(msgbuf, sizeof(msgbuf), "unexpected character '%c'", (char)c);
             if(m < 0) 
@@ -370,11 +773,11 @@ static Token next_core(Lexer* L){
 
             (void)m;
 
-            add_error(L, LEX_ERR_UNEXPECTED_CHAR, line, col, msgbuf, strlen(msgbuf));
+            add_error(L, LEX_ERR_UNEXPECTED_CHAR, at, msgbuf, strlen(msgbuf));
             // consume to avoid infinite loop
             getc_(L);
             // recover by returning a NAME-like token of length 0
-            return make_tok(T_NAME, "", 0, line, col);
+            return make_tok(T_NAME, "", 0, at);
         }
     }
 
@@ -387,17 +790,74 @@ static Token next_core(Lexer* L){
 
 Token lexer_next(Lexer* L){
     if(L->had_fatal)
-        return make_tok(T_EOF, NULL, 0, L->line, L->col);
+        return make_tok(T_EOF, NULL, 0, pos_(L));
     
-    Token t = next_core(L);
+    Token t = L->chunks ? replay_next(L) : next_core(L);
     if(L->had_fatal && t.type != T_EOF){
         // Force EOF if a fatal error occurred mid-stream
         token_free(&t);
-        return make_tok(T_EOF, NULL, 0, L->line, L->col);
+        return make_tok(T_EOF, NULL, 0, pos_(L));
     }
+    TRACE_PROBE2(lexer_next, (int)t.type, t.offset);
     return t;
 }
 
+// Record the offset of every newline of in-memory input
+static void build_nl_index(Lexer* L){
+    const char* text = L->map ? L->map : L->src;
+    size_t len = L->map ? L->map_len : L->len;
+    L->nl_built = true;
+
+    size_t count = 0;
+    for(const char* p = text; p && (p = (const char*)memchr(p, '\n', len - (size_t)(p - text))); p++)
+        count++;
+    if(count == 0)
+        return;
+
+    L->nl_index = (size_t*)malloc(count * sizeof(size_t));
+    if(!L->nl_index){
+        fprintf(stderr, "fatal (tokenizing): allocation failed for the line index.\n");
+        return;
+    }
+    for(const char* p = text; (p = (const char*)memchr(p, '\n', len - (size_t)(p - text))); p++)
+        L->nl_index[L->nl_count++] = (size_t)(p - text);
+}
+
+void lexer_position(Lexer* L, size_t offset, int* line, int* column){
+    size_t start;
+    if(L->read){
+        // Streamed input: only the window is left, the lines before it were counted on refill
+        int n = L->base_line;
+        start = L->base_line_start;
+        size_t end = (offset > L->base) ? offset - L->base : 0;
+        if(end > L->len)
+            end = L->len;
+        const char* p = L->src;
+        const char* stop = L->src + end;
+        while(p < stop && (p = (const char*)memchr(p, '\n', (size_t)(stop - p)))){
+            n++;
+            start = L->base + (size_t)(p - L->src) + 1;
+            p++;
+        }
+        *line = n + 1;
+    }else{
+        // In-memory input: count the newlines before offset in the index
+        if(!L->nl_built)
+            build_nl_index(L);
+        size_t lo = 0, hi = L->nl_count;
+        while(lo < hi){
+            size_t mid = lo + (hi - lo) / 2;
+            if(L->nl_index[mid] < offset)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        start = lo ? L->nl_index[lo - 1] + 1 : 0;
+        *line = (int)lo + 1;
+    }
+    *column = (offset >= start) ? (int)(offset - start) + 1 : 1;
+}
+
 size_t lexer_error_count(const Lexer* L){ 
     return L ? L->err_count : 0; 
 }
@@ -409,45 +869,31 @@ const LexError* lexer_errors(const Lexer* L){
 size_t lexer_tokenize_file(const char *filename, Token **out_tokens, const LexerConfig *cfg){
     *out_tokens = NULL;
 
-    FILE *fp = fopen(filename, "rb");
+    // "-" reads the template from the standard input
+    bool use_stdin = (strcmp(filename, "-") == 0);
+    FILE *fp = use_stdin ? stdin : fopen(filename, "rb");
     if(!fp){
         fprintf(stderr, "fatal (tokenizing): cannot open '%s'.\n", filename);
         return 0;
     }
-    fseek(fp, 0, SEEK_END);
-    long n = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    if(n < 0){ 
-        fclose(fp); 
-        return 0; 
-    }
-
-    char *buf = (char*)malloc((size_t)n + 1);
-    if(!buf){ 
-        fclose(fp); 
-        fprintf(stderr, "fatal (tokenizing): alocation failed for the file bufeer.\n"); 
-        return 0; 
-    }
-
-    size_t rd = fread(buf, 1, (size_t)n, fp);
-    fclose(fp);
-    buf[rd] = '\0';
 
     LexerConfig local = cfg ? *cfg : (LexerConfig){ .tab_width = 4, .emit_blank_newlines = false, .stop_on_first_error = true };
     Lexer L; 
-    lexer_init(&L, buf, rd, &local);
+    lexer_init_stream(&L, lexer_read_file, fp, &local);
 
     size_t cap = 64, count = 0;
     Token *arr = (Token*)malloc(cap * sizeof(Token));
     if(!arr){ 
-        free(buf); 
+        if(!use_stdin) 
+            fclose(fp); 
+        lexer_free(&L);
         fprintf(stderr, "fatal (tokenizing): allocation failed for tokens array.\n"); 
         return 0; 
     }
 
     for(;;){
         Token t = next_core(&L);
-        if(t.type == T_NAME || t.type == T_INDENT || t.type == T_DEDENT || t.type == T_EOF){
+        if(t.type == T_NAME || t.type == T_INCLUDE || t.type == T_ATTRS || t.type == T_SYMLINK || t.type == T_HARDLINK || t.type == T_INDENT || t.type == T_DEDENT || t.type == T_EOF){
             if(count == cap){
                 cap *= 2;
                 Token *tmp = (Token*)realloc(arr, cap * sizeof(Token));
@@ -457,7 +903,8 @@ size_t lexer_tokenize_file(const char *filename, Token **out_tokens, const Lexer
                         token_free(&arr[i]);
 
                     free(arr); 
-                    free(buf); 
+                    if(!use_stdin) 
+                        fclose(fp); 
                     lexer_free(&L);
                     return 0;
                 }
@@ -473,7 +920,8 @@ size_t lexer_tokenize_file(const char *filename, Token **out_tokens, const Lexer
     }
 
     lexer_free(&L);
-    free(buf);
+    if(!use_stdin) 
+        fclose(fp);
     *out_tokens = arr;
     return count;
 }
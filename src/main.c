@@ -12,37 +12,197 @@
     - parser.h/parser.c:  Parses the token stream and builds the tree structure in memory.
     - builder.h/builder.c:  Traverses the in-memory tree and creates the corresponding directories and files on disk.
     - fs.h/fs.c: Provides basic file system operations such as create_folder and create_file.
+    - pool.h/pool.c: Worker thread pool used by the parallel walks.
+    - pipeline.h/pipeline.c: Pipelined mode, lexer thread -> parser -> builder workers.
+    - export.h/export.c: Buffered text, JSON and NUL-separated path output of a parsed tree.
+    - plan.h/plan.c: Compiled operation logs (--plan), replayed without lexing or parsing (--apply-plan).
+    - diff.h/diff.c: Template-to-template deltas (--diff), applied in place (--update).
+    - watch.h/watch.c: inotify-driven re-apply of template edits (--watch).
+    - serve.h/serve.c: Unix socket daemon with a warm template cache (--serve) and its client (--client).
+    - filter.h/filter.c: --only/--exclude path globs, matched while parsing to prune whole subtrees.
+    - params.h/params.c: ${var} placeholders rendered per row of a bindings table (--batch).
+    - throttle.h/throttle.c: AIMD window and rate cap on the filesystem operations (--throttle, --max-ops).
+    - progress.h/progress.c: Atomic entry counters sampled by a reporter thread (--progress).
+    - trace.h/trace.c: Per-thread phase and slow call spans written as trace-event JSON (--trace), USDT probes.
 
     Workflow:
-    1. Parse command-line arguments to get input .trm files and the destination directory.
+    1. Parse command-line arguments to get input .trm files and the destination directories.
     2. For each input file:
         a. Lex the file to generate tokens.
         b. Parse the tokens to create a tree representation of the file system structure.
-        c. Build the file system structure on disk using the created tree and the destination directory.
+        c. Build the file system structure on disk using the created tree and the destination directory
+           (or remove it bottom-up in --remove mode). Several destinations share one parse and one
+           worker pool: the tree is compiled into a plan and replayed into each of them.
         d. Clean up the in-memory tree.
     3. Free resources used by command-line arguments.
 */
 #include "args.h"
 #include "parser.h"
 #include "builder.h"
+#include "pipeline.h"
+#include "export.h"
+#include "plan.h"
+#include "diff.h"
+#include "watch.h"
+#include "serve.h"
+#include "params.h"
 
 int main(int argc, char **argv){
     Args args;
 
     if(parse_args(argc, argv, &args) != 0)              // Parse command-line arguments. If parsing fails, exit.
         return EXIT_FAILURE;
+    parser_set_jobs(args.jobs);                         // Large templates are lexed with the same worker count.
+    parser_set_index(args.find_path != NULL);           // Lookups go through the path index.
+    parser_set_filter(&args.filter);                    // Entries left out by --only/--exclude are never parsed into the tree.
+    build_set_dedup(args.dedup);                        // Identical files become hard links of one inode.
+    throttle_configure(args.throttle, args.jobs ? args.jobs : pool_default_workers(), args.max_ops);  // Pace the filesystem operations of every builder.
+    if(args.progress && progress_start(stderr) == 0)    // Count the entries done and report them until exit, whatever the exit path.
+        atexit(progress_stop);
+    if(args.trace_path){                                // Record the run timeline, written out at exit.
+        if(trace_start(args.trace_path) != 0)
+            return EXIT_FAILURE;
+        atexit(trace_stop);
+    }
+
+    if(args.apply_plan_path || args.show_plan_path){    // Replay or print a compiled plan, no template is read.
+        Plan plan;
+        int status = plan_read(&plan, args.apply_plan_path ? args.apply_plan_path : args.show_plan_path);
+        if(status == 0 && args.apply_plan_path)
+            progress_expect(plan.count * (args.dest_count > 1 ? args.dest_count : 1));
+        if(status == 0)
+            status = !args.apply_plan_path ? plan_print(&plan, stdout)
+                   : args.dest_count > 1 ? plan_apply_many(&plan, (const char *const *)args.dest_paths, args.dest_count, args.jobs, args.preflight)
+                   : plan_apply(&plan, args.dest_path, args.jobs, args.preflight);
+        plan_free(&plan);
+        free_args(&args);
+        return status;
+    }
+
+    if(args.diff_old){                                  // Compare two templates, and apply the delta in --update mode.
+        Tree old_tr = parse_tokens(args.diff_old);
+        Tree new_tr = parse_tokens(args.diff_new);
+        int status = EXIT_FAILURE;
+        if(!old_tr || !new_tr)
+            fprintf(stderr, "fatal : parsing error please check the input file \"%s\".\n", old_tr ? args.diff_new : args.diff_old);
+        else
+            status = diff_trees(old_tr, new_tr, args.update_mode ? args.dest_path : NULL, stdout, NULL);
+        clean_tree(&old_tr);
+        clean_tree(&new_tr);
+        parser_clear_cache();
+        free_args(&args);
+        return status;
+    }
+
+    if(args.serve_path){                                // Serve requests until interrupted, templates stay parsed between them.
+        int status = serve_run(args.serve_path, args.jobs, args.preflight);
+        free_args(&args);
+        return status;
+    }
+
+    if(args.watch_mode){                                // Keep the destination in sync with the template until interrupted.
+        int status = watch_template(args.input_files[0], args.dest_path);
+        parser_clear_cache();
+        free_args(&args);
+        return status;
+    }
 
+    Plan plan = { 0 };                                  // Operations compiled in --plan mode.
+    ParamTable table = { 0 };                           // Variable bindings of a --batch build.
+    if(args.batch_path && params_table_read(&table, args.batch_path) != 0)
+        return EXIT_FAILURE;
     for(size_t i = 0; i < args.file_count; i++){       // Iterate through each input file provided.
-        Tree tr = parse_tokens(args.input_files[i]);      // Parse the input file to create the tree structure.
+        if(args.client_path){                           // Let the server build it from its warm cache.
+            if(serve_send(args.client_path, args.input_files[i], args.dest_path, args.remove_mode,
+                          args.jobs, args.preflight, args.journal_path) != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.plan_path){                             // Compile the tree into the plan instead of creating it.
+            Tree tr = parse_tokens(args.input_files[i]);
+            int status = plan_compile(&plan, tr);
+            clean_tree(&tr);
+            if(status != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.find_path){                             // Look the path up instead of creating the tree.
+            Tree tr = parse_tokens(args.input_files[i]);
+            Tree node = tree_find(tr, args.find_path);
+            if(node)
+                printf("%s %s\n", node->is_directory ? "directory" : "file", args.find_path);
+            else
+                fprintf(stderr, "error : \"%s\" is not in \"%s\".\n", args.find_path, args.input_files[i]);
+            clean_tree(&tr);
+            if(!node)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.export_mode){                           // Print the parsed tree for review instead of creating it.
+            Tree tr = parse_tokens(args.input_files[i]);
+            int status = export_tree(tr, args.export_format, STDOUT_FILENO);
+            clean_tree(&tr);
+            if(status != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.batch_path){                            // Instantiate the template once per bindings row from a single parse.
+            TreeStats stats;
+            Tree tr = parse_tokens_stats(args.input_files[i], &stats);
+            if(tr)
+                progress_expect((stats.directories + stats.files) * table.rows * (args.dest_count > 1 ? args.dest_count : 1));
+            int status = tr ? params_build(tr, &table, args.dest_count > 1 ? (const char *const *)args.dest_paths : (const char *const *)&args.dest_path,
+                                           args.dest_count > 1 ? args.dest_count : 1, args.jobs, args.preflight) : EXIT_FAILURE;
+            clean_tree(&tr);
+            if(status != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.direct_mode && !args.remove_mode){      // Create entries straight from the token stream, memory is O(depth).
+            if(build_direct(args.input_files[i], args.dest_path) != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+        if(args.pipeline_mode && !args.remove_mode){    // Overlap lexing, parsing and building on separate threads.
+            if(pipeline_build(args.input_files[i], args.dest_path, args.jobs) != 0)
+                return EXIT_FAILURE;
+            continue;
+        }
+
+        TreeStats stats;                                // Entry counts, kept by the parser as it attaches them.
+        Tree tr = parse_tokens_stats(args.input_files[i], &stats);  // Parse the input file to create the tree structure.
         if(!tr){                                        // If parsing fails (returns NULL), print an error and exit.
             fprintf(stderr, "fatal : parsing error please check the input file \"%s\".\n", args.input_files[i]);
             return EXIT_FAILURE;
         } else {
-            if(build_tree(tr, args.dest_path) != 0)     // Build the directory/file structure based on the tree. If building fails, exit.
+            progress_expect((stats.directories + stats.files) * (args.dest_count > 1 ? args.dest_count : 1));
+            if(args.remove_mode){                       // Remove the structure described by the tree instead of building it.
+                for(unsigned int d = 0; d < (args.dest_count > 1 ? args.dest_count : 1); d++)
+                    if(remove_tree(tr, args.dest_count > 1 ? args.dest_paths[d] : args.dest_path, args.jobs) != 0)
+                        return EXIT_FAILURE;
+            } else if(args.dest_count > 1){             // Fan out: compile the tree once, replay it into every destination on one pool.
+                Plan fan = { 0 };
+                int status = plan_compile(&fan, tr);
+                if(status == 0)
+                    status = plan_apply_many(&fan, (const char *const *)args.dest_paths, args.dest_count, args.jobs, args.preflight);
+                plan_free(&fan);
+                if(status != 0)
+                    return EXIT_FAILURE;
+            } else if(args.preflight && !(args.journal_path && build_journal_matches(args.journal_path, args.dest_path, &stats))   // Refuse a build the destination can not hold before creating anything,
+                      && check_capacity(args.dest_path, stats.directories, stats.files) != 0)                        // unless it resumes one that already created part of it.
+                return EXIT_FAILURE;
+            else if(build_tree_resume(tr, args.dest_path, args.journal_path, &stats) != 0)     // Build the directory/file structure based on the tree (journaled with --resume). If building fails, exit.
                 return EXIT_FAILURE;
             clean_tree(&tr);                            // Clean up the allocated memory for the tree.
         }
     }
+    if(args.plan_path && plan_write(&plan, args.plan_path) != 0)
+        return EXIT_FAILURE;
+    plan_free(&plan);
+    params_table_free(&table);
+    parser_clear_cache();                               // Free the templates loaded by @include directives.
+    if(args.debug_mode)                                 // Show how the throttle settled.
+        throttle_report(stderr);
     free_args(&args);                                   // Free the memory allocated for the command-line arguments.
     return 0;                                           // Exit successfully.
 }
@@ -0,0 +1,271 @@
+#include "params.h"
+
+int params_table_read(ParamTable *table, const char *path){
+    memset(table, 0, sizeof(*table));
+
+    FILE *fp = fopen(path, "r");
+    if(!fp){
+        fprintf(stderr, "fatal (params): cannot open bindings table \"%s\".\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char line[PARAMS_LINE_MAX];
+    size_t count = 0, cap = 0, number = 0;
+    int status = EXIT_SUCCESS;
+    while(status == EXIT_SUCCESS && fgets(line, sizeof(line), fp)){
+        number++;
+        if(!strchr(line, '\n') && !feof(fp)){
+            fprintf(stderr, "fatal (params): \"%s\" line %zu is longer than %d bytes.\n", path, number, PARAMS_LINE_MAX - 2);
+            status = EXIT_FAILURE;
+            break;
+        }
+        size_t before = count;
+        for(char *cell = strtok(line, " \t\r\n"); cell; cell = strtok(NULL, " \t\r\n")){
+            if(cell == line && cell[0] == '#')
+                break;
+            char *copy = NULL;
+            if(count == cap){
+                size_t new_cap = cap ? cap * 2 : 64;
+                char **tmp = realloc(table->cells, new_cap * sizeof(char *));
+                if(!tmp)
+                    break;
+                table->cells = tmp;
+                cap = new_cap;
+            }
+            if(!(copy = strdup(cell)))
+                break;
+            table->cells[count++] = copy;
+        }
+
+        size_t cells = count - before;
+        if(cells == 0)
+            continue;
+        if(table->columns == 0)
+            table->columns = cells;             /* The header */
+        else if(cells != table->columns){
+            fprintf(stderr, "fatal (params): \"%s\" line %zu has %zu cells, the header has %zu.\n", path, number, cells, table->columns);
+            status = EXIT_FAILURE;
+        } else
+            table->rows++;
+    }
+
+    fclose(fp);
+    if(status == EXIT_SUCCESS && table->columns == 0){
+        fprintf(stderr, "fatal (params): \"%s\" has no header row.\n", path);
+        status = EXIT_FAILURE;
+    }
+    if(status == EXIT_SUCCESS && count != table->columns * (table->rows + 1)){
+        fprintf(stderr, "fatal (params): memory allocation failed for \"%s\".\n", path);
+        status = EXIT_FAILURE;
+    }
+    if(status != EXIT_SUCCESS){
+        table->columns = count;                 /* Free every cell read so far */
+        table->rows = 0;
+        params_table_free(table);
+    }
+    return status;
+}
+
+void params_table_free(ParamTable *table){
+    for(size_t i = 0; i < table->columns * (table->rows + 1); i++)
+        free(table->cells[i]);
+    free(table->cells);
+    memset(table, 0, sizeof(*table));
+}
+
+static int segment_add(ParamPlan *params, ParamSegment seg){
+    if(params->segment_count == params->segment_cap){
+        size_t new_cap = params->segment_cap ? params->segment_cap * 2 : 64;
+        ParamSegment *tmp = realloc(params->segments, new_cap * sizeof(ParamSegment));
+        if(!tmp){
+            fprintf(stderr, "fatal (params): failed to grow the segment list.\n");
+            return EXIT_FAILURE;
+        }
+        params->segments = tmp;
+        params->segment_cap = new_cap;
+    }
+    params->segments[params->segment_count++] = seg;
+    return EXIT_SUCCESS;
+}
+
+// Index of the variable name[0..len), added on first use
+static uint32_t var_index(ParamPlan *params, const char *name, size_t len){
+    for(size_t v = 0; v < params->var_count; v++)
+        if(strncmp(params->vars[v], name, len) == 0 && params->vars[v][len] == '\0')
+            return (uint32_t)v;
+
+    char **tmp = realloc(params->vars, (params->var_count + 1) * sizeof(char *));
+    if(!tmp)
+        return PARAM_LITERAL;
+    params->vars = tmp;
+    if(!(params->vars[params->var_count] = _strndup(name, len)))
+        return PARAM_LITERAL;
+    return (uint32_t)params->var_count++;
+}
+
+int params_compile(ParamPlan *params, const Plan *plan){
+    memset(params, 0, sizeof(*params));
+    params->plan = plan;
+
+    params->names = calloc(plan->count + 1, sizeof(ParamName));
+    if(!params->names){
+        fprintf(stderr, "fatal (params): memory allocation failed for the segment lists.\n");
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < plan->count; i++){
+        // Link targets are copied as they are: a placeholder there would not follow its file
+        if(plan->ops[i].target != 0 && strstr(plan->names + plan->ops[i].target, "${")){
+            fprintf(stderr, "fatal (params): the link target \"%s\" can not hold a placeholder.\n", plan->names + plan->ops[i].target);
+            return EXIT_FAILURE;
+        }
+
+        const char *name = plan->names + plan->ops[i].name;
+        if(!strstr(name, "${"))
+            continue;
+
+        // The lexer only lets well-formed "${identifier}" placeholders through
+        params->names[i].first = (uint32_t)params->segment_count;
+        for(const char *p = name; *p; ){
+            const char *var = strstr(p, "${");
+            const char *end = var ? strchr(var, '}') : NULL;
+            if(!var || !end)
+                var = end = p + strlen(p);
+            if(var > p && segment_add(params, (ParamSegment){ PARAM_LITERAL, (uint32_t)(p - plan->names), (uint32_t)(var - p) }) != 0)
+                return EXIT_FAILURE;
+            if(*var == '\0')
+                break;
+
+            uint32_t v = var_index(params, var + 2, (size_t)(end - var - 2));
+            if(v == PARAM_LITERAL){
+                fprintf(stderr, "fatal (params): memory allocation failed for \"%s\".\n", name);
+                return EXIT_FAILURE;
+            }
+            if(segment_add(params, (ParamSegment){ v, 0, 0 }) != 0)
+                return EXIT_FAILURE;
+            p = end + 1;
+        }
+        params->names[i].count = (uint32_t)(params->segment_count - params->names[i].first);
+    }
+
+    // The instance shares the ops layout, its name table starts with the template one
+    Plan *inst = &params->instance;
+    inst->ops = malloc((plan->count + 1) * sizeof(PlanOp));
+    inst->names = malloc(plan->names_len + 1);
+    if(!inst->ops || !inst->names){
+        fprintf(stderr, "fatal (params): memory allocation failed for the instance.\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(inst->ops, plan->ops, plan->count * sizeof(PlanOp));
+    memcpy(inst->names, plan->names, plan->names_len);
+    inst->count = inst->cap = plan->count;
+    inst->names_len = inst->names_cap = params->base_len = plan->names_len;
+    return EXIT_SUCCESS;
+}
+
+int params_bind(ParamPlan *params, const ParamTable *table){
+    free(params->column);
+    params->column = malloc((params->var_count + 1) * sizeof(size_t));
+    if(!params->column){
+        fprintf(stderr, "fatal (params): memory allocation failed for the bindings.\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for(size_t v = 0; v < params->var_count; v++){
+        size_t c = 0;
+        while(c < table->columns && strcmp(table->cells[c], params->vars[v]) != 0)
+            c++;
+        if(c == table->columns){
+            fprintf(stderr, "fatal (params): the bindings table has no \"%s\" column for ${%s}.\n", params->vars[v], params->vars[v]);
+            status = EXIT_FAILURE;
+        }
+        params->column[v] = c;
+    }
+    return status;
+}
+
+// Append text[0..len) to the instance name table
+static bool instance_append(Plan *inst, const char *text, size_t len){
+    if(inst->names_len + len + 1 > inst->names_cap){
+        size_t new_cap = inst->names_cap * 2 + len + 1;
+        char *tmp = realloc(inst->names, new_cap);
+        if(!tmp)
+            return false;
+        inst->names = tmp;
+        inst->names_cap = new_cap;
+    }
+    memcpy(inst->names + inst->names_len, text, len);
+    inst->names_len += len;
+    inst->names[inst->names_len] = '\0';
+    return true;
+}
+
+const Plan *params_instantiate(ParamPlan *params, const ParamTable *table, size_t row){
+    const Plan *plan = params->plan;
+    Plan *inst = &params->instance;
+    char *const *cells = table->cells + (row + 1) * table->columns;
+
+    // Drop the names of the previous instance, the template ones stay
+    inst->names_len = params->base_len;
+
+    for(size_t i = 0; i < plan->count; i++){
+        const ParamName *pn = &params->names[i];
+        if(pn->count == 0)
+            continue;
+
+        size_t start = inst->names_len;
+        for(uint32_t s = pn->first; s < pn->first + pn->count; s++){
+            const ParamSegment *seg = &params->segments[s];
+            const char *text = (seg->var == PARAM_LITERAL) ? plan->names + seg->offset : cells[params->column[seg->var]];
+            size_t len = (seg->var == PARAM_LITERAL) ? seg->length : strlen(text);
+            if(!instance_append(inst, text, len)){
+                fprintf(stderr, "fatal (params): memory allocation failed for row %zu.\n", row + 1);
+                return NULL;
+            }
+        }
+        inst->names_len++;                      /* Keep the terminator */
+
+        // A value must not leave the entry it names
+        const char *name = inst->names + start;
+        if(name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strchr(name, '/') || strchr(name, PATH_SEPARATOR)){
+            fprintf(stderr, "error (params): row %zu gives the invalid name \"%s\" to \"%s\".\n", row + 1, name, plan->names + plan->ops[i].name);
+            return NULL;
+        }
+        inst->ops[i].name = start;
+    }
+    return inst;
+}
+
+void params_free(ParamPlan *params){
+    for(size_t v = 0; v < params->var_count; v++)
+        free(params->vars[v]);
+    free(params->vars);
+    free(params->column);
+    free(params->names);
+    free(params->segments);
+    plan_free(&params->instance);
+    memset(params, 0, sizeof(*params));
+}
+
+int params_build(const Tree root, const ParamTable *table, const char *const *dest_dirs, size_t dest_count, unsigned int jobs, bool preflight){
+    Plan plan = { 0 };
+    ParamPlan params = { 0 };
+    int status = plan_compile(&plan, root);
+    if(status == 0)
+        status = params_compile(&params, &plan);
+    if(status == 0)
+        status = params_bind(&params, table);
+
+    // One parse, one split: each row only concatenates segments
+    bool ready = (status == 0);
+    for(size_t row = 0; ready && row < table->rows; row++){
+        const Plan *inst = params_instantiate(&params, table, row);
+        if(!inst || plan_apply_many(inst, dest_dirs, dest_count, jobs, preflight) != 0)
+            status = EXIT_FAILURE;
+    }
+
+    params_free(&params);
+    plan_free(&plan);
+    return status;
+}
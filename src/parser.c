@@ -1,29 +1,419 @@
 #include "parser.h"
 
-Tree parse_tokens(const char *path){
-    Token *toks = NULL;
-    // Configure the lexer
-    LexerConfig cfg = { .tab_width = 4, .emit_blank_newlines = false, .stop_on_first_error = false };
-    size_t ntok = lexer_tokenize_file(path, &toks, &cfg);       /* Tokenize the file */
+/* ---------------- Sibling index ----------------
+ * Open addressing table of every attached node, keyed on its parent and
+ * its name. Duplicate names under one parent are found in O(1) so they are
+ * merged (directories) or dropped (files) instead of being built twice.
+ */
+typedef struct SiblingSlot {
+    size_t hash;        // Hash of (parent, name)
+    Tree parent;        // Parent the node is attached to (shared nodes have no parent link)
+    Tree node;          // Indexed node, NULL for an empty slot
+} SiblingSlot;
+
+typedef struct SiblingIndex {
+    SiblingSlot *slots; // Slot array, capacity is a power of two
+    size_t cap;         // Number of slots
+    size_t count;       // Number of used slots
+} SiblingIndex;
+
+// Hash a name slice under a parent
+static size_t sibling_hash(const Tree parent, const char *name, size_t len){
+    return hash_bytes(name, len, hash_bytes(&parent, sizeof(parent), HASH_SEED));
+}
+
+// Find the node named name[0..len) under parent, NULL if there is none
+static Tree sibling_find(const SiblingIndex *idx, const Tree parent, const char *name, size_t len, size_t hash){
+    if(idx->cap == 0)
+        return NULL;
+
+    for(size_t i = hash & (idx->cap - 1);; i = (i + 1) & (idx->cap - 1)){
+        Tree n = idx->slots[i].node;
+        if(n == NULL)
+            return NULL;
+        if(idx->slots[i].hash == hash && idx->slots[i].parent == parent && strncmp(n->name, name, len) == 0 && n->name[len] == '\0')
+            return n;
+    }
+}
+
+// Retire the slot of a sealed node: it keeps the probe chain going but never matches again
+static void sibling_seal(SiblingIndex *idx, const Tree parent, const Tree node, size_t hash){
+    for(size_t i = hash & (idx->cap - 1); idx->slots[i].node != NULL; i = (i + 1) & (idx->cap - 1)){
+        if(idx->slots[i].node == node && idx->slots[i].parent == parent){
+            idx->slots[i].hash = 0;
+            idx->slots[i].parent = (Tree)&idx->slots[i];
+            return;
+        }
+    }
+}
+
+// Place a node in a slot array without checking the load factor
+static void sibling_place(SiblingSlot *slots, size_t cap, SiblingSlot slot){
+    size_t i = slot.hash & (cap - 1);
+    while(slots[i].node != NULL)
+        i = (i + 1) & (cap - 1);
+    slots[i] = slot;
+}
+
+// Add a node, growing the table to keep it at most 3/4 full
+static int sibling_add(SiblingIndex *idx, Tree parent, Tree node, size_t hash){
+    if((idx->count + 1) * 4 > idx->cap * 3){
+        size_t new_cap = idx->cap ? idx->cap * 2 : 64;
+        SiblingSlot *tmp = calloc(new_cap, sizeof(SiblingSlot));
+        if(!tmp){
+            fprintf(stderr, "fatal (parsing): failed to grow sibling index\n\n");
+            return EXIT_FAILURE;
+        }
+        for(size_t i = 0; i < idx->cap; i++)
+            if(idx->slots[i].node)
+                sibling_place(tmp, new_cap, idx->slots[i]);
+        free(idx->slots);
+        idx->slots = tmp;
+        idx->cap = new_cap;
+    }
+
+    sibling_place(idx->slots, idx->cap, (SiblingSlot){ hash, parent, node });
+    idx->count++;
+    return EXIT_SUCCESS;
+}
+
+/* ---------------- Include cache ----------------
+ * Every included template is parsed once per run, keyed on its real path,
+ * and its root is mounted by reference at each "@include" point. Memory and
+ * parse time follow the unique content instead of the expanded tree.
+ */
+typedef struct IncludeEntry {
+    char *key;          // Real path of the included template
+    Tree root;          // Parsed root (NULL until parsed or if parsing failed)
+    TreeStats stats;    // Entries of root, added at each mount point
+    bool loading;       // Set while the template is parsed, detects include cycles
+} IncludeEntry;
+
+static IncludeEntry *include_cache = NULL;
+static size_t include_count = 0;
+static int include_depth = 0;       // Nesting of the include being parsed, 0 for a top-level template
+static bool index_trees = false;    // Give top-level templates a path index, see parser_set_index
+static const PathFilter *path_filter = NULL;    // Prunes top-level templates, see parser_set_filter
+
+char *parser_resolve_include(const char *from, const char *target){
+    size_t dir_len = 0;
+    bool absolute = (target[0] == '/' || target[0] == PATH_SEPARATOR);
+    #ifdef _WIN32
+        absolute = absolute || (target[0] != '\0' && target[1] == ':');
+    #endif
+
+    if(!absolute){
+        for(size_t i = 0; from[i] != '\0'; i++)
+            if(from[i] == '/' || from[i] == PATH_SEPARATOR)
+                dir_len = i + 1;
+    }
+
+    size_t target_len = strlen(target);
+    char *resolved = malloc(dir_len + target_len + 1);
+    if(!resolved){
+        fprintf(stderr, "fatal (parsing): memory allocation failed for include \"%s\".\n", target);
+        return NULL;
+    }
+    memcpy(resolved, from, dir_len);
+    memcpy(resolved + dir_len, target, target_len + 1);
+    return resolved;
+}
+
+// Return the cached root of an included template and its counts, parsing it on first use
+static Tree load_include(const char *from, const char *target, TreeStats *stats){
+    char *resolved = parser_resolve_include(from, target);
+    if(!resolved)
+        return NULL;
+
+    #ifdef _WIN32
+        char *key = _fullpath(NULL, resolved, 0);
+    #else
+        char *key = realpath(resolved, NULL);
+    #endif
+    if(!key){
+        fprintf(stderr, "error (parsing): cannot open included template \"%s\".\n", resolved);
+        free(resolved);
+        return NULL;
+    }
+
+    // Look the template up in the cache
+    for(size_t i = 0; i < include_count; i++){
+        if(strcmp(include_cache[i].key, key) != 0)
+            continue;
+
+        if(include_cache[i].loading)
+            fprintf(stderr, "error (parsing): include cycle through \"%s\".\n", resolved);
+        free(key);
+        free(resolved);
+        *stats = include_cache[i].stats;
+        return include_cache[i].loading ? NULL : include_cache[i].root;
+    }
+
+    IncludeEntry *tmp = realloc(include_cache, (include_count + 1) * sizeof(IncludeEntry));
+    if(!tmp){
+        fprintf(stderr, "fatal (parsing): memory allocation failed for include \"%s\".\n", resolved);
+        free(key);
+        free(resolved);
+        return NULL;
+    }
+    include_cache = tmp;
+
+    // The cache may move while the template is parsed: keep the index only
+    size_t slot = include_count++;
+    include_cache[slot] = (IncludeEntry){ key, NULL, { 0, 0, 0 }, true };
+
+    include_depth++;
+    Tree root = parse_tokens_stats(resolved, stats);
+    include_depth--;
+    if(!is_empty_tree(root))
+        root->is_shared = true;
+
+    include_cache[slot].root = root;
+    include_cache[slot].stats = *stats;
+    include_cache[slot].loading = false;
+    free(resolved);
+    return root;
+}
+
+static unsigned int lex_jobs = 0;
+
+void parser_set_jobs(unsigned int jobs){
+    lex_jobs = jobs;
+}
+
+void parser_set_index(bool enabled){
+    index_trees = enabled;
+}
+
+void parser_set_filter(const PathFilter *filter){
+    path_filter = filter_active(filter) ? filter : NULL;
+}
+
+const PathFilter *parser_filter(void){
+    return path_filter;
+}
+
+/* ---------------- Entry attributes ---------------- */
+
+// Permission bits given in octal
+static bool read_mode(const char *text, int *mode){
+    char *end;
+    long value = strtol(text, &end, 8);
+    if(end == text || *end != '\0' || value < 0 || value > 07777)
+        return false;
+    *mode = (int)value;
+    return true;
+}
+
+// User or group given by name or numeric id, resolved once per attribute list
+static bool read_id(const char *text, bool group, long *id){
+    char *end;
+    long value = strtol(text, &end, 10);
+    if(end != text && *end == '\0' && value >= 0){
+        *id = value;
+        return true;
+    }
+    #ifndef _WIN32
+        char buf[16384];
+        if(group){
+            struct group entry, *found = NULL;
+            if(getgrnam_r(text, &entry, buf, sizeof(buf), &found) == 0 && found){
+                *id = (long)found->gr_gid;
+                return true;
+            }
+        } else {
+            struct passwd entry, *found = NULL;
+            if(getpwnam_r(text, &entry, buf, sizeof(buf), &found) == 0 && found){
+                *id = (long)found->pw_uid;
+                return true;
+            }
+        }
+    #endif
+    return false;
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date
+static long long days_from_civil(long long y, int m, int d){
+    y -= (m <= 2);
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    long long yoe = y - era * 400;
+    long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Seconds since the epoch, or a UTC date YYYY-MM-DD[THH:MM[:SS]][Z]
+static bool read_time(const char *text, long long *seconds){
+    char *end;
+    long long value = strtoll(text, &end, 10);
+    if(end != text && *end == '\0'){
+        *seconds = value;
+        return true;
+    }
+
+    int y, mo, d, h = 0, mi = 0, s = 0, n = 0;
+    if(sscanf(text, "%4d-%2d-%2d%n", &y, &mo, &d, &n) != 3)
+        return false;
+    const char *rest = text + n;
+    if(*rest == 'T'){
+        if(sscanf(rest, "T%2d:%2d%n", &h, &mi, &n) != 2)
+            return false;
+        rest += n;
+        if(*rest == ':'){
+            if(sscanf(rest, ":%2d%n", &s, &n) != 1)
+                return false;
+            rest += n;
+        }
+    }
+    if(*rest == 'Z')
+        rest++;
+    if(*rest != '\0' || mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || s > 60 || h < 0 || mi < 0 || s < 0)
+        return false;
+
+    *seconds = days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+    return true;
+}
+
+int parser_read_attrs(const char *text, const char *name, bool is_dir, EntryAttrs *attrs){
+    EntryAttrs next = *attrs;
+    char item[256];
+
+    for(const char *p = text; *p != '\0'; ){
+        if(*p == ' ' || *p == '\t'){
+            p++;
+            continue;
+        }
+        size_t n = strcspn(p, " \t");
+        snprintf(item, sizeof(item), "%.*s", (int)n, p);
+        p += n;
+
+        char *value = strchr(item, '=');
+        bool ok = (n < sizeof(item) && value && value != item && value[1] != '\0');
+        if(ok){
+            *value++ = '\0';
+            if(strcmp(item, "mode") == 0)
+                ok = read_mode(value, is_dir ? &next.dir_mode : &next.file_mode);
+            else if(strcmp(item, "dmode") == 0)
+                ok = read_mode(value, &next.dir_mode);
+            else if(strcmp(item, "fmode") == 0)
+                ok = read_mode(value, &next.file_mode);
+            else if(strcmp(item, "group") == 0)
+                ok = read_id(value, true, &next.gid);
+            else if(strcmp(item, "owner") == 0){
+                char *group = strchr(value, ':');
+                if(group)
+                    *group++ = '\0';
+                ok = (*value == '\0' || read_id(value, false, &next.uid)) && (!group || read_id(group, true, &next.gid));
+                if(group)
+                    group[-1] = ':';
+            }
+            else if(strcmp(item, "mtime") == 0)
+                ok = next.has_mtime = read_time(value, &next.mtime);
+            else
+                ok = false;
+            value[-1] = '=';
+        }
+
+        if(!ok){
+            fprintf(stderr, "warning (parsing): invalid attribute \"%s\" on \"%s\", attribute list ignored.\n", item, name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    *attrs = next;
+    return EXIT_SUCCESS;
+}
+
+// Write the path of name[0..len) under parent, relative to root, in a reusable buffer
+static const char *filter_path(char **buf, size_t *cap, const Tree root, const Tree parent, const char *name, size_t len){
+    const char *dir = (parent == root) ? "" : parent->path + strlen(root->path) + 1;
+    size_t dir_len = strlen(dir);
+    size_t need = dir_len + len + 2;
+    if(need > *cap){
+        char *tmp = realloc(*buf, need);
+        if(!tmp){
+            fprintf(stderr, "fatal (parsing): failed to grow the filter path\n\n");
+            exit(EXIT_FAILURE);
+        }
+        *buf = tmp;
+        *cap = need;
+    }
+    memcpy(*buf, dir, dir_len);
+    size_t at = dir_len;
+    if(dir_len > 0)
+        (*buf)[at++] = PATH_SEPARATOR;
+    memcpy(*buf + at, name, len);
+    (*buf)[at + len] = '\0';
+    return *buf;
+}
+
+void parser_clear_cache(void){
+    for(size_t i = 0; i < include_count; i++){
+        clean_tree(&include_cache[i].root);
+        free(include_cache[i].key);
+    }
+    free(include_cache);
+    include_cache = NULL;
+    include_count = 0;
+}
+
+const char *parser_cached_include(size_t i){
+    return i < include_count ? include_cache[i].key : NULL;
+}
 
+Tree parse_source(const char *path, TokenNext next, void *source, const ParseHooks *hooks, TreeStats *stats){
     Tree tree = NULL;
+    SiblingIndex siblings = { NULL, 0, 0 };
+    TreeStats counts = { 0, 0, HASH_SEED };    /* Kept as entries are attached, no walk afterwards */
 
     size_t stack_cap = 16;
     Tree *stack = (Tree*)calloc(stack_cap, sizeof(Tree));
     if(!stack){
         fprintf(stderr, "fatal (parsing file): failed to allocate level stack\n\n");
-        for(size_t i=0; i<ntok; ++i) 
-            token_free(&toks[i]);
-            
-        free(toks);
         exit(EXIT_FAILURE);
     }
 
     int level = 0;
+    int skip_level = -1;        /* Entries deeper than this level belong to a dropped entry */
     stack[0] = NULL;
 
-    for(size_t i=0; i<ntok; ++i){
-        Token *t = &toks[i];
+    // Included templates are mounted whole, only the including one is filtered
+    const PathFilter *filter = (include_depth == 0) ? path_filter : NULL;
+    int select_level = -1;      /* Entries deeper than this level are selected by the filter */
+    char *rel = NULL;           /* Path below the root matched against the filter */
+    size_t rel_cap = 0;
+
+    Tree last = NULL;           /* Entry just declared, the target of a following attribute list or link */
+    bool last_new = false;      /* last was attached by its declaration, not reopened */
+    Tree reported = NULL;       /* Entry waiting for on_node until its attributes are known */
+    int reported_level = 0;
+
+    for(Token tok = next(source); tok.type != T_EOF; token_free(&tok), tok = next(source)){
+        Token *t = &tok;
+
+        if(t->type == T_ATTRS){
+            // Dropped entries and included templates take no attributes
+            if(last){
+                EntryAttrs attrs = last->attrs ? *tree_attrs(last->attrs) : ENTRY_ATTRS_DEFAULT;
+                if(parser_read_attrs(t->lexeme, last->name, last->is_directory, &attrs) == 0)
+                    last->attrs = tree_attrs_intern(&attrs);
+            }
+            continue;
+        }
+
+        if(t->type == T_SYMLINK || t->type == T_HARDLINK){
+            // Only a file declared right there can become a link
+            if(last && (!last_new || !last->parent || tree_set_link(last, t->type == T_SYMLINK ? TREE_LINK_SYMBOLIC : TREE_LINK_HARD, t->lexeme) != 0))
+                fprintf(stderr, "warning (parsing): \"%s\" can not be a link, \"%s\" ignored.\n", last->name, t->lexeme);
+            last = NULL;
+            continue;
+        }
+        last = NULL;
+
+        if(reported){
+            hooks->on_node(hooks->ctx, reported, reported_level);
+            reported = NULL;
+        }
 
         if(t->type == T_INDENT){
             level++;
@@ -33,10 +423,9 @@ Tree parse_tokens(const char *path){
                 Tree *tmp = (Tree*)realloc(stack, new_cap * sizeof(Tree));
                 if(!tmp){
                     fprintf(stderr, "fatal (parsing): failed to grow level stack\n\n");
-                    for(size_t k=0; k<ntok; ++k) 
-                        token_free(&toks[k]);
-                    free(toks); 
+                    token_free(t);
                     free(stack);
+                    free(siblings.slots);
                     exit(EXIT_FAILURE);
                 }
                 for(size_t z = stack_cap; z < new_cap; ++z) tmp[z] = NULL;
@@ -53,32 +442,202 @@ Tree parse_tokens(const char *path){
         }
 
         if(t->type == T_NAME){
+            if(t->length == 0)              /* Recovery token, the lexer reported the error */
+                continue;
+            if(skip_level >= 0 && level > skip_level)
+                continue;
+            skip_level = -1;
+
             const char *name = (t->lexeme)? t->lexeme : "";
             Tree parent = (level > 0)? stack[level-1] : NULL;
-            Tree node = attach_child(parent, name);
-            if(is_empty_tree(node)) 
+
+            // Look the name up among the parent children (without the directory mark)
+            size_t len = strlen(name);
+            bool is_dir = (len > 0 && name[len - 1] == '/');
+            size_t key_len = is_dir ? len - 1 : len;
+
+            if(filter && !is_empty_tree(parent)){
+                // Pruned subtrees are skipped token by token, no node is allocated for them
+                bool selected = (select_level >= 0 && level > select_level);
+                if(!selected)
+                    select_level = -1;
+                FilterVerdict verdict = filter_check(filter, filter_path(&rel, &rel_cap, tree, parent, name, key_len), is_dir, selected);
+                if(verdict == FILTER_SKIP){
+                    skip_level = level;
+                    continue;
+                }
+                if(verdict == FILTER_SELECT && !selected)
+                    select_level = level;
+            }
+
+            size_t hash = sibling_hash(parent, name, key_len);
+            Tree node = sibling_find(&siblings, parent, name, key_len, hash);
+
+            if(node && node->is_directory != is_dir){
+                // Same name with another kind: keep the first one, drop this entry
+                fprintf(stderr, "warning (parsing): \"%.*s\" is declared both as a file and a directory, keeping the first one.\n", (int)key_len, name);
+                skip_level = level;
                 continue;
+            }
+
+            if(node && node->is_shared && is_dir){
+                // Included subtrees are shared between mount points and never modified
+                fprintf(stderr, "warning (parsing): \"%.*s\" comes from an included template and can not be extended, entry ignored.\n", (int)key_len, name);
+                skip_level = level;
+                continue;
+            }
 
-            if(is_empty_tree(tree)) 
+            if(node && node->is_sealed && is_dir){
+                // Already handed over to a builder: declare the directory again instead of extending it
+                sibling_seal(&siblings, parent, node, hash);
+                node = NULL;
+            }
+
+            if(!node && is_empty_tree(parent) && !is_empty_tree(tree)){
+                // A template has a single root, a second one would never be built
+                fprintf(stderr, "warning (parsing): \"%.*s\" is outside the root \"%s\", entry ignored.\n", (int)key_len, name, tree->path);
+                skip_level = level;
+                continue;
+            }
+
+            last_new = !node;
+            if(!node){
+                node = attach_child(parent, name);
+                if(is_empty_tree(node)){
+                    skip_level = level;
+                    continue;
+                }
+                node->attrs = parent ? parent->attrs : 0;   /* Inherited, a list may follow */
+                if(sibling_add(&siblings, parent, node, hash) != 0){
+                    token_free(t);
+                    free(stack);
+                    free(siblings.slots);
+                    exit(EXIT_FAILURE);
+                }
+                if(node->is_directory)
+                    counts.directories++;
+                else
+                    counts.files++;
+                counts.shape = hash_bytes(name, len, counts.shape ^ (size_t)level);
+            }
+
+            if(is_empty_tree(tree)){
                 tree = node;
+                // Index from the root on, attach_child and mount_subtree extend it
+                if(index_trees && include_depth == 0)
+                    tree_index(tree);
+            }
 
             stack[level] = node;
 
             for(size_t l = (size_t)level + 1; l < stack_cap; ++l) 
                 stack[l] = NULL;
 
+            last = node;
+            if(hooks && hooks->on_node){
+                reported = node;
+                reported_level = level;
+            }
             continue;
         }
 
-        if(t->type == T_EOF){
-            break;
+        if(t->type == T_INCLUDE){
+            if(skip_level >= 0 && level > skip_level)
+                continue;
+            skip_level = level;             /* Nothing can be nested under an include */
+
+            Tree parent = (level > 0)? stack[level-1] : NULL;
+            if(is_empty_tree(parent) || !parent->is_directory){
+                fprintf(stderr, "warning (parsing): \"@include %s\" must be placed inside a directory, ignored.\n", t->lexeme);
+                continue;
+            }
+
+            TreeStats sub_counts = { 0, 0, 0 };
+            Tree sub = load_include(path, t->lexeme, &sub_counts);
+            if(is_empty_tree(sub))
+                continue;
+
+            if(filter){
+                // Shared subtrees are never pruned: the include is kept or dropped as a whole
+                bool selected = (select_level >= 0 && level > select_level);
+                if(filter_check(filter, filter_path(&rel, &rel_cap, tree, parent, sub->name, strlen(sub->name)), sub->is_directory, selected) == FILTER_SKIP)
+                    continue;
+            }
+
+            // The same template included twice in one directory is mounted once
+            size_t hash = sibling_hash(parent, sub->name, strlen(sub->name));
+            Tree node = sibling_find(&siblings, parent, sub->name, strlen(sub->name), hash);
+            if(node){
+                if(node != sub)
+                    fprintf(stderr, "warning (parsing): \"%s\" already exists in \"%s\", \"@include %s\" ignored.\n", sub->name, parent->path, t->lexeme);
+                continue;
+            }
+
+            if(is_empty_tree(mount_subtree(parent, sub)) || sibling_add(&siblings, parent, sub, hash) != 0){
+                token_free(t);
+                free(stack);
+                free(siblings.slots);
+                exit(EXIT_FAILURE);
+            }
+            counts.directories += sub_counts.directories;
+            counts.files += sub_counts.files;
+            counts.shape = hash_bytes(&sub_counts.shape, sizeof(sub_counts.shape), counts.shape ^ (size_t)level);
+
+            if(hooks && hooks->on_node)
+                hooks->on_node(hooks->ctx, sub, level);
+            continue;
         }
     }
 
-    for(size_t i=0;i<ntok;++i) token_free(&toks[i]);
-    free(toks);
+    if(reported)
+        hooks->on_node(hooks->ctx, reported, reported_level);
+
     free(stack);
+    free(siblings.slots);
+    free(rel);
+    if(stats)
+        *stats = counts;
 
     return tree;
 
+}
+
+// TokenNext over a streaming lexer
+static Token next_from_lexer(void *source){
+    return lexer_next((Lexer*)source);
+}
+
+Tree parse_tokens(const char *path){
+    return parse_tokens_stats(path, NULL);
+}
+
+Tree parse_tokens_stats(const char *path, TreeStats *stats){
+    // Open the template, "-" streams it from the standard input
+    bool use_stdin = (strcmp(path, "-") == 0);
+    FILE *fp = use_stdin ? stdin : fopen(path, "rb");
+    if(!fp){
+        fprintf(stderr, "fatal (parsing): cannot open '%s'.\n", path);
+        return NULL;
+    }
+
+    // Configure the lexer: large files are lexed chunk-parallel, anything
+    // else is pulled one token at a time as the input arrives
+    uint64_t span = trace_begin();
+    LexerConfig cfg = PARSER_LEXER_CONFIG;
+    Lexer L;
+    if(!lexer_init_parallel(&L, fp, lex_jobs, &cfg))
+        lexer_init_stream(&L, lexer_read_file, fp, &cfg);
+
+    Tree tree = parse_source(path, next_from_lexer, &L, NULL, stats);
+
+    // Report what the lexer collected along the way
+    for(size_t e = 0; e < lexer_error_count(&L); e++)
+        lex_error_print(&lexer_errors(&L)[e], path);
+
+    lexer_free(&L);
+    if(!use_stdin)
+        fclose(fp);
+
+    trace_end(span, "parse", path);
+    return tree;
 }
\ No newline at end of file
@@ -0,0 +1,392 @@
+#include "pipeline.h"
+
+#ifndef _WIN32
+/* ---------------- Token ring ----------------
+ * Single-producer/single-consumer ring of token batches. The lexer thread
+ * owns tail, the parser owns head; each side publishes its index with a
+ * release store and reads the other one with an acquire load.
+ */
+typedef struct TokenBatch {
+    Token toks[PIPELINE_BATCH];     // Tokens, moved by value to the parser
+    size_t count;                   // Tokens in this batch (at least 1)
+} TokenBatch;
+
+typedef struct TokenRing {
+    TokenBatch slots[PIPELINE_RING];
+    atomic_size_t head;             // Next batch to read
+    atomic_size_t tail;             // Next batch to write
+} TokenRing;
+
+// Wait politely for the other side: spin, then yield, then sleep
+static void ring_backoff(unsigned int *spins){
+    (*spins)++;
+    if(*spins < 64)
+        return;
+    if(*spins < 128){
+        sched_yield();
+        return;
+    }
+    struct timespec ts = { 0, 50000 };
+    nanosleep(&ts, NULL);
+}
+
+/* ---------------- Lexer stage ---------------- */
+typedef struct LexStage {
+    Lexer L;                        // Streaming lexer
+    TokenRing *ring;                // Output ring
+} LexStage;
+
+// Lexer thread: fill batches until the T_EOF token is pushed
+static void *lex_stage_run(void *arg){
+    LexStage *st = arg;
+    TokenRing *ring = st->ring;
+    uint64_t span = trace_begin();
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    bool done = false;
+
+    while(!done){
+        unsigned int spins = 0;
+        while(tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPELINE_RING)
+            ring_backoff(&spins);
+
+        TokenBatch *batch = &ring->slots[tail & (PIPELINE_RING - 1)];
+        batch->count = 0;
+        while(batch->count < PIPELINE_BATCH && !done){
+            Token t = lexer_next(&st->L);
+            batch->toks[batch->count++] = t;
+            done = (t.type == T_EOF);
+        }
+
+        atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+    }
+
+    trace_end(span, "lex", NULL);
+    return NULL;
+}
+
+/* ---------------- Parser side of the ring ---------------- */
+typedef struct RingReader {
+    TokenRing *ring;                // Input ring
+    size_t head;                    // Batch being read
+    size_t pos;                     // Next token in the batch
+    bool holding;                   // A batch is being read
+} RingReader;
+
+// TokenNext over the ring
+static Token ring_next(void *source){
+    RingReader *rd = source;
+    TokenRing *ring = rd->ring;
+
+    if(rd->holding){
+        TokenBatch *batch = &ring->slots[rd->head & (PIPELINE_RING - 1)];
+        if(rd->pos < batch->count)
+            return batch->toks[rd->pos++];
+
+        // Batch consumed, hand the slot back to the lexer
+        rd->holding = false;
+        atomic_store_explicit(&ring->head, ++rd->head, memory_order_release);
+    }
+
+    unsigned int spins = 0;
+    while(atomic_load_explicit(&ring->tail, memory_order_acquire) == rd->head)
+        ring_backoff(&spins);
+
+    rd->holding = true;
+    rd->pos = 1;
+    return ring->slots[rd->head & (PIPELINE_RING - 1)].toks[0];
+}
+
+/* ---------------- Build stage ----------------
+ * Mirrors the parser position with a stack of open entries. When an entry
+ * is complete and its parent already exists on disk, the whole subtree is
+ * sealed and queued to the builders. The root is created right away, and an
+ * open directory is created early once it gathers PIPELINE_SPLIT entries,
+ * so huge directories are split into independent child subtrees.
+ */
+typedef struct BuildFrame {
+    Tree node;                      // Open entry
+    int depth;                      // Parser depth of the entry
+    size_t start;                   // Entries seen when it was opened
+} BuildFrame;
+
+typedef struct BuildStage {
+    const char *dest_dir;           // Destination directory
+    ThreadPool pool;                // Builder workers
+    atomic_int status;              // Shared failure flag
+    BuildFrame *frames;             // Open entries, outermost first
+    size_t depth;                   // Number of open entries
+    size_t cap;                     // Frame capacity
+    size_t created;                 // Open entries already created (a prefix of frames)
+    size_t count;                   // Entries seen so far
+    Tree *early;                    // Directories created early with attributes, set once the pool drains
+    size_t early_count;             // Number of early directories
+    struct BuildTask **held;        // Subtrees holding hard links, queued once the whole tree is parsed
+    size_t held_count;              // Number of held subtrees
+} BuildStage;
+
+typedef struct BuildTask {
+    Tree node;                      // Subtree to build
+    char *base;                     // Base path of the subtree
+    atomic_int *status;             // Shared failure flag
+} BuildTask;
+
+// Pool task: create a complete subtree, directories first
+static void build_task_run(void *arg){
+    BuildTask *task = arg;
+    // Single files are only traced by their calls, when slow
+    uint64_t span = task->node->is_directory ? trace_begin() : 0;
+
+    if(task->node->is_directory && build_directory_recursive(task->node, task->base) != 0)
+        atomic_store(task->status, EXIT_FAILURE);
+    if(build_file_recursive(task->node, task->base) != 0)
+        atomic_store(task->status, EXIT_FAILURE);
+    trace_end(span, "build subtree", task->node->path);
+
+    free(task->base);
+    free(task);
+}
+
+static TreeWalkAction find_hardlink(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    (void)parent;
+    (void)ctx;
+    return frame->node->link == TREE_LINK_HARD ? TREE_WALK_STOP : TREE_WALK_CONTINUE;
+}
+
+// Hard link targets are resolved against the whole tree (see tree_link_resolve), which the parser is still growing
+static bool subtree_has_hardlink(Tree node){
+    TreeVisitor visitor = { find_hardlink, NULL, NULL };
+    return tree_walk(node, &visitor) != 0;
+}
+
+// Seal a complete subtree and queue it
+static void stage_emit(BuildStage *st, Tree node, Tree parent){
+    if(!node->is_shared)            /* Shared subtrees are immutable already */
+        node->is_sealed = true;
+
+    BuildTask *task = malloc(sizeof(BuildTask));
+    // Shared subtrees are rebased on their mount point like in build_child
+    char *base = node->is_shared ? build_full_path(parent, st->dest_dir) : strdup(st->dest_dir);
+    if(!task || !base){
+        fprintf(stderr, "fatal (pipeline): memory allocation failed for \"%s\".\n", node->path);
+        atomic_store(&st->status, EXIT_FAILURE);
+        free(task);
+        free(base);
+        return;
+    }
+
+    task->node = node;
+    task->base = base;
+    task->status = &st->status;
+    if(subtree_has_hardlink(node)){
+        BuildTask **tmp = realloc(st->held, (st->held_count + 1) * sizeof(BuildTask *));
+        if(tmp){
+            st->held = tmp;
+            st->held[st->held_count++] = task;
+            return;
+        }
+        fprintf(stderr, "fatal (pipeline): memory allocation failed for \"%s\".\n", node->path);
+        atomic_store(&st->status, EXIT_FAILURE);
+        free(base);
+        free(task);
+        return;
+    }
+    if(pool_submit(&st->pool, build_task_run, task) != 0){
+        atomic_store(&st->status, EXIT_FAILURE);
+        free(base);
+        free(task);
+    }
+}
+
+// Create the next open directory and queue its children that are already complete
+static void stage_create_next(BuildStage *st){
+    BuildFrame *f = &st->frames[st->created];
+    char *full_path = build_full_path(f->node, st->dest_dir);
+    if(!full_path || create_folder(full_path) != 0)
+        atomic_store(&st->status, EXIT_FAILURE);
+    free(full_path);
+
+    // Its children are built by the workers: the attributes wait until they are all done
+    if(f->node->attrs != 0){
+        Tree *tmp = realloc(st->early, (st->early_count + 1) * sizeof(Tree));
+        if(!tmp){
+            fprintf(stderr, "fatal (pipeline): memory allocation failed for \"%s\".\n", f->node->path);
+            atomic_store(&st->status, EXIT_FAILURE);
+        } else {
+            st->early = tmp;
+            st->early[st->early_count++] = f->node;
+        }
+    }
+
+    Tree open_child = (st->created + 1 < st->depth) ? st->frames[st->created + 1].node : NULL;
+    for(size_t i = 0; i < f->node->child_count; i++){
+        Tree child = f->node->children[i];
+        if(child && child != open_child && !child->is_sealed)
+            stage_emit(st, child, f->node);
+    }
+
+    st->created++;
+}
+
+// Close the innermost open entry
+static void stage_close(BuildStage *st){
+    st->depth--;
+    if(st->created > st->depth){
+        // Created early: its children were queued one by one
+        st->created = st->depth;
+        return;
+    }
+
+    // Sealed entries (a repeated file) are queued already
+    Tree node = st->frames[st->depth].node;
+    if(st->depth > 0 && st->created == st->depth && !node->is_sealed)
+        stage_emit(st, node, st->frames[st->depth - 1].node);
+}
+
+// ParseHooks callback
+static void stage_on_node(void *ctx, Tree node, int depth){
+    BuildStage *st = ctx;
+
+    // Every entry at this depth or deeper is complete
+    while(st->depth > 0 && st->frames[st->depth - 1].depth >= depth)
+        stage_close(st);
+
+    if(st->depth == st->cap){
+        size_t new_cap = st->cap ? st->cap * 2 : 16;
+        BuildFrame *tmp = realloc(st->frames, new_cap * sizeof(BuildFrame));
+        if(!tmp){
+            fprintf(stderr, "fatal (pipeline): failed to grow the open entries stack\n");
+            exit(EXIT_FAILURE);
+        }
+        st->frames = tmp;
+        st->cap = new_cap;
+    }
+    st->frames[st->depth++] = (BuildFrame){ node, depth, st->count++ };
+
+    // The root is created right away, big directories once they are worth splitting
+    if(st->created < st->depth){
+        BuildFrame *f = &st->frames[st->created];
+        bool splittable = f->node->is_directory && !f->node->is_shared;
+        if(splittable && (st->created == 0 || st->count - f->start >= PIPELINE_SPLIT))
+            stage_create_next(st);
+    }
+}
+// Open the directory at path below dest_fd one name at a time, without following a symbolic link
+static int stage_open_dir(int dest_fd, const char *path){
+    char *copy = strdup(path), *save = NULL;
+    int fd = (dest_fd >= 0 && copy) ? fcntl(dest_fd, F_DUPFD_CLOEXEC, 0) : -1;
+    for(char *name = copy ? strtok_r(copy, "/", &save) : NULL; fd >= 0 && name; name = strtok_r(NULL, "/", &save)){
+        int next = open_folder_at(fd, name);
+        close(fd);
+        fd = next;
+    }
+    if(fd < 0)
+        fprintf(stderr, "error : failed to open directory \"%s\".\n", path);
+    free(copy);
+    return fd;
+}
+#endif
+
+int pipeline_build(const char *path, const char *dest_dir, unsigned int jobs){
+    #ifndef _WIN32
+        bool use_stdin = (strcmp(path, "-") == 0);
+        FILE *fp = use_stdin ? stdin : fopen(path, "rb");
+        if(!fp){
+            fprintf(stderr, "fatal (pipeline): cannot open '%s'.\n", path);
+            return EXIT_FAILURE;
+        }
+
+        LexStage lex;
+        LexerConfig cfg = PARSER_LEXER_CONFIG;
+        lexer_init_stream(&lex.L, lexer_read_file, fp, &cfg);
+        lex.ring = malloc(sizeof(TokenRing));
+
+        BuildStage st = { .dest_dir = dest_dir };
+        atomic_init(&st.status, EXIT_SUCCESS);
+
+        if(!lex.ring || pool_init(&st.pool, jobs) != 0){
+            fprintf(stderr, "fatal (pipeline): failed to set up the pipeline.\n");
+            free(lex.ring);
+            lexer_free(&lex.L);
+            if(!use_stdin)
+                fclose(fp);
+            return EXIT_FAILURE;
+        }
+        atomic_init(&lex.ring->head, 0);
+        atomic_init(&lex.ring->tail, 0);
+
+        pthread_t lexer_thread;
+        if(pthread_create(&lexer_thread, NULL, lex_stage_run, &lex) != 0){
+            fprintf(stderr, "fatal (pipeline): failed to start the lexer thread.\n");
+            pool_destroy(&st.pool);
+            free(lex.ring);
+            lexer_free(&lex.L);
+            if(!use_stdin)
+                fclose(fp);
+            return EXIT_FAILURE;
+        }
+
+        // Parse in this thread while the lexer and the builders run
+        RingReader reader = { lex.ring, 0, 0, false };
+        ParseHooks hooks = { stage_on_node, &st };
+        uint64_t span = trace_begin();
+        Tree tree = parse_source(path, ring_next, &reader, &hooks, NULL);
+        trace_end(span, "parse", path);
+
+        // Everything still open is complete now
+        while(st.depth > 0)
+            stage_close(&st);
+
+        // The tree is complete: the subtrees holding hard links can resolve their targets
+        for(size_t i = 0; i < st.held_count; i++){
+            if(pool_submit(&st.pool, build_task_run, st.held[i]) != 0){
+                atomic_store(&st.status, EXIT_FAILURE);
+                free(st.held[i]->base);
+                free(st.held[i]);
+            }
+        }
+
+        pthread_join(lexer_thread, NULL);
+        pool_wait(&st.pool);
+        pool_destroy(&st.pool);
+
+        // Innermost first; only the root and split directories get here
+        int dest_fd = st.early_count > 0 ? open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+        for(size_t i = st.early_count; i-- > 0; ){
+            int fd = stage_open_dir(dest_fd, st.early[i]->path);
+            if(fd < 0 || apply_folder_attrs(fd, st.early[i]->name, tree_attrs(st.early[i]->attrs)) != 0)
+                atomic_store(&st.status, EXIT_FAILURE);
+            if(fd >= 0)
+                close(fd);
+        }
+        if(dest_fd >= 0)
+            close(dest_fd);
+
+        for(size_t e = 0; e < lexer_error_count(&lex.L); e++)
+            lex_error_print(&lexer_errors(&lex.L)[e], path);
+
+        int status = atomic_load(&st.status);
+        if(is_empty_tree(tree)){
+            fprintf(stderr, "fatal (pipeline): tree is empty, nothing to create.\n");
+            status = EXIT_FAILURE;
+        }
+
+        clean_tree(&tree);
+        free(st.frames);
+        free(st.early);
+        free(st.held);
+        free(lex.ring);
+        lexer_free(&lex.L);
+        if(!use_stdin)
+            fclose(fp);
+        return status;
+    #else
+        // No threads: parse then build
+        (void)jobs;
+        Tree tree = parse_tokens(path);
+        if(is_empty_tree(tree))
+            return EXIT_FAILURE;
+        int status = build_tree(tree, dest_dir);
+        clean_tree(&tree);
+        return status;
+    #endif
+}
@@ -0,0 +1,688 @@
+#include "plan.h"
+
+/* Files created by one pool task at most */
+#define PLAN_TASK_FILES 4096
+
+// Append str to the name table, its offset goes to *offset
+static int plan_add_name(Plan *plan, const char *str, uint64_t *offset){
+    size_t n = strlen(str) + 1;
+    if(plan->names_len + n > plan->names_cap){
+        size_t new_cap = plan->names_cap ? plan->names_cap : 4096;
+        while(new_cap < plan->names_len + n)
+            new_cap *= 2;
+        char *tmp = realloc(plan->names, new_cap);
+        if(!tmp){
+            fprintf(stderr, "fatal (plan): failed to grow the name table.\n");
+            return EXIT_FAILURE;
+        }
+        plan->names = tmp;
+        plan->names_cap = new_cap;
+    }
+
+    memcpy(plan->names + plan->names_len, str, n);
+    *offset = (uint64_t)plan->names_len;
+    plan->names_len += n;
+    return EXIT_SUCCESS;
+}
+
+// Append an operation, its name and its link target (NULL for none)
+static int plan_add(Plan *plan, PlanKind kind, uint32_t parent, const char *name, uint32_t attrs, const char *target){
+    if(plan->count >= PLAN_ROOT){
+        fprintf(stderr, "fatal (plan): too many operations.\n");
+        return EXIT_FAILURE;
+    }
+
+    if(plan->count == plan->cap){
+        size_t new_cap = plan->cap ? plan->cap * 2 : 256;
+        PlanOp *tmp = realloc(plan->ops, new_cap * sizeof(PlanOp));
+        if(!tmp){
+            fprintf(stderr, "fatal (plan): failed to grow the operation log.\n");
+            return EXIT_FAILURE;
+        }
+        plan->ops = tmp;
+        plan->cap = new_cap;
+    }
+
+    PlanOp op = { parent, (uint32_t)kind, 0, attrs, 0, 0 };
+    if(plan_add_name(plan, name, &op.name) != 0 || (target && plan_add_name(plan, target, &op.target) != 0))
+        return EXIT_FAILURE;
+    plan->ops[plan->count++] = op;
+    return EXIT_SUCCESS;
+}
+
+/* State of a compile walk */
+typedef struct PlanWalk {
+    Plan *plan;                     // Plan being extended
+    uint32_t next_dir;              // Files pass: op index of the next directory, in pre-order
+    int status;                     // First failure
+} PlanWalk;
+
+// First pass: directories in pre-order, like build_directory_recursive
+// The root is always a directory, like in build_tree
+static TreeWalkAction compile_dirs_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    PlanWalk *walk = ctx;
+    if(parent && !frame->node->is_directory)
+        return TREE_WALK_SKIP;
+
+    frame->mark = walk->plan->count;
+    if(plan_add(walk->plan, PLAN_MKDIR, parent ? (uint32_t)parent->mark : PLAN_ROOT, frame->node->name, frame->node->attrs, NULL) != 0){
+        walk->status = EXIT_FAILURE;
+        return TREE_WALK_STOP;
+    }
+    return TREE_WALK_CONTINUE;
+}
+
+// Second pass: files, walking the directories in the same order to find their op index
+static TreeWalkAction compile_files_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    PlanWalk *walk = ctx;
+    Tree node = frame->node;
+
+    if(!parent || node->is_directory){
+        frame->mark = walk->next_dir++;
+        return TREE_WALK_CONTINUE;
+    }
+
+    // A hard link is replayed from its target, which must be a file of the template like in build_tree
+    if(node->link == TREE_LINK_HARD && !tree_link_resolve(node)){
+        fprintf(stderr, "fatal (plan): \"%s\" links to \"%s\", which is not a file of the template.\n", node->path, node->target);
+        walk->status = EXIT_FAILURE;
+        return TREE_WALK_STOP;
+    }
+    PlanKind kind = (node->link == TREE_LINK_SYMBOLIC) ? PLAN_SYMLINK : (node->link == TREE_LINK_HARD) ? PLAN_HARDLINK : PLAN_CREATE;
+    if(plan_add(walk->plan, kind, (uint32_t)parent->mark, node->name, node->attrs, node->link != TREE_LINK_NONE ? node->target : NULL) != 0){
+        walk->status = EXIT_FAILURE;
+        return TREE_WALK_STOP;
+    }
+    if(node->child_count > 0)
+        fprintf(stderr, "warning (plan): entries under the file \"%s\" can not be created, left out.\n", node->path);
+    return TREE_WALK_SKIP;
+}
+
+int plan_compile(Plan *plan, const Tree root){
+    if(is_empty_tree(root)){
+        fprintf(stderr, "fatal (plan): tree is empty, nothing to plan.\n");
+        return EXIT_FAILURE;
+    }
+
+    PlanWalk walk = { plan, (uint32_t)plan->count, EXIT_SUCCESS };
+    TreeVisitor dirs = { compile_dirs_pre, NULL, &walk };
+    TreeVisitor files = { compile_files_pre, NULL, &walk };
+    if(tree_walk(root, &dirs) != 0 || tree_walk(root, &files) != 0)
+        return EXIT_FAILURE;
+    return walk.status;
+}
+
+// Relative path of op index, built in *buf (grown as needed); returns its length, 0 on failure
+static size_t plan_path(const Plan *plan, uint32_t index, char **buf, size_t *cap){
+    size_t len = 0;
+    for(uint32_t i = index; i != PLAN_ROOT; i = plan->ops[i].parent)
+        len += strlen(plan->names + plan->ops[i].name) + 1;
+
+    if(len > *cap){
+        char *tmp = realloc(*buf, len);
+        if(!tmp){
+            fprintf(stderr, "fatal (plan): memory allocation failed for a path.\n");
+            return 0;
+        }
+        *buf = tmp;
+        *cap = len;
+    }
+
+    // Fill from the end, the last separator slot holds the terminator
+    size_t end = len - 1;
+    (*buf)[end] = '\0';
+    for(uint32_t i = index; i != PLAN_ROOT; i = plan->ops[i].parent){
+        const char *name = plan->names + plan->ops[i].name;
+        size_t n = strlen(name);
+        end -= n;
+        memcpy(*buf + end, name, n);
+        if(end > 0)
+            (*buf)[--end] = PATH_SEPARATOR;
+    }
+    return len - 1;
+}
+
+int plan_write(const Plan *plan, const char *path){
+    bool use_stdout = (strcmp(path, "-") == 0);
+    FILE *fp = use_stdout ? stdout : fopen(path, "wb");
+    if(!fp){
+        fprintf(stderr, "fatal (plan): cannot open '%s' for writing.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // Interned ids only hold in this process: number the sets the ops use, in order of first use
+    uint32_t max_id = 0;
+    for(size_t i = 0; i < plan->count; i++)
+        if(plan->ops[i].attrs > max_id)
+            max_id = plan->ops[i].attrs;
+    uint32_t *index = calloc((size_t)max_id + 1, sizeof(uint32_t));
+    PlanAttrs *table = malloc(((size_t)max_id + 1) * sizeof(PlanAttrs));
+    uint32_t attrs_count = 0;
+    for(size_t i = 0; index && table && i < plan->count; i++){
+        uint32_t id = plan->ops[i].attrs;
+        if(id == 0 || index[id] != 0)
+            continue;
+        const EntryAttrs *a = tree_attrs(id);
+        table[attrs_count] = (PlanAttrs){ a->dir_mode, a->file_mode, a->uid, a->gid, a->mtime, a->has_mtime ? 1 : 0, 0 };
+        index[id] = ++attrs_count;
+    }
+
+    PlanHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.byte_order = PLAN_BYTE_ORDER;
+    header.attrs_count = attrs_count;
+    header.op_count = plan->count;
+    header.names_len = plan->names_len;
+
+    bool ok = index && table && fwrite(&header, sizeof(header), 1, fp) == 1;
+    for(size_t i = 0; ok && i < plan->count; i++){
+        PlanOp op = plan->ops[i];
+        op.attrs = index[op.attrs];
+        ok = fwrite(&op, sizeof(op), 1, fp) == 1;
+    }
+    ok = ok && (attrs_count == 0 || fwrite(table, sizeof(PlanAttrs), attrs_count, fp) == attrs_count)
+            && (plan->names_len == 0 || fwrite(plan->names, 1, plan->names_len, fp) == plan->names_len);
+    ok = ((use_stdout ? fflush(fp) : fclose(fp)) == 0) && ok;
+    free(index);
+    free(table);
+
+    if(!ok){
+        fprintf(stderr, "fatal (plan): failed to write '%s'.\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// A plan entry must stay inside its parent directory
+static bool plan_valid_name(const char *name){
+    return name[0] != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0
+        && !strchr(name, '/') && !strchr(name, '\\');
+}
+
+static int plan_validate(const Plan *plan){
+    if(plan->count > 0 && (plan->names_len == 0 || plan->names[plan->names_len - 1] != '\0'))
+        return EXIT_FAILURE;
+
+    for(size_t i = 0; i < plan->count; i++){
+        const PlanOp *op = &plan->ops[i];
+        if(op->kind < PLAN_MKDIR || op->kind > PLAN_HARDLINK || op->reserved != 0)
+            return EXIT_FAILURE;
+        if(op->name >= plan->names_len || !plan_valid_name(plan->names + op->name))
+            return EXIT_FAILURE;
+        if(op->parent != PLAN_ROOT && (op->parent >= i || plan->ops[op->parent].kind != PLAN_MKDIR))
+            return EXIT_FAILURE;
+
+        // Links live in a directory; a hard link target must not climb above the top-level one
+        bool link = (op->kind == PLAN_SYMLINK || op->kind == PLAN_HARDLINK);
+        if(link ? (op->parent == PLAN_ROOT || op->target == 0 || op->target >= plan->names_len || plan->names[op->target] == '\0') : op->target != 0)
+            return EXIT_FAILURE;
+        if(op->kind == PLAN_HARDLINK){
+            size_t levels = 0;
+            for(uint32_t p = op->parent; p != PLAN_ROOT; p = plan->ops[p].parent)
+                levels++;
+            if(!tree_link_inside(plan->names + op->target, levels))
+                return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Intern the attribute sets read from a plan file and give their ids to the ops
+static int plan_intern_attrs(Plan *plan, const PlanAttrs *table, size_t count){
+    uint32_t *ids = malloc((count + 1) * sizeof(uint32_t));
+    if(!ids)
+        return EXIT_FAILURE;
+
+    ids[0] = 0;
+    int status = EXIT_SUCCESS;
+    for(size_t i = 0; i < count && status == EXIT_SUCCESS; i++){
+        const PlanAttrs *a = &table[i];
+        if(a->dir_mode < -1 || a->dir_mode > 07777 || a->file_mode < -1 || a->file_mode > 07777
+           || a->uid < -1 || a->gid < -1 || a->has_mtime > 1 || a->reserved != 0){
+            status = EXIT_FAILURE;
+            break;
+        }
+        EntryAttrs attrs = { a->dir_mode, a->file_mode, (long)a->uid, (long)a->gid, (long long)a->mtime, a->has_mtime != 0 };
+        ids[i + 1] = tree_attrs_intern(&attrs);
+    }
+    for(size_t i = 0; i < plan->count && status == EXIT_SUCCESS; i++){
+        if(plan->ops[i].attrs > count)
+            status = EXIT_FAILURE;
+        else
+            plan->ops[i].attrs = ids[plan->ops[i].attrs];
+    }
+    free(ids);
+    return status;
+}
+
+int plan_read(Plan *plan, const char *path){
+    memset(plan, 0, sizeof(*plan));
+
+    bool use_stdin = (strcmp(path, "-") == 0);
+    FILE *fp = use_stdin ? stdin : fopen(path, "rb");
+    if(!fp){
+        fprintf(stderr, "fatal (plan): cannot open '%s'.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    PlanHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1
+           && memcmp(header.magic, PLAN_MAGIC, sizeof(header.magic)) == 0
+           && header.byte_order == PLAN_BYTE_ORDER
+           && header.op_count < PLAN_ROOT;
+
+    // A regular file must hold exactly what the header announces
+    struct stat st;
+    if(ok && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode))
+        ok = (uint64_t)st.st_size == sizeof(header) + header.op_count * sizeof(PlanOp) + (uint64_t)header.attrs_count * sizeof(PlanAttrs) + header.names_len;
+
+    if(ok){
+        plan->count = plan->cap = (size_t)header.op_count;
+        plan->names_len = plan->names_cap = (size_t)header.names_len;
+        plan->ops = malloc(plan->count * sizeof(PlanOp) + 1);
+        plan->names = malloc(plan->names_len + 1);
+        PlanAttrs *table = malloc((size_t)header.attrs_count * sizeof(PlanAttrs) + 1);
+        ok = plan->ops && plan->names && table
+          && fread(plan->ops, sizeof(PlanOp), plan->count, fp) == plan->count
+          && fread(table, sizeof(PlanAttrs), header.attrs_count, fp) == header.attrs_count
+          && fread(plan->names, 1, plan->names_len, fp) == plan->names_len
+          && plan_validate(plan) == 0
+          && plan_intern_attrs(plan, table, header.attrs_count) == 0;
+        free(table);
+    }
+
+    if(!use_stdin)
+        fclose(fp);
+    if(!ok){
+        fprintf(stderr, "fatal (plan): '%s' is not a valid plan for this machine.\n", path);
+        plan_free(plan);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+#ifndef _WIN32
+/* Destination being replayed, freed by the last task using its descriptor */
+typedef struct PlanDest {
+    const Plan *plan;               // Plan being applied
+    const char *path;               // Destination directory
+    int fd;                         // Descriptor, -1 until the directory pass opens it
+    atomic_size_t pending;          // Queued file runs + 1 for the directory pass
+    ThreadPool *pool;               // Pool shared by every destination
+    atomic_int *status;             // Shared failure flag
+} PlanDest;
+
+/* Run of file creations sharing a parent directory */
+typedef struct PlanFiles {
+    PlanDest *dest;                 // Destination of the run
+    size_t first;                   // First op of the run
+    size_t count;                   // Ops in the run
+    char *dir;                      // Parent directory relative to the destination, NULL for the destination itself
+} PlanFiles;
+
+/* Directory on the pre-order path of the directory pass */
+typedef struct PlanDir {
+    uint32_t op;                    // PLAN_MKDIR op
+    int fd;                         // Descriptor, -1 until a child needs it
+} PlanDir;
+
+static int plan_dir_push(PlanDir **stack, size_t *depth, size_t *cap, PlanDir dir){
+    if(*depth == *cap){
+        size_t new_cap = *cap ? *cap * 2 : 16;
+        PlanDir *tmp = realloc(*stack, new_cap * sizeof(PlanDir));
+        if(!tmp){
+            fprintf(stderr, "fatal (plan): failed to grow the directory stack.\n");
+            return EXIT_FAILURE;
+        }
+        *stack = tmp;
+        *cap = new_cap;
+    }
+    (*stack)[(*depth)++] = dir;
+    return EXIT_SUCCESS;
+}
+
+// Open the directory created by op index one name at a time from dest_fd, no symbolic link is followed
+static int plan_open_dir(const Plan *plan, int dest_fd, uint32_t index){
+    size_t depth = 0;
+    for(uint32_t i = index; i != PLAN_ROOT; i = plan->ops[i].parent)
+        depth++;
+    uint32_t *chain = malloc((depth + 1) * sizeof(uint32_t));
+    if(!chain)
+        return -1;
+    size_t d = depth;
+    for(uint32_t i = index; i != PLAN_ROOT; i = plan->ops[i].parent)
+        chain[--d] = i;
+
+    int fd = fcntl(dest_fd, F_DUPFD_CLOEXEC, 0);
+    for(d = 0; d < depth && fd >= 0; d++){
+        int next = open_folder_at(fd, plan->names + plan->ops[chain[d]].name);
+        close(fd);
+        fd = next;
+    }
+    free(chain);
+    return fd;
+}
+
+// Every entry of the destination exists: set the directory attributes, innermost first
+static void plan_dest_attrs(PlanDest *dest){
+    const Plan *plan = dest->plan;
+    for(size_t i = plan->count; i-- > 0; ){
+        const PlanOp *op = &plan->ops[i];
+        if(op->kind != PLAN_MKDIR || op->attrs == 0)
+            continue;
+        int fd = plan_open_dir(plan, dest->fd, (uint32_t)i);
+        if(fd < 0)
+            fprintf(stderr, "error (plan): cannot open directory \"%s\".\n", plan->names + op->name);
+        if(fd < 0 || apply_folder_attrs(fd, plan->names + op->name, tree_attrs(op->attrs)) != 0)
+            atomic_store(dest->status, EXIT_FAILURE);
+        if(fd >= 0)
+            close(fd);
+    }
+}
+
+// Drop one reference, the last one sets the directory attributes and closes the destination
+static void plan_dest_release(PlanDest *dest){
+    if(atomic_fetch_sub(&dest->pending, 1) != 1)
+        return;
+    if(dest->fd >= 0){
+        plan_dest_attrs(dest);
+        close(dest->fd);
+    }
+    free(dest);
+}
+
+// Pool task: create a run of files
+static void plan_files_run(void *arg){
+    PlanFiles *task = arg;
+    PlanDest *dest = task->dest;
+    const Plan *plan = dest->plan;
+    uint64_t span = trace_begin();
+
+    int dirfd = task->dir ? plan_open_dir(plan, dest->fd, plan->ops[task->first].parent) : dest->fd;
+    if(dirfd < 0){
+        fprintf(stderr, "error (plan): cannot open directory \"%s\".\n", task->dir);
+        atomic_store(dest->status, EXIT_FAILURE);
+    } else {
+        for(size_t i = task->first; i < task->first + task->count; i++)
+            if(plan->ops[i].kind == PLAN_CREATE && create_file_attrs_at(dirfd, plan->names + plan->ops[i].name, tree_attrs(plan->ops[i].attrs)) != 0)
+                atomic_store(dest->status, EXIT_FAILURE);
+
+        // Links after the files of the run; a hard link target in another run (or declared later) is created here
+        // and found by its own create, like in build_hardlink
+        for(size_t i = task->first; i < task->first + task->count; i++){
+            const PlanOp *op = &plan->ops[i];
+            const char *name = plan->names + op->name, *target = plan->names + op->target;
+            if(op->kind == PLAN_SYMLINK && create_symlink_at(dirfd, name, target) != 0)
+                atomic_store(dest->status, EXIT_FAILURE);
+            else if(op->kind == PLAN_HARDLINK && link_file_beneath(dirfd, target, name, true) != 0){
+                fprintf(stderr, "error (plan): failed to link \"%s\" to \"%s\" (%s).\n", name, target, strerror(errno));
+                atomic_store(dest->status, EXIT_FAILURE);
+            }
+        }
+        if(task->dir)
+            close(dirfd);
+    }
+
+    trace_end(span, "plan files", task->dir ? task->dir : dest->path);
+    free(task->dir);
+    free(task);
+    plan_dest_release(dest);
+}
+
+// Pool task: create the directories of a destination in order, queueing its file runs
+static void plan_dest_run(void *arg){
+    PlanDest *dest = arg;
+    const Plan *plan = dest->plan;
+    atomic_int *status = dest->status;
+    uint64_t span = trace_begin();
+
+    dest->fd = open(dest->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dest->fd < 0){
+        fprintf(stderr, "fatal (plan): cannot open destination \"%s\".\n", dest->path);
+        atomic_store(status, EXIT_FAILURE);
+        plan_dest_release(dest);
+        return;
+    }
+
+    char *path = NULL;
+    size_t path_cap = 0;
+    PlanDir *stack = NULL;
+    size_t depth = 0, stack_cap = 0;
+
+    for(size_t i = 0; i < plan->count; ){
+        const PlanOp *op = &plan->ops[i];
+
+        if(op->kind == PLAN_MKDIR){
+            // Leave the directories that are not ancestors of this one
+            while(depth > 0 && stack[depth - 1].op != op->parent){
+                if(stack[depth - 1].fd >= 0)
+                    close(stack[depth - 1].fd);
+                depth--;
+            }
+            int parent_fd = dest->fd;
+            if(op->parent != PLAN_ROOT){
+                if(depth == 0){
+                    // Parent not on the pre-order path (hand-ordered plan): reach it by its path
+                    int fd = plan_open_dir(plan, dest->fd, op->parent);
+                    if(fd < 0){
+                        fprintf(stderr, "error (plan): cannot open the parent of \"%s\".\n", plan->names + op->name);
+                        atomic_store(status, EXIT_FAILURE);
+                        i++;
+                        continue;
+                    }
+                    if(plan_dir_push(&stack, &depth, &stack_cap, (PlanDir){ op->parent, fd }) != 0){
+                        close(fd);
+                        atomic_store(status, EXIT_FAILURE);
+                        break;
+                    }
+                }
+
+                // Every directory below the top was opened when its child was created
+                PlanDir *top = &stack[depth - 1];
+                if(top->fd < 0)
+                    top->fd = open_folder_at(depth > 1 ? stack[depth - 2].fd : dest->fd, plan->names + plan->ops[top->op].name);
+                parent_fd = top->fd;
+            }
+
+            if(parent_fd < 0 || create_folder_attrs_at(parent_fd, plan->names + op->name, tree_attrs(op->attrs)) != 0)
+                atomic_store(status, EXIT_FAILURE);
+
+            if(plan_dir_push(&stack, &depth, &stack_cap, (PlanDir){ (uint32_t)i, -1 }) != 0){
+                atomic_store(status, EXIT_FAILURE);
+                break;
+            }
+            i++;
+            continue;
+        }
+
+        // A run of files sharing a parent becomes one pool task
+        size_t end = i + 1;
+        while(end < plan->count && end - i < PLAN_TASK_FILES
+              && plan->ops[end].kind != PLAN_MKDIR && plan->ops[end].parent == op->parent)
+            end++;
+
+        PlanFiles *task = malloc(sizeof(PlanFiles));
+        char *dir = NULL;
+        if(op->parent != PLAN_ROOT && plan_path(plan, op->parent, &path, &path_cap))
+            dir = strdup(path);
+        if(!task || (op->parent != PLAN_ROOT && !dir)){
+            fprintf(stderr, "fatal (plan): memory allocation failed for \"%s\".\n", plan->names + op->name);
+            atomic_store(status, EXIT_FAILURE);
+            free(task);
+            free(dir);
+            i = end;
+            continue;
+        }
+
+        *task = (PlanFiles){ dest, i, end - i, dir };
+        atomic_fetch_add(&dest->pending, 1);
+        if(pool_submit(dest->pool, plan_files_run, task) != 0)
+            plan_files_run(task);               /* Could not queue it, run it here */
+        i = end;
+    }
+
+    while(depth > 0){
+        if(stack[depth - 1].fd >= 0)
+            close(stack[depth - 1].fd);
+        depth--;
+    }
+    free(stack);
+    free(path);
+    trace_end(span, "plan directories", dest->path);
+    plan_dest_release(dest);
+}
+#endif
+
+// Check every destination, counting the plan once per destination sharing its filesystem
+static int plan_preflight(const Plan *plan, const char *const *dest_dirs, size_t dest_count){
+    size_t directories = 0;
+    for(size_t i = 0; i < plan->count; i++)
+        directories += (plan->ops[i].kind == PLAN_MKDIR);
+    size_t files = plan->count - directories;
+
+    int status = EXIT_SUCCESS;
+    for(size_t d = 0; d < dest_count; d++){
+        size_t copies = 1;
+        #ifndef _WIN32
+            struct stat st, other;
+            bool first = true;
+            if(stat(dest_dirs[d], &st) == 0){
+                for(size_t e = 0; e < dest_count; e++){
+                    if(e == d || stat(dest_dirs[e], &other) != 0 || other.st_dev != st.st_dev)
+                        continue;
+                    first = first && e > d;
+                    copies++;
+                }
+            }
+            if(!first)
+                continue;                       /* Checked with the first destination of its filesystem */
+        #endif
+        if(check_capacity(dest_dirs[d], directories * copies, files * copies) != 0)
+            status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+int plan_apply(const Plan *plan, const char *dest_dir, unsigned int jobs, bool preflight){
+    return plan_apply_many(plan, &dest_dir, 1, jobs, preflight);
+}
+
+int plan_apply_many(const Plan *plan, const char *const *dest_dirs, size_t dest_count, unsigned int jobs, bool preflight){
+    if(preflight && plan_preflight(plan, dest_dirs, dest_count) != 0)
+        return EXIT_FAILURE;
+
+    #ifndef _WIN32
+        ThreadPool pool;
+        if(pool_init(&pool, jobs) != 0)
+            return EXIT_FAILURE;
+
+        atomic_int status;
+        atomic_init(&status, EXIT_SUCCESS);
+
+        // Destinations replay their directories side by side, file runs fill the gaps
+        for(size_t d = 0; d < dest_count; d++){
+            PlanDest *dest = malloc(sizeof(PlanDest));
+            if(!dest){
+                fprintf(stderr, "fatal (plan): memory allocation failed for \"%s\".\n", dest_dirs[d]);
+                atomic_store(&status, EXIT_FAILURE);
+                break;
+            }
+            *dest = (PlanDest){ .plan = plan, .path = dest_dirs[d], .fd = -1, .pool = &pool, .status = &status };
+            atomic_init(&dest->pending, 1);
+            if(pool_submit(&pool, plan_dest_run, dest) != 0)
+                plan_dest_run(dest);            /* Could not queue it, run it here */
+        }
+
+        pool_wait(&pool);
+        pool_destroy(&pool);
+        return atomic_load(&status);
+    #else
+        // No descriptor-relative calls: replay with full paths
+        (void)jobs;
+        int status = EXIT_SUCCESS;
+        char *path = NULL;
+        size_t path_cap = 0;
+        for(size_t d = 0; d < dest_count; d++){
+            const char *dest_dir = dest_dirs[d];
+            size_t base_len = strlen(dest_dir);
+            for(size_t i = 0; i < plan->count; i++){
+                if(plan->ops[i].kind == PLAN_SYMLINK || plan->ops[i].kind == PLAN_HARDLINK){
+                    if(d == 0)
+                        fprintf(stderr, "warning (plan): links are not supported on this platform, \"%s\" skipped.\n", plan->names + plan->ops[i].name);
+                    continue;
+                }
+                size_t len = plan_path(plan, (uint32_t)i, &path, &path_cap);
+                char *full_path = malloc(base_len + len + 2);
+                if(!len || !full_path){
+                    free(full_path);
+                    status = EXIT_FAILURE;
+                    continue;
+                }
+                snprintf(full_path, base_len + len + 2, "%s%c%s", dest_dir, PATH_SEPARATOR, path);
+                int res = (plan->ops[i].kind == PLAN_MKDIR) ? create_folder(full_path) : create_file(full_path);
+                if(res != 0)
+                    status = EXIT_FAILURE;
+                free(full_path);
+            }
+        }
+        free(path);
+        return status;
+    #endif
+}
+
+// Print the attributes of an entry like a template attribute list
+static void plan_print_attrs(const EntryAttrs *attrs, bool is_dir, FILE *out){
+    int mode = is_dir ? attrs->dir_mode : attrs->file_mode;
+    const char *sep = " [";
+    if(mode >= 0){
+        fprintf(out, "%smode=%04o", sep, (unsigned int)mode);
+        sep = " ";
+    }
+    if(attrs->uid >= 0){
+        fprintf(out, "%sowner=%ld", sep, attrs->uid);
+        sep = " ";
+    }
+    if(attrs->gid >= 0){
+        fprintf(out, "%sgroup=%ld", sep, attrs->gid);
+        sep = " ";
+    }
+    if(attrs->has_mtime){
+        fprintf(out, "%smtime=%lld", sep, attrs->mtime);
+        sep = " ";
+    }
+    if(sep[0] == ' ' && sep[1] == '\0')
+        fputc(']', out);
+}
+
+int plan_print(const Plan *plan, FILE *out){
+    char *path = NULL;
+    size_t path_cap = 0;
+
+    for(size_t i = 0; i < plan->count; i++){
+        if(!plan_path(plan, (uint32_t)i, &path, &path_cap)){
+            free(path);
+            return EXIT_FAILURE;
+        }
+        const PlanOp *op = &plan->ops[i];
+        bool is_dir = op->kind == PLAN_MKDIR;
+        if(is_dir)
+            fprintf(out, "mkdir  %s%c", path, PATH_SEPARATOR);
+        else if(op->kind == PLAN_SYMLINK || op->kind == PLAN_HARDLINK)
+            fprintf(out, "link   %s %s %s", path, op->kind == PLAN_SYMLINK ? "->" : "=>", plan->names + op->target);
+        else
+            fprintf(out, "create %s", path);
+        if(op->attrs != 0)
+            plan_print_attrs(tree_attrs(op->attrs), is_dir, out);
+        fputc('\n', out);
+    }
+
+    free(path);
+    return EXIT_SUCCESS;
+}
+
+void plan_free(Plan *plan){
+    free(plan->ops);
+    free(plan->names);
+    memset(plan, 0, sizeof(*plan));
+}
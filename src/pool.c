@@ -0,0 +1,151 @@
+#include "pool.h"
+
+unsigned int pool_default_workers(void){
+    #ifndef _WIN32
+        long n = sysconf(_SC_NPROCESSORS_ONLN);     /* Ask the system for the processor count */
+        return (n > 0) ? (unsigned int)n : 1;
+    #else
+        return 1;
+    #endif
+}
+
+#ifndef _WIN32
+// Worker loop: pop tasks until the pool is stopping and the queue is empty
+static void *pool_worker(void *arg){
+    ThreadPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(pool->count == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->has_work, &pool->lock);
+
+        if(pool->count == 0 && pool->stopping)
+            break;
+
+        // Take the task at the head of the queue
+        PoolItem item = pool->items[pool->head];
+        pool->head = (pool->head + 1) % pool->cap;
+        pool->count--;
+        pool->active++;
+
+        pthread_mutex_unlock(&pool->lock);
+        item.fn(item.arg);                          /* Run the task without holding the lock */
+        pthread_mutex_lock(&pool->lock);
+
+        pool->active--;
+        if(pool->count == 0 && pool->active == 0)
+            pthread_cond_broadcast(&pool->idle);    /* Wake up pool_wait */
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+#endif
+
+int pool_init(ThreadPool *pool, unsigned int workers){
+    memset(pool, 0, sizeof(*pool));
+
+    #ifndef _WIN32
+        if(workers == 0)
+            workers = pool_default_workers();
+
+        pool->cap = 64;
+        pool->items = malloc(pool->cap * sizeof(PoolItem));
+        pool->workers = malloc(workers * sizeof(pthread_t));
+        if(!pool->items || !pool->workers){
+            fprintf(stderr, "fatal (pool): allocation failed for the worker pool.\n");
+            free(pool->items);
+            free(pool->workers);
+            return EXIT_FAILURE;
+        }
+
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->has_work, NULL);
+        pthread_cond_init(&pool->idle, NULL);
+
+        // Start the workers, keep the ones that did start if one fails
+        for(unsigned int i = 0; i < workers; i++){
+            if(pthread_create(&pool->workers[i], NULL, pool_worker, pool) != 0)
+                break;
+            pool->worker_count++;
+        }
+
+        if(pool->worker_count == 0){
+            fprintf(stderr, "fatal (pool): failed to start any worker thread.\n");
+            pool_destroy(pool);
+            return EXIT_FAILURE;
+        }
+    #else
+        (void)workers;  /* Inline mode: tasks run in the caller */
+    #endif
+
+    return EXIT_SUCCESS;
+}
+
+int pool_submit(ThreadPool *pool, PoolTask fn, void *arg){
+    #ifndef _WIN32
+        pthread_mutex_lock(&pool->lock);
+
+        // Grow the circular queue, unrolling it at the start of the new buffer
+        if(pool->count == pool->cap){
+            size_t new_cap = pool->cap * 2;
+            PoolItem *tmp = malloc(new_cap * sizeof(PoolItem));
+            if(!tmp){
+                pthread_mutex_unlock(&pool->lock);
+                fprintf(stderr, "fatal (pool): allocation failed for the task queue.\n");
+                return EXIT_FAILURE;
+            }
+            for(size_t i = 0; i < pool->count; i++)
+                tmp[i] = pool->items[(pool->head + i) % pool->cap];
+            free(pool->items);
+            pool->items = tmp;
+            pool->cap = new_cap;
+            pool->head = 0;
+        }
+
+        pool->items[(pool->head + pool->count) % pool->cap] = (PoolItem){ fn, arg };
+        pool->count++;
+
+        pthread_cond_signal(&pool->has_work);
+        pthread_mutex_unlock(&pool->lock);
+    #else
+        fn(arg);        /* No worker: run the task right away */
+        (void)pool;
+    #endif
+
+    return EXIT_SUCCESS;
+}
+
+void pool_wait(ThreadPool *pool){
+    #ifndef _WIN32
+        pthread_mutex_lock(&pool->lock);
+        while(pool->count > 0 || pool->active > 0)
+            pthread_cond_wait(&pool->idle, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    #else
+        (void)pool;
+    #endif
+}
+
+void pool_destroy(ThreadPool *pool){
+    #ifndef _WIN32
+        // Ask the workers to leave once the queue is drained
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->has_work);
+        pthread_mutex_unlock(&pool->lock);
+
+        for(unsigned int i = 0; i < pool->worker_count; i++)
+            pthread_join(pool->workers[i], NULL);
+
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->has_work);
+        pthread_cond_destroy(&pool->idle);
+        free(pool->workers);
+        pool->workers = NULL;
+    #endif
+
+    free(pool->items);
+    pool->items = NULL;
+    pool->worker_count = 0;
+}
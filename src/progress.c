@@ -0,0 +1,138 @@
+#include "progress.h"
+
+#ifndef _WIN32
+static Progress progress = {
+    .enabled = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER
+};
+
+static double seconds_since(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Print one progress line; rate is in entries per second
+static void progress_print(size_t done, size_t failed, size_t total, double rate, double elapsed, bool last){
+    FILE *out = progress.out;
+
+    fprintf(out, "%sprogress : %zu", progress.tty ? "\r" : "", done);
+    if(total > 0)
+        fprintf(out, "/%zu entries (%.0f%%)", total, done >= total ? 100.0 : 100.0 * (double)done / (double)total);
+    else
+        fprintf(out, " entries");
+    if(last)
+        fprintf(out, " in %.1fs", elapsed);
+    fprintf(out, ", %.0f/s", rate);
+    if(!last && total > done && rate > 0){
+        unsigned long eta = (unsigned long)((double)(total - done) / rate + 0.5);
+        fprintf(out, ", eta %lu:%02lu", eta / 60, eta % 60);
+    }
+    if(failed > 0)
+        fprintf(out, ", %zu failed", failed);
+    // Pad over the end of a longer previous line
+    fprintf(out, progress.tty && !last ? "   " : "\n");
+    fflush(out);
+}
+
+// Reporter loop: sample the counters each interval until progress_stop
+static void *progress_report(void *arg){
+    (void)arg;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t last_done = 0, last_failed = 0;
+    double last_time = 0;
+
+    pthread_mutex_lock(&progress.lock);
+    while(!progress.stopping){
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (long)PROGRESS_INTERVAL_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&progress.wake, &progress.lock, &until);
+        if(progress.stopping)
+            break;
+        pthread_mutex_unlock(&progress.lock);
+
+        size_t done = atomic_load_explicit(&progress.done, memory_order_relaxed);
+        size_t failed = atomic_load_explicit(&progress.failed, memory_order_relaxed);
+        double now = seconds_since(&start);
+        if(done == last_done && failed == last_failed){
+            // Nothing happened (parsing, or an idle --watch): keep the last line
+            pthread_mutex_lock(&progress.lock);
+            continue;
+        }
+        double rate = now > last_time ? (double)(done - last_done) / (now - last_time) : 0;
+        progress_print(done, failed, atomic_load_explicit(&progress.total, memory_order_relaxed), rate, now, false);
+        last_done = done;
+        last_failed = failed;
+        last_time = now;
+
+        pthread_mutex_lock(&progress.lock);
+    }
+    pthread_mutex_unlock(&progress.lock);
+
+    // Last line: the average rate over the whole build
+    size_t done = atomic_load_explicit(&progress.done, memory_order_relaxed);
+    double elapsed = seconds_since(&start);
+    progress_print(done, atomic_load_explicit(&progress.failed, memory_order_relaxed),
+                   atomic_load_explicit(&progress.total, memory_order_relaxed), elapsed > 0 ? (double)done / elapsed : 0, elapsed, true);
+    return NULL;
+}
+
+int progress_start(FILE *out){
+    progress.out = out;
+    progress.tty = isatty(fileno(out));
+    progress.stopping = false;
+    atomic_store(&progress.done, 0);
+    atomic_store(&progress.failed, 0);
+    atomic_store(&progress.total, 0);
+
+    if(pthread_create(&progress.thread, NULL, progress_report, NULL) != 0){
+        fprintf(stderr, "error (progress): failed to start the reporter thread.\n");
+        return EXIT_FAILURE;
+    }
+    progress.enabled = true;
+    return EXIT_SUCCESS;
+}
+
+void progress_expect(size_t count){
+    if(progress.enabled)
+        atomic_fetch_add_explicit(&progress.total, count, memory_order_relaxed);
+}
+
+void progress_entry(bool ok){
+    if(progress.enabled)
+        atomic_fetch_add_explicit(ok ? &progress.done : &progress.failed, 1, memory_order_relaxed);
+}
+
+void progress_stop(void){
+    if(!progress.enabled)
+        return;
+
+    pthread_mutex_lock(&progress.lock);
+    progress.stopping = true;
+    pthread_cond_signal(&progress.wake);
+    pthread_mutex_unlock(&progress.lock);
+    pthread_join(progress.thread, NULL);
+    progress.enabled = false;
+}
+#else
+int progress_start(FILE *out){
+    (void)out;
+    return EXIT_SUCCESS;
+}
+
+void progress_expect(size_t count){
+    (void)count;
+}
+
+void progress_entry(bool ok){
+    (void)ok;
+}
+
+void progress_stop(void){
+}
+#endif
@@ -0,0 +1,449 @@
+#include "serve.h"
+
+#ifndef _WIN32
+
+/* File identity used to notice edits */
+typedef struct ServeStamp {
+    struct timespec mtime;          // Modification time
+    off_t size;                     // Size in bytes
+    ino_t ino;                      // Inode, changes when an editor renames a new file in
+} ServeStamp;
+
+/* Cached template */
+typedef struct ServeTemplate {
+    char *path;                     // Absolute template path
+    Tree root;                      // Parsed tree, NULL if parsing failed
+    TreeStats stats;                // Entries in the tree, includes expanded
+    ServeStamp stamp;               // Identity of the parsed file
+} ServeTemplate;
+
+/* Template pulled in by an "@include" */
+typedef struct ServeInclude {
+    char *path;                     // Real path, as keyed by the include cache
+    ServeStamp stamp;               // Identity when it was parsed
+} ServeInclude;
+
+typedef struct ServeState {
+    ServeTemplate *templates;       // Cached templates
+    size_t count;                   // Number of cached templates
+    ServeInclude *includes;         // Templates held by the include cache
+    size_t include_count;           // Number of included templates
+    pthread_rwlock_t lock;          // Read: lookup and build, write: parse and flush
+    bool preflight;                 // Check the destination capacity before each build
+} ServeState;
+
+/* One accepted connection, handled by a pool worker */
+typedef struct ServeConn {
+    ServeState *state;              // Shared server state
+    int fd;                         // Connected socket
+} ServeConn;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_on_signal(int sig){
+    (void)sig;
+    serve_stop = 1;
+}
+
+static bool stamp_read(const char *path, ServeStamp *stamp){
+    struct stat st;
+    if(stat(path, &st) != 0)
+        return false;
+    stamp->mtime = st.st_mtim;
+    stamp->size = st.st_size;
+    stamp->ino = st.st_ino;
+    return true;
+}
+
+static bool stamp_fresh(const char *path, const ServeStamp *stamp){
+    ServeStamp now;
+    return stamp_read(path, &now) && now.mtime.tv_sec == stamp->mtime.tv_sec && now.mtime.tv_nsec == stamp->mtime.tv_nsec
+        && now.size == stamp->size && now.ino == stamp->ino;
+}
+
+static bool includes_fresh(const ServeState *st){
+    for(size_t i = 0; i < st->include_count; i++)
+        if(!stamp_fresh(st->includes[i].path, &st->includes[i].stamp))
+            return false;
+    return true;
+}
+
+static void includes_free(ServeState *st){
+    for(size_t i = 0; i < st->include_count; i++)
+        free(st->includes[i].path);
+    free(st->includes);
+    st->includes = NULL;
+    st->include_count = 0;
+}
+
+// Record the identity of every template the include cache holds (write lock held)
+static void includes_refresh(ServeState *st){
+    includes_free(st);
+    size_t n = 0;
+    while(parser_cached_include(n))
+        n++;
+    if(n == 0)
+        return;
+
+    st->includes = calloc(n, sizeof(ServeInclude));
+    if(!st->includes)
+        return;
+    for(size_t i = 0; i < n; i++){
+        const char *path = parser_cached_include(i);
+        ServeInclude *inc = &st->includes[st->include_count];
+        // An include that cannot be stamped is never fresh: stamp it as empty
+        if(!stamp_read(path, &inc->stamp))
+            memset(&inc->stamp, 0, sizeof(inc->stamp));
+        inc->path = strdup(path);
+        if(inc->path)
+            st->include_count++;
+    }
+}
+
+// Drop every cached tree, then the include cache they mount (write lock held)
+static void serve_flush(ServeState *st){
+    for(size_t i = 0; i < st->count; i++){
+        clean_tree(&st->templates[i].root);
+        free(st->templates[i].path);
+    }
+    free(st->templates);
+    st->templates = NULL;
+    st->count = 0;
+    parser_clear_cache();
+    includes_free(st);
+}
+
+static ServeTemplate *serve_find(ServeState *st, const char *path){
+    for(size_t i = 0; i < st->count; i++)
+        if(strcmp(st->templates[i].path, path) == 0)
+            return &st->templates[i];
+    return NULL;
+}
+
+// Parse path into its cache slot (write lock held), returns NULL on failure
+static ServeTemplate *serve_load(ServeState *st, const char *path){
+    ServeStamp stamp;
+    if(!stamp_read(path, &stamp)){
+        fprintf(stderr, "error (serve): cannot open template \"%s\".\n", path);
+        return NULL;
+    }
+
+    ServeTemplate *t = serve_find(st, path);
+    if(!t){
+        ServeTemplate *tmp = realloc(st->templates, (st->count + 1) * sizeof(ServeTemplate));
+        char *key = strdup(path);
+        if(!tmp || !key){
+            fprintf(stderr, "fatal (serve): memory allocation failed for \"%s\".\n", path);
+            if(tmp)
+                st->templates = tmp;
+            free(key);
+            return NULL;
+        }
+        st->templates = tmp;
+        t = &st->templates[st->count++];
+        *t = (ServeTemplate){ .path = key };
+    }
+
+    clean_tree(&t->root);
+    t->root = parse_tokens_stats(path, &t->stats);
+    t->stamp = stamp;
+    includes_refresh(st);
+    return t;
+}
+
+// Find a fresh parse of path, returns with the read lock held
+static ServeTemplate *serve_lookup(ServeState *st, const char *path, bool *cached){
+    *cached = true;
+    pthread_rwlock_rdlock(&st->lock);
+    for(;;){
+        ServeTemplate *t = includes_fresh(st) ? serve_find(st, path) : NULL;
+        if(t && stamp_fresh(path, &t->stamp))
+            return t;
+
+        // Stale or missing: parse again under the write lock, then look again
+        pthread_rwlock_unlock(&st->lock);
+        pthread_rwlock_wrlock(&st->lock);
+        if(!includes_fresh(st))
+            serve_flush(st);
+        t = serve_find(st, path);
+        if(!t || !stamp_fresh(path, &t->stamp)){
+            *cached = false;
+            if(!serve_load(st, path)){
+                pthread_rwlock_unlock(&st->lock);
+                pthread_rwlock_rdlock(&st->lock);
+                return NULL;
+            }
+        }
+        pthread_rwlock_unlock(&st->lock);
+        pthread_rwlock_rdlock(&st->lock);
+    }
+}
+
+static double elapsed_ms(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static bool send_all(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Read one "\n"-terminated line, returns its length without the newline or -1
+static ssize_t recv_line(int fd, char *buf, size_t cap){
+    size_t len = 0;
+    while(len + 1 < cap){
+        ssize_t n = recv(fd, buf + len, cap - 1 - len, 0);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        char *nl = memchr(buf + len, '\n', (size_t)n);
+        len += (size_t)n;
+        if(nl){
+            *nl = '\0';
+            return nl - buf;
+        }
+    }
+    return -1;
+}
+
+static void serve_conn_run(void *arg){
+    ServeConn *conn = arg;
+    ServeState *st = conn->state;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Split the request into its fields: op, template, destination, jobs, preflight, journal
+    char *line = malloc(SERVE_LINE_MAX);
+    char *field[SERVE_FIELDS] = { NULL };
+    size_t fields = 0;
+    if(line && recv_line(conn->fd, line, SERVE_LINE_MAX) >= 0){
+        for(char *f = line; f && fields < SERVE_FIELDS; fields++){
+            field[fields] = f;
+            f = strchr(f, '\t');
+            if(f)
+                *f++ = '\0';
+        }
+    }
+
+    int status = EXIT_FAILURE;
+    size_t entries = 0;
+    bool cached = false;
+    const char *op = field[0], *path = field[1], *dest = field[2], *journal = field[5];
+    bool remove = fields == SERVE_FIELDS && strcmp(op, "remove") == 0;
+    char *end = NULL;
+    unsigned long jobs = fields == SERVE_FIELDS ? strtoul(field[3], &end, 10) : 0;
+    if(fields != SERVE_FIELDS || (!remove && strcmp(op, "build") != 0) || path[0] != '/' || dest[0] != '/'
+       || end == field[3] || *end != '\0' || jobs > UINT_MAX || (strcmp(field[4], "0") != 0 && strcmp(field[4], "1") != 0)
+       || (journal[0] != '\0' && journal[0] != '/')){
+        fprintf(stderr, "error (serve): malformed request.\n");
+    } else {
+        bool preflight = st->preflight && field[4][0] == '1';
+        ServeTemplate *t = serve_lookup(st, path, &cached);
+        if(t && t->root){
+            entries = t->stats.directories + t->stats.files;
+            // The workers already run one connection each: a removal takes one more unless the client asked for more
+            if(remove)
+                status = remove_tree(t->root, dest, jobs ? (unsigned int)jobs : 1);
+            else if(!preflight || (journal[0] && build_journal_matches(journal, dest, &t->stats))
+                    || check_capacity(dest, t->stats.directories, t->stats.files) == 0)
+                status = build_tree_resume(t->root, dest, journal[0] ? journal : NULL, &t->stats);
+        }
+        pthread_rwlock_unlock(&st->lock);
+    }
+
+    char reply[128];
+    int n = snprintf(reply, sizeof(reply), "status=%d entries=%zu cached=%d ms=%.2f\n", status, entries, cached ? 1 : 0, elapsed_ms(&start));
+    send_all(conn->fd, reply, (size_t)n);
+
+    free(line);
+    close(conn->fd);
+    free(conn);
+}
+
+int serve_run(const char *socket_path, unsigned int jobs, bool preflight){
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if(strlen(socket_path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "fatal (serve): socket path \"%s\" is too long.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(lfd < 0){
+        fprintf(stderr, "fatal (serve): cannot create a socket.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Replace the socket left by a previous server, never another kind of file
+    struct stat old;
+    if(lstat(socket_path, &old) == 0 && S_ISSOCK(old.st_mode))
+        unlink(socket_path);
+    if(bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, SOMAXCONN) != 0){
+        fprintf(stderr, "fatal (serve): cannot listen on \"%s\".\n", socket_path);
+        close(lfd);
+        return EXIT_FAILURE;
+    }
+
+    ServeState st = { 0 };
+    st.preflight = preflight;
+    ThreadPool pool;
+    if(pthread_rwlock_init(&st.lock, NULL) != 0 || pool_init(&pool, jobs) != 0){
+        fprintf(stderr, "fatal (serve): failed to start the workers.\n");
+        close(lfd);
+        unlink(socket_path);
+        return EXIT_FAILURE;
+    }
+
+    // Stop on interrupt: the handler has no SA_RESTART, so accept returns
+    struct sigaction sa = { 0 };
+    sa.sa_handler = serve_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while(!serve_stop){
+        int fd = accept(lfd, NULL, NULL);
+        if(fd < 0)
+            continue;
+
+        // A client that never finishes its request must not hold a worker forever
+        struct timeval timeout = { .tv_sec = SERVE_TIMEOUT };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        ServeConn *conn = malloc(sizeof(ServeConn));
+        if(conn){
+            conn->state = &st;
+            conn->fd = fd;
+        }
+        if(!conn || pool_submit(&pool, serve_conn_run, conn) != 0){
+            fprintf(stderr, "error (serve): cannot queue a request.\n");
+            free(conn);
+            close(fd);
+        }
+    }
+
+    pool_wait(&pool);
+    pool_destroy(&pool);
+    close(lfd);
+    unlink(socket_path);
+
+    serve_flush(&st);
+    pthread_rwlock_destroy(&st.lock);
+    return EXIT_SUCCESS;
+}
+
+// Absolute form of path, resolved against the working directory if relative
+static char *absolute_path(const char *path){
+    if(path[0] == '/')
+        return strdup(path);
+
+    char *cwd = getcwd(NULL, 0);
+    if(!cwd)
+        return NULL;
+    size_t cwd_len = strlen(cwd), len = strlen(path);
+    char *abs = malloc(cwd_len + len + 2);
+    if(abs){
+        memcpy(abs, cwd, cwd_len);
+        abs[cwd_len] = '/';
+        memcpy(abs + cwd_len + 1, path, len + 1);
+    }
+    free(cwd);
+    return abs;
+}
+
+// Send one request line and return the status of the reply
+static int serve_exchange(const struct sockaddr_un *addr, char *line, size_t len, const char *template_path){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0){
+        fprintf(stderr, "fatal (client): no server listening on \"%s\".\n", addr->sun_path);
+        if(fd >= 0)
+            close(fd);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_FAILURE;
+    if(!send_all(fd, line, len) || recv_line(fd, line, SERVE_LINE_MAX) < 0 || sscanf(line, "status=%d", &status) != 1){
+        fprintf(stderr, "fatal (client): no reply from the server.\n");
+        status = EXIT_FAILURE;
+    } else if(status != 0)
+        fprintf(stderr, "error (client): the server failed on \"%s\", see its log.\n", template_path);
+    close(fd);
+    return status;
+}
+
+int serve_send(const char *socket_path, const char *template_path, const char *dest_dir, bool remove,
+               unsigned int jobs, bool preflight, const char *journal_path){
+    if(strcmp(template_path, "-") == 0){
+        fprintf(stderr, "fatal (client): the standard input cannot be sent to the server.\n");
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if(strlen(socket_path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "fatal (client): socket path \"%s\" is too long.\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // The server has its own working directory: send absolute paths
+    char *path = absolute_path(template_path);
+    char *dest = absolute_path(dest_dir);
+    char *journal = journal_path ? absolute_path(journal_path) : strdup("");
+    char *line = malloc(SERVE_LINE_MAX);
+    int status = EXIT_FAILURE;
+
+    if(!path || !dest || !journal || !line)
+        fprintf(stderr, "fatal (client): cannot resolve the request paths.\n");
+    else if(strpbrk(path, "\t\n") || strpbrk(dest, "\t\n") || strpbrk(journal, "\t\n"))
+        fprintf(stderr, "fatal (client): paths holding a tab or a newline cannot be sent.\n");
+    else {
+        int n = snprintf(line, SERVE_LINE_MAX, "%s\t%s\t%s\t%u\t%d\t%s\n", remove ? "remove" : "build", path, dest,
+                         jobs, preflight ? 1 : 0, journal);
+        if(n < 0 || n >= SERVE_LINE_MAX)
+            fprintf(stderr, "fatal (client): request for \"%s\" is too long.\n", template_path);
+        else
+            status = serve_exchange(&addr, line, (size_t)n, template_path);
+    }
+
+    free(line);
+    free(journal);
+    free(dest);
+    free(path);
+    return status;
+}
+
+#else
+
+int serve_run(const char *socket_path, unsigned int jobs, bool preflight){
+    (void)socket_path;
+    (void)jobs;
+    (void)preflight;
+    fprintf(stderr, "fatal (serve): the server is not supported on this platform.\n");
+    return EXIT_FAILURE;
+}
+
+int serve_send(const char *socket_path, const char *template_path, const char *dest_dir, bool remove,
+               unsigned int jobs, bool preflight, const char *journal_path){
+    (void)socket_path;
+    (void)template_path;
+    (void)dest_dir;
+    (void)remove;
+    (void)jobs;
+    (void)preflight;
+    (void)journal_path;
+    fprintf(stderr, "fatal (client): the server is not supported on this platform.\n");
+    return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include "throttle.h"
+
+#ifndef _WIN32
+static Throttle throttle = {
+    .enabled = false,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .room = PTHREAD_COND_INITIALIZER
+};
+
+static uint64_t now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void throttle_configure(bool adaptive, unsigned int max_window, double ops_per_sec){
+    throttle.adaptive = adaptive;
+    throttle.max_window = max_window > 0 ? max_window : 1;
+    // Slow start from one operation in flight, a fixed window is simply the bound
+    throttle.window = adaptive ? 1.0 : (double)throttle.max_window;
+    throttle.slow_start = true;
+    throttle.interval_ns = ops_per_sec > 0 ? (uint64_t)(1e9 / ops_per_sec) : 0;
+    throttle.next_ns = 0;
+    throttle.enabled = adaptive || throttle.interval_ns > 0;
+}
+
+uint64_t throttle_begin(void){
+    if(!throttle.enabled)
+        return 0;
+
+    pthread_mutex_lock(&throttle.lock);
+    while(throttle.in_flight >= (unsigned int)throttle.window)
+        pthread_cond_wait(&throttle.room, &throttle.lock);
+    throttle.in_flight++;
+
+    // Take the next start slot of the rate cap, then wait for it without the lock
+    uint64_t now = now_ns();
+    uint64_t slot = now;
+    if(throttle.interval_ns > 0){
+        if(throttle.next_ns > slot)
+            slot = throttle.next_ns;
+        throttle.next_ns = slot + throttle.interval_ns;
+    }
+    pthread_mutex_unlock(&throttle.lock);
+
+    if(slot > now){
+        struct timespec wait = { (time_t)((slot - now) / 1000000000ull), (long)((slot - now) % 1000000000ull) };
+        while(nanosleep(&wait, &wait) != 0 && errno == EINTR)
+            ;
+    }
+    uint64_t start = now_ns();
+    return start > 0 ? start : 1;
+}
+
+// Feed one latency sample to the window, called with the lock held
+static void throttle_adapt(double latency){
+    Throttle *t = &throttle;
+
+    t->avg_ns = t->avg_ns == 0 ? latency : t->avg_ns + (latency - t->avg_ns) / (1 << THROTTLE_EWMA_SHIFT);
+    if(t->base_ns == 0 || t->avg_ns < t->base_ns)
+        t->base_ns = t->avg_ns;
+    else
+        t->base_ns += (t->avg_ns - t->base_ns) / THROTTLE_BASE_DRIFT;  /* A lasting change of the filesystem becomes the new base */
+    t->since_decrease++;
+
+    if(t->avg_ns > t->base_ns * THROTTLE_SLOWDOWN && t->since_decrease >= (uint64_t)t->window && t->window > 1.0){
+        // The filesystem is queueing: halve the window, at most once per window of operations
+        t->window = t->window / 2 < 1.0 ? 1.0 : t->window / 2;
+        t->since_decrease = 0;
+        t->slow_start = false;
+        t->decreases++;
+    } else {
+        t->window += t->slow_start ? 1.0 : 1.0 / t->window;
+        if(t->window > (double)t->max_window)
+            t->window = (double)t->max_window;
+    }
+}
+
+void throttle_end(uint64_t start){
+    if(start == 0)
+        return;
+
+    uint64_t latency = now_ns() - start;
+    pthread_mutex_lock(&throttle.lock);
+    throttle.in_flight--;
+    throttle.ops++;
+    if(throttle.adaptive)
+        throttle_adapt((double)latency);
+    pthread_cond_broadcast(&throttle.room);     /* The window may have grown by more than one */
+    pthread_mutex_unlock(&throttle.lock);
+}
+
+void throttle_report(FILE *out){
+    if(!throttle.enabled)
+        return;
+
+    pthread_mutex_lock(&throttle.lock);
+    if(throttle.adaptive)
+        fprintf(out, "throttle : %llu operations, window %.1f of %u, halved %llu times, latency %.1f us (base %.1f us).\n",
+                (unsigned long long)throttle.ops, throttle.window, throttle.max_window, (unsigned long long)throttle.decreases,
+                throttle.avg_ns / 1e3, throttle.base_ns / 1e3);
+    else
+        fprintf(out, "throttle : %llu operations, at most %.0f per second.\n",
+                (unsigned long long)throttle.ops, 1e9 / (double)throttle.interval_ns);
+    pthread_mutex_unlock(&throttle.lock);
+}
+#else
+void throttle_configure(bool adaptive, unsigned int max_window, double ops_per_sec){
+    (void)adaptive;
+    (void)max_window;
+    (void)ops_per_sec;
+}
+
+uint64_t throttle_begin(void){
+    return 0;
+}
+
+void throttle_end(uint64_t start){
+    (void)start;
+}
+
+void throttle_report(FILE *out){
+    (void)out;
+}
+#endif
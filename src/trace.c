@@ -0,0 +1,200 @@
+#include "trace.h"
+
+#ifndef _WIN32
+static bool trace_enabled = false;
+static FILE *trace_out = NULL;
+static struct timespec trace_epoch;
+static _Atomic(TraceBuffer *) trace_buffers = NULL;
+static atomic_uint trace_threads = 0;
+static _Thread_local TraceBuffer *trace_local = NULL;
+
+static uint64_t trace_now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - trace_epoch.tv_sec) * 1000000000ull + (uint64_t)now.tv_nsec - (uint64_t)trace_epoch.tv_nsec;
+}
+
+// Buffer of the calling thread, registered on its first event
+static TraceBuffer *trace_buffer(void){
+    if(trace_local)
+        return trace_local;
+
+    TraceBuffer *buf = calloc(1, sizeof(TraceBuffer));
+    if(!buf)
+        return NULL;
+    buf->tid = atomic_fetch_add(&trace_threads, 1) + 1;
+    atomic_init(&buf->count, 0);
+
+    // Push it on the registry, lock-free
+    buf->next = atomic_load_explicit(&trace_buffers, memory_order_relaxed);
+    while(!atomic_compare_exchange_weak_explicit(&trace_buffers, &buf->next, buf, memory_order_release, memory_order_relaxed))
+        ;
+    trace_local = buf;
+    return buf;
+}
+
+int trace_start(const char *path){
+    trace_out = fopen(path, "w");
+    if(!trace_out){
+        fprintf(stderr, "fatal (trace): cannot write '%s' (%s).\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+    trace_enabled = true;
+    trace_buffer();                     /* The calling thread is thread 1 */
+    return EXIT_SUCCESS;
+}
+
+uint64_t trace_begin(void){
+    if(!trace_enabled)
+        return 0;
+    uint64_t now = trace_now();
+    return now > 0 ? now : 1;
+}
+
+void trace_end(uint64_t start, const char *name, const char *detail){
+    if(start == 0)
+        return;
+    uint64_t end = trace_now();
+    int saved = errno;                  /* Callers still read the errno of the traced call */
+
+    TraceBuffer *buf = trace_buffer();
+    size_t count = buf ? atomic_load_explicit(&buf->count, memory_order_relaxed) : 0;
+    if(!buf || count >= TRACE_MAX_EVENTS){
+        if(buf)
+            buf->dropped++;
+        errno = saved;
+        return;
+    }
+
+    // Open a new chunk when the current one is full
+    if(count % TRACE_CHUNK == 0){
+        TraceChunk *chunk = malloc(sizeof(TraceChunk));
+        if(!chunk){
+            buf->dropped++;
+            errno = saved;
+            return;
+        }
+        chunk->next = buf->chunk;
+        buf->chunk = chunk;
+    }
+
+    TraceEvent *ev = &buf->chunk->events[count % TRACE_CHUNK];
+    ev->name = name;
+    ev->start_ns = start;
+    ev->dur_ns = end - start;
+    size_t len = detail ? strlen(detail) : 0;
+    if(len >= TRACE_DETAIL){
+        // Keep the end of long paths, without splitting a UTF-8 sequence
+        detail += len - (TRACE_DETAIL - 1);
+        while(((unsigned char)*detail & 0xC0) == 0x80)
+            detail++;
+        len = strlen(detail);
+    }
+    if(len > 0)
+        memcpy(ev->detail, detail, len);
+    ev->detail[len] = '\0';
+
+    atomic_store_explicit(&buf->count, count + 1, memory_order_release);
+    errno = saved;
+}
+
+void trace_slow(uint64_t start, const char *name, const char *detail){
+    if(start != 0 && trace_now() - start >= TRACE_SLOW_NS)
+        trace_end(start, name, detail);
+}
+
+// JSON string contents, escaped
+static void trace_put_json(FILE *out, const char *s){
+    for(; *s; s++){
+        unsigned char c = (unsigned char)*s;
+        if(c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if(c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+}
+
+void trace_stop(void){
+    if(!trace_enabled)
+        return;
+    trace_enabled = false;
+
+    FILE *out = trace_out;
+    int pid = (int)getpid();
+    bool first = true;
+    size_t dropped = 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    TraceBuffer *buf = atomic_load_explicit(&trace_buffers, memory_order_acquire);
+    while(buf){
+        size_t count = atomic_load_explicit(&buf->count, memory_order_acquire);
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", pid, buf->tid, buf->tid == 1 ? "main" : "worker");
+        first = false;
+
+        // Chunks are newest first, only the newest is partly filled
+        size_t in_chunk = count % TRACE_CHUNK ? count % TRACE_CHUNK : TRACE_CHUNK;
+        for(TraceChunk *chunk = buf->chunk; chunk && count > 0; ){
+            for(size_t i = 0; i < in_chunk; i++){
+                TraceEvent *ev = &chunk->events[i];
+                fprintf(out, ",\n{\"name\":\"");
+                trace_put_json(out, ev->name);
+                fprintf(out, "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", pid, buf->tid,
+                        (double)ev->start_ns / 1e3, (double)ev->dur_ns / 1e3);
+                if(ev->detail[0]){
+                    fprintf(out, ",\"args\":{\"detail\":\"");
+                    trace_put_json(out, ev->detail);
+                    fprintf(out, "\"}");
+                }
+                fputc('}', out);
+            }
+            count -= in_chunk;
+            in_chunk = TRACE_CHUNK;
+
+            TraceChunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        dropped += buf->dropped;
+
+        TraceBuffer *next = buf->next;
+        free(buf);
+        buf = next;
+    }
+    fprintf(out, "\n]}\n");
+    atomic_store(&trace_buffers, NULL);
+    trace_local = NULL;
+
+    if(fclose(out) != 0)
+        fprintf(stderr, "error (trace): failed to write the trace (%s).\n", strerror(errno));
+    if(dropped > 0)
+        fprintf(stderr, "warning (trace): %zu events over %u per thread were dropped.\n", dropped, TRACE_MAX_EVENTS);
+}
+#else
+int trace_start(const char *path){
+    (void)path;
+    return EXIT_SUCCESS;
+}
+
+uint64_t trace_begin(void){
+    return 0;
+}
+
+void trace_end(uint64_t start, const char *name, const char *detail){
+    (void)start;
+    (void)name;
+    (void)detail;
+}
+
+void trace_slow(uint64_t start, const char *name, const char *detail){
+    (void)start;
+    (void)name;
+    (void)detail;
+}
+
+void trace_stop(void){
+}
+#endif
@@ -1,4 +1,5 @@
 #include "treeMaker.h"
+#include "export.h"
 
 Tree new_tree(const char *path){
     // Allocate the exact memory for TreeNode size
@@ -12,6 +13,7 @@ Tree new_tree(const char *path){
     // Check if the path is given
     if(path == NULL || strlen(path) == 0){
         fprintf(stderr, "fatal (parsing): invalid name.\n");      /* Print the error */
+        free(tree);                                                 /* Free the unused node */
         return NULL;                                                /* Exit and return null */
     }
 
@@ -29,14 +31,247 @@ Tree new_tree(const char *path){
     }
 
     // Initialize other tree fields
+    tree->name = tree->path;
     tree->is_directory = is_dir;                                     
+    tree->is_shared = false;
+    tree->is_sealed = false;
+    tree->link = TREE_LINK_NONE;
+    tree->attrs = 0;
     tree->child_count = 0;    
     tree->children = NULL;
     tree->parent = NULL;
+    tree->index = NULL;
 
     return tree;
 }
 
+/* ---------------- Entry attributes ----------------
+ * Nodes keep a 32-bit id rather than a pointer so TreeNode does not grow.
+ * Builders read the sets while the parser interns new ones, so a set is
+ * written once in a block that never moves, and its id is only published
+ * afterwards; the lock only guards the writers.
+ */
+static EntryAttrs *attrs_blocks[TREE_ATTRS_BLOCKS];
+static uint32_t attrs_count = 1;            /* Id 0 is the default set */
+static uint32_t *attrs_slots = NULL;        /* Open addressing set of ids, 0 marks a free slot */
+static size_t attrs_cap = 0;
+#ifndef _WIN32
+    static pthread_mutex_t attrs_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static bool attrs_equal(const EntryAttrs *a, const EntryAttrs *b){
+    return a->dir_mode == b->dir_mode && a->file_mode == b->file_mode
+        && a->uid == b->uid && a->gid == b->gid
+        && a->has_mtime == b->has_mtime && (!a->has_mtime || a->mtime == b->mtime);
+}
+
+static size_t attrs_hash(const EntryAttrs *a){
+    long long key[5] = { a->dir_mode, a->file_mode, a->uid, a->gid, a->has_mtime ? a->mtime : -1 };
+    return hash_bytes(key, sizeof(key), HASH_SEED);
+}
+
+// Find the id of attrs, or the free slot where it belongs
+static uint32_t *attrs_slot(const EntryAttrs *attrs){
+    size_t i = attrs_hash(attrs) & (attrs_cap - 1);
+    while(attrs_slots[i] != 0 && !attrs_equal(tree_attrs(attrs_slots[i]), attrs))
+        i = (i + 1) & (attrs_cap - 1);
+    return &attrs_slots[i];
+}
+
+static int attrs_grow(void){
+    size_t new_cap = attrs_cap ? attrs_cap * 2 : 64;
+    uint32_t *old = attrs_slots;
+    size_t old_cap = attrs_cap;
+    attrs_slots = calloc(new_cap, sizeof(uint32_t));
+    if(!attrs_slots){
+        attrs_slots = old;
+        return EXIT_FAILURE;
+    }
+    attrs_cap = new_cap;
+    for(size_t i = 0; i < old_cap; i++)
+        if(old[i] != 0)
+            *attrs_slot(tree_attrs(old[i])) = old[i];
+    free(old);
+    return EXIT_SUCCESS;
+}
+
+uint32_t tree_attrs_intern(const EntryAttrs *attrs){
+    EntryAttrs none = ENTRY_ATTRS_DEFAULT;
+    if(!attrs || attrs_equal(attrs, &none))
+        return 0;
+
+    #ifndef _WIN32
+        pthread_mutex_lock(&attrs_lock);
+    #endif
+    uint32_t id = 0;
+    if((attrs_count + 1) * 2 <= attrs_cap || attrs_grow() == 0){
+        uint32_t *slot = attrs_slot(attrs);
+        id = *slot;
+        uint32_t block = attrs_count / TREE_ATTRS_BLOCK;
+        if(id == 0 && block < TREE_ATTRS_BLOCKS){
+            if(!attrs_blocks[block])
+                attrs_blocks[block] = malloc(TREE_ATTRS_BLOCK * sizeof(EntryAttrs));
+            if(attrs_blocks[block]){
+                id = attrs_count++;
+                attrs_blocks[block][id % TREE_ATTRS_BLOCK] = *attrs;
+                *slot = id;
+            }
+        }
+    }
+    #ifndef _WIN32
+        pthread_mutex_unlock(&attrs_lock);
+    #endif
+
+    if(id == 0)
+        fprintf(stderr, "warning (parsing): attribute set could not be stored, defaults kept.\n");
+    return id;
+}
+
+const EntryAttrs *tree_attrs(uint32_t id){
+    return id == 0 ? NULL : &attrs_blocks[id / TREE_ATTRS_BLOCK][id % TREE_ATTRS_BLOCK];
+}
+
+/* ---------------- Path index ----------------
+ * Owned nodes already store their full path and are keyed on it; nodes of a
+ * mounted (included) subtree store paths relative to their mount point, so
+ * their full path is interned once in the index key blocks.
+ */
+#define TREE_INDEX_BLOCK 65536
+
+// Place a slot without checking the load factor
+static void index_place(TreeIndexSlot *slots, size_t cap, TreeIndexSlot slot){
+    size_t i = slot.hash & (cap - 1);
+    while(slots[i].node != NULL)
+        i = (i + 1) & (cap - 1);
+    slots[i] = slot;
+}
+
+// Add a node under key, growing the table to keep it at most 3/4 full
+static void index_add(TreeIndex *idx, const char *key, Tree node){
+    if(idx->failed)
+        return;
+
+    if((idx->count + 1) * 4 > idx->cap * 3){
+        size_t new_cap = idx->cap ? idx->cap * 2 : 64;
+        TreeIndexSlot *tmp = calloc(new_cap, sizeof(TreeIndexSlot));
+        if(!tmp){
+            fprintf(stderr, "error (index): failed to grow the path index, lookups will walk the tree.\n");
+            idx->failed = true;
+            return;
+        }
+        for(size_t i = 0; i < idx->cap; i++)
+            if(idx->slots[i].node)
+                index_place(tmp, new_cap, idx->slots[i]);
+        free(idx->slots);
+        idx->slots = tmp;
+        idx->cap = new_cap;
+    }
+
+    // A path declared twice keeps its first node
+    size_t hash = hash_bytes(key, strlen(key), HASH_SEED);
+    size_t i = hash & (idx->cap - 1);
+    for(; idx->slots[i].node; i = (i + 1) & (idx->cap - 1))
+        if(idx->slots[i].hash == hash && strcmp(idx->slots[i].key, key) == 0)
+            return;
+    idx->slots[i] = (TreeIndexSlot){ hash, key, node };
+    idx->count++;
+}
+
+// Intern prefix[0..prefix_len) + separator + path, NULL on allocation failure
+static const char *index_intern(TreeIndex *idx, const char *prefix, size_t prefix_len, const char *path){
+    size_t n = prefix_len + 1 + strlen(path) + 1;
+    TreeIndexBlock *b = idx->keys;
+    if(!b || b->cap - b->used < n){
+        size_t cap = n > TREE_INDEX_BLOCK ? n : TREE_INDEX_BLOCK;
+        b = malloc(sizeof(TreeIndexBlock) + cap);
+        if(!b)
+            return NULL;
+        b->next = idx->keys;
+        b->used = 0;
+        b->cap = cap;
+        idx->keys = b;
+    }
+
+    char *key = b->data + b->used;
+    memcpy(key, prefix, prefix_len);
+    key[prefix_len] = PATH_SEPARATOR;
+    memcpy(key + prefix_len + 1, path, n - prefix_len - 1);
+    b->used += n;
+    return key;
+}
+
+/* Subtree walk: frame data holds the key of the node, frame mark the
+ * length of the prefix its own path was appended to (0 for none) */
+typedef struct IndexWalk {
+    TreeIndex *idx;             // Index being filled
+    const char *prefix;         // Full path of the mount point of the walk root, NULL for none
+    size_t prefix_len;          // Length of prefix
+} IndexWalk;
+
+static TreeWalkAction index_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    IndexWalk *walk = ctx;
+    Tree node = frame->node;
+    const char *prefix = walk->prefix;
+    size_t prefix_len = walk->prefix_len;
+
+    if(parent){
+        // A nested mount starts from the full path of its parent, other nodes share its prefix
+        prefix = parent->data;
+        prefix_len = node->is_shared ? strlen(parent->data) : parent->mark;
+        if(!node->is_shared && parent->mark == 0)
+            prefix = NULL;
+    }
+
+    const char *key = prefix ? index_intern(walk->idx, prefix, prefix_len, node->path) : node->path;
+    if(!key){
+        fprintf(stderr, "error (index): failed to store the path of \"%s\", lookups will walk the tree.\n", node->path);
+        walk->idx->failed = true;
+        return TREE_WALK_STOP;
+    }
+
+    frame->data = (void *)key;
+    frame->mark = prefix ? prefix_len : 0;
+    index_add(walk->idx, key, node);
+
+    // Owned nodes share the index so attach_child can extend it, mounted ones belong to their template
+    if(!prefix)
+        node->index = walk->idx;
+    return TREE_WALK_CONTINUE;
+}
+
+// Index node and everything below it, prefix names the mount point (NULL for none)
+static void index_subtree(TreeIndex *idx, Tree node, const char *prefix, size_t prefix_len){
+    IndexWalk walk = { idx, prefix, prefix_len };
+    TreeVisitor visitor = { index_pre, NULL, &walk };
+    tree_walk(node, &visitor);
+}
+
+static void index_free(TreeIndex *idx){
+    while(idx->keys){
+        TreeIndexBlock *next = idx->keys->next;
+        free(idx->keys);
+        idx->keys = next;
+    }
+    free(idx->slots);
+    free(idx);
+}
+
+int tree_index(Tree root){
+    if(is_empty_tree(root))
+        return EXIT_FAILURE;
+    if(root->index && root->index->root == root)
+        return EXIT_SUCCESS;
+
+    TreeIndex *idx = calloc(1, sizeof(TreeIndex));
+    if(!idx){
+        fprintf(stderr, "error (index): failed to allocate the path index.\n");
+        return EXIT_FAILURE;
+    }
+    idx->root = root;
+    index_subtree(idx, root, NULL, 0);
+    return idx->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 Tree attach_child(Tree parent, const char *name){
     // Check if the parent is empty
     if(is_empty_tree(parent))
@@ -44,21 +279,37 @@ Tree attach_child(Tree parent, const char *name){
         return new_tree(name);
     
 
+    // A link keeps its target where the children would be
+    if(parent->link != TREE_LINK_NONE){
+        fprintf(stderr, "warning (parsing): \"%s\" can not be nested under the link \"%s\", entry ignored.\n", name, parent->path);
+        return NULL;
+    }
+
     // Create a new node
     Tree node = new_tree(name);
+    if(is_empty_tree(node))                         /* Invalid name, already reported */
+        return NULL;
 
     /* ======================== Attach node to the parent ======================== */
 
     node->parent = parent;      
-    // Reallocate path buffer to PATH_MAX and build full path including parent
-    node->path = realloc(node->path, PATH_MAX);
-    if(node->path == NULL){                         /* Check if allocation failed */
+    // Build the full path from the parent path and the node name (without trailing slash)
+    size_t parent_len = strlen(parent->path);
+    size_t name_len = strlen(node->path);
+    char *full_path = malloc(parent_len + name_len + 2);
+    if(full_path == NULL){                          /* Check if allocation failed */
         // Print the error
         fprintf(stderr, "fatal (parsing): memory allocation failed for \"%s\".\n", name);
+        clean_tree(&node);                          /* Clean the tree */
         return NULL;                                /* Exit and return null */
     }
     // Attach the parent and child path to node path
-    snprintf(node->path, PATH_MAX, "%s%c%s", node->parent->path, PATH_SEPARATOR, name);
+    memcpy(full_path, parent->path, parent_len);
+    full_path[parent_len] = PATH_SEPARATOR;
+    memcpy(full_path + parent_len + 1, node->path, name_len + 1);
+    free(node->path);
+    node->path = full_path;
+    node->name = full_path + parent_len + 1;
 
     // Reallocate parent children
     Tree *new_children = realloc(parent->children, (parent->child_count + 1) * sizeof(Tree));
@@ -74,9 +325,156 @@ Tree attach_child(Tree parent, const char *name){
 
     // Add the created node to parent children array
     parent->children[parent->child_count++] = node;
+
+    // Keep the path index of the tree up to date
+    if(parent->index){
+        node->index = parent->index;
+        index_add(node->index, node->path, node);
+    }
+    TRACE_PROBE2(attach_child, parent->path, node->name);
     return node;                                    /* return the node */
 }
 
+int tree_set_link(Tree node, TreeLink link, const char *target){
+    // Links stand for files, the target takes the place of the children array
+    if(is_empty_tree(node) || node->is_directory || node->child_count > 0 || node->link != TREE_LINK_NONE)
+        return EXIT_FAILURE;
+
+    // A hard link is created from its target: it must not reach outside the destination
+    size_t levels = 0;
+    for(Tree up = node->parent; up; up = up->parent)
+        levels++;
+    if(link == TREE_LINK_HARD && !tree_link_inside(target, levels))
+        return EXIT_FAILURE;
+
+    char *copy = strdup(target);
+    if(!copy){
+        fprintf(stderr, "fatal (parsing): memory allocation failed for the target of \"%s\".\n", node->path);
+        return EXIT_FAILURE;
+    }
+    free(node->children);
+    node->target = copy;
+    node->link = (uint8_t)link;
+    return EXIT_SUCCESS;
+}
+
+bool tree_link_inside(const char *target, size_t levels){
+    if(!target || !*target || target[0] == '/' || target[0] == '\\')
+        return false;
+
+    // Follow the names from the link directory, ".." may climb up to the root but not above it
+    size_t depth = levels;
+    bool named = false;             /* The last name is a file name, not "." or ".." */
+    for(const char *seg = target; *seg; ){
+        size_t len = strcspn(seg, "/\\");
+        named = false;
+        if(len == 2 && seg[0] == '.' && seg[1] == '.'){
+            if(depth <= 1)
+                return false;
+            depth--;
+        } else if(len > 0 && !(len == 1 && seg[0] == '.')){
+            depth++;
+            named = true;
+        }
+        seg += len + (seg[len] != '\0');
+    }
+    return named;
+}
+
+Tree tree_link_resolve(const Tree node){
+    if(is_empty_tree(node) || node->link != TREE_LINK_HARD)
+        return NULL;
+
+    // tree_link_inside keeps ".." below the root of the template holding the link, included ones too
+    Tree at = node->parent;
+    for(const char *seg = node->target; at && *seg; ){
+        size_t len = strcspn(seg, "/");
+        if(len == 2 && seg[0] == '.' && seg[1] == '.')
+            at = at->parent;
+        else if(len > 0 && !(len == 1 && seg[0] == '.')){
+            Tree found = NULL;
+            for(size_t i = 0; i < at->child_count && !found; i++){
+                Tree child = at->children[i];
+                if(child && strncmp(child->name, seg, len) == 0 && child->name[len] == '\0')
+                    found = child;
+            }
+            // A link can not be walked through, nor be the target: it may lead outside the destination
+            if(found && found->link != TREE_LINK_NONE)
+                found = NULL;
+            at = (found && (found->is_directory || seg[len] == '\0')) ? found : NULL;
+        }
+        seg += len + (seg[len] == '/');
+    }
+    return (at && !at->is_directory) ? at : NULL;
+}
+
+Tree mount_subtree(Tree parent, Tree subtree){
+    // Check the parent and the subtree
+    if(is_empty_tree(parent) || is_empty_tree(subtree))
+        return NULL;
+
+    // Reallocate parent children
+    Tree *new_children = realloc(parent->children, (parent->child_count + 1) * sizeof(Tree));
+    if(new_children == NULL){                       /* Check if allocation failed */
+        // Print the error
+        fprintf(stderr, "fatal (parsing) : memory allocation failed for \"%s\".\n", subtree->name);
+        return NULL;                                /* Exit and return null */
+    }
+    parent->children = new_children;
+
+    // The subtree is referenced, not owned: mark it so clean_tree leaves it alone
+    if(!subtree->is_shared)                         /* Already set for cached includes, which may be read concurrently */
+        subtree->is_shared = true;
+    parent->children[parent->child_count++] = subtree;
+
+    // Index the mounted nodes under the full path of the mount point
+    if(parent->index)
+        index_subtree(parent->index, subtree, parent->path, strlen(parent->path));
+    return subtree;                                 /* return the mounted subtree */
+}
+
+Tree tree_find(Tree root, const char *path){
+    if(is_empty_tree(root) || !path)
+        return NULL;
+
+    TreeIndex *idx = root->index;
+    if(idx && idx->root == root && !idx->failed){
+        size_t hash = hash_bytes(path, strlen(path), HASH_SEED);
+        for(size_t i = hash & (idx->cap - 1); idx->slots[i].node; i = (i + 1) & (idx->cap - 1))
+            if(idx->slots[i].hash == hash && strcmp(idx->slots[i].key, path) == 0)
+                return idx->slots[i].node;
+        return NULL;
+    }
+
+    // No index: match one name per level, starting with the root itself
+    const char separators[] = { '/', PATH_SEPARATOR, '\0' };
+    Tree node = root;
+    const char *p = path;
+    for(;;){
+        size_t len = strcspn(p, separators);
+        if(strncmp(node->name, p, len) != 0 || node->name[len] != '\0')
+            return NULL;
+        if(p[len] == '\0')
+            return node;
+        p += len + 1;
+
+        Tree next = NULL;
+        size_t next_len = strcspn(p, separators);
+        for(size_t i = 0; i < node->child_count && !next; i++){
+            Tree child = node->children[i];
+            if(child && strncmp(child->name, p, next_len) == 0 && child->name[next_len] == '\0')
+                next = child;
+        }
+        if(!next)
+            return NULL;
+        node = next;
+    }
+}
+
+bool tree_contains(Tree root, const char *path){
+    return tree_find(root, path) != NULL;
+}
+
 bool is_empty_tree(Tree tree){
     return tree == NULL;    /* Return the test result */
 }
@@ -86,43 +484,112 @@ void print_tree(Tree tree, int level){
     if(is_empty_tree(tree))
         return;
 
-    // Print tab for each level 
-    for(int i = 0; i < level; i++)
-        printf("    "); 
-    
-    // Print the tree
-    printf("%s%s\n", tree->path,(tree->is_directory) ? "/" : "");    
-
-    // Recusivelly call the function for each child of the tree
-    for(size_t i = 0; i < tree->child_count; i++) 
-        print_tree(tree->children[i], level + 1);
-        
+    // Flush what stdio holds, then write through the buffered text exporter
+    fflush(stdout);
+    export_text(tree, level, STDOUT_FILENO);
 }
 
-void clean_tree(Tree *tree){
-    // Check if tree is empty and return
-    if(is_empty_tree(*tree))    
-        return;
+int tree_walk(Tree root, const TreeVisitor *visitor){
+    if(is_empty_tree(root))
+        return EXIT_SUCCESS;
+
+    // Start on the C stack, move to the heap for deep trees
+    TreeFrame inline_stack[TREE_WALK_INLINE];
+    TreeFrame *stack = inline_stack;
+    size_t cap = TREE_WALK_INLINE;
+    size_t open = 0;
+    int status = EXIT_SUCCESS;
+
+    stack[0] = (TreeFrame){ root, 0, 0, NULL, 0 };
+    TreeWalkAction action = visitor->pre ? visitor->pre(&stack[0], NULL, visitor->ctx) : TREE_WALK_CONTINUE;
+    if(action == TREE_WALK_STOP)
+        return EXIT_FAILURE;
+    if(action == TREE_WALK_CONTINUE)
+        open = 1;
+
+    while(open > 0){
+        TreeFrame *frame = &stack[open - 1];
+        Tree node = frame->node;
 
-    // Check if the tree has no children
-    if((*tree)->children != NULL){
-        // Recursivelly call the fucntion for each tree child
-        for(size_t i = 0; i <(*tree)->child_count; ++i){
-            if((*tree)->children[i] != NULL){
-                clean_tree(&(*tree)->children[i]);
-                (*tree)->children[i] = NULL; 
+        while(frame->next < node->child_count && !node->children[frame->next])
+            frame->next++;
+
+        // Every child visited: leave the node
+        if(frame->next == node->child_count){
+            action = visitor->post ? visitor->post(frame, open > 1 ? &stack[open - 2] : NULL, visitor->ctx) : TREE_WALK_CONTINUE;
+            open--;
+            if(action == TREE_WALK_STOP){
+                status = EXIT_FAILURE;
+                break;
             }
+            continue;
         }
-        // Free the children array
-        free((*tree)->children); 
-        (*tree)->children = NULL;
+
+        if(open == cap){
+            size_t new_cap = cap * 2;
+            TreeFrame *tmp = (stack == inline_stack) ? malloc(new_cap * sizeof(TreeFrame)) : realloc(stack, new_cap * sizeof(TreeFrame));
+            if(!tmp){
+                fprintf(stderr, "fatal (walk): memory allocation failed at depth %zu.\n", open);
+                status = EXIT_FAILURE;
+                break;
+            }
+            if(stack == inline_stack)
+                memcpy(tmp, inline_stack, sizeof(inline_stack));
+            stack = tmp;
+            cap = new_cap;
+            frame = &stack[open - 1];
+        }
+
+        stack[open] = (TreeFrame){ node->children[frame->next++], open, 0, NULL, 0 };
+        action = visitor->pre ? visitor->pre(&stack[open], frame, visitor->ctx) : TREE_WALK_CONTINUE;
+        if(action == TREE_WALK_STOP){
+            status = EXIT_FAILURE;
+            break;
+        }
+        if(action == TREE_WALK_CONTINUE)
+            open++;
     }
 
-    // Free the tree path
-    free((*tree)->path);
-    (*tree)->path = NULL;
+    // Stopped early: let the visitor release what the open frames hold
+    for(; open > 0 && visitor->post; open--)
+        visitor->post(&stack[open - 1], open > 1 ? &stack[open - 2] : NULL, visitor->ctx);
+
+    if(stack != inline_stack)
+        free(stack);
+    return status;
+}
+
+// Shared (included) subtrees below the root belong to the include cache
+static TreeWalkAction clean_pre(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    (void)ctx;
+    return (parent && frame->node->is_shared) ? TREE_WALK_SKIP : TREE_WALK_CONTINUE;
+}
+
+// Children are gone by now: free the node itself
+static TreeWalkAction clean_post(TreeFrame *frame, TreeFrame *parent, void *ctx){
+    (void)parent;
+    (void)ctx;
+    Tree node = frame->node;
+    if(node->link != TREE_LINK_NONE)
+        free(node->target);
+    else
+        free(node->children);
+    free(node->path);
+    free(node);
+    return TREE_WALK_CONTINUE;
+}
+
+void clean_tree(Tree *tree){
+    // Check if tree is empty and return
+    if(is_empty_tree(*tree))
+        return;
+
+    // The index of a tree goes with its root
+    if((*tree)->index && (*tree)->index->root == *tree)
+        index_free((*tree)->index);
 
-    // Finally free the tree 
-    free((*tree));
+    // Free bottom-up, the parent child arrays stay readable until their own post
+    TreeVisitor visitor = { clean_pre, clean_post, NULL };
+    tree_walk(*tree, &visitor);
     (*tree) = NULL;
 }
@@ -12,3 +12,13 @@ char *_strndup(const char *src, size_t n){
     dest[len] = '\0';
     return dest;                    /* Return dest */
 }
+
+size_t hash_bytes(const void *data, size_t n, size_t seed){
+    const unsigned char *p = data;
+    size_t h = seed;
+    for(size_t i = 0; i < n; i++){
+        h ^= p[i];                          /* Mix the byte in */
+        h *= (size_t)1099511628211ULL;      /* FNV prime */
+    }
+    return h;                               /* Return the hash */
+}
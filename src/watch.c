@@ -0,0 +1,135 @@
+#include "watch.h"
+
+#ifdef __linux__
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_on_signal(int sig){
+    (void)sig;
+    watch_stop = 1;
+}
+
+static double elapsed_ms(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Parse the template again and create what the previous tree did not have
+static void watch_apply(const char *path, Tree *current, int dest_fd){
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Tree next = parse_tokens(path);
+    if(!next){
+        fprintf(stderr, "error (watch): \"%s\" could not be parsed, keeping the previous tree.\n", path);
+        return;
+    }
+
+    DiffStats stats;
+    int status = diff_trees_at(*current, next, dest_fd, true, stdout, &stats);
+    printf("watch: %zu added, %zu removed (kept), %zu retyped, %zu changed in %.2f ms%s\n",
+           stats.added, stats.removed, stats.retyped, stats.changed, elapsed_ms(&start), status != 0 ? ", with errors" : "");
+    fflush(stdout);
+
+    clean_tree(current);
+    *current = next;
+}
+
+// Read the pending events, returns true if one of them names the template
+static bool watch_drain(int in, const char *name){
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool hit = false;
+
+    for(;;){
+        ssize_t n = read(in, buf, sizeof(buf));
+        if(n <= 0)
+            return hit;
+        for(char *p = buf; p < buf + n; ){
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if(ev->len > 0 && strcmp(ev->name, name) == 0)
+                hit = true;
+            if(ev->mask & IN_Q_OVERFLOW)
+                hit = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+int watch_template(const char *path, const char *dest_dir){
+    if(strcmp(path, "-") == 0){
+        fprintf(stderr, "fatal (watch): the standard input cannot be watched.\n");
+        return EXIT_FAILURE;
+    }
+
+    int dest_fd = open(dest_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dest_fd < 0){
+        fprintf(stderr, "fatal (watch): cannot open destination \"%s\".\n", dest_dir);
+        return EXIT_FAILURE;
+    }
+
+    // Watch the directory: editors often save by renaming a new file over the template
+    char *dir = strdup(path);
+    if(!dir){
+        fprintf(stderr, "fatal (watch): memory allocation failed for \"%s\".\n", path);
+        close(dest_fd);
+        return EXIT_FAILURE;
+    }
+    char *slash = strrchr(dir, '/');
+    const char *name = slash ? path + (slash - dir) + 1 : path;
+    if(slash == dir)
+        dir[1] = '\0';
+    else if(slash)
+        *slash = '\0';
+
+    int in = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(in < 0 || inotify_add_watch(in, slash ? dir : ".", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0){
+        fprintf(stderr, "fatal (watch): cannot watch \"%s\".\n", path);
+        if(in >= 0)
+            close(in);
+        free(dir);
+        close(dest_fd);
+        return EXIT_FAILURE;
+    }
+
+    // Stop on interrupt: the handler has no SA_RESTART, so poll returns
+    struct sigaction sa = { 0 };
+    sa.sa_handler = watch_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // The first pass diffs against nothing, which builds the whole template
+    Tree current = NULL;
+    watch_apply(path, &current, dest_fd);
+
+    struct pollfd pfd = { .fd = in, .events = POLLIN };
+    while(!watch_stop){
+        if(poll(&pfd, 1, -1) <= 0 || !watch_drain(in, name))
+            continue;
+
+        // Let the save settle: wait until the directory has been quiet for a moment
+        while(!watch_stop && poll(&pfd, 1, WATCH_SETTLE_MS) > 0)
+            watch_drain(in, name);
+
+        if(!watch_stop)
+            watch_apply(path, &current, dest_fd);
+    }
+
+    clean_tree(&current);
+    close(in);
+    free(dir);
+    close(dest_fd);
+    return EXIT_SUCCESS;
+}
+
+#else
+
+int watch_template(const char *path, const char *dest_dir){
+    (void)path;
+    (void)dest_dir;
+    fprintf(stderr, "fatal (watch): watching is not supported on this platform.\n");
+    return EXIT_FAILURE;
+}
+
+#endif